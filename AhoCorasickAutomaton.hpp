@@ -5,7 +5,10 @@
 #include <unordered_set>
 #include <vector>
 #include <queue>
+#include <stdexcept>
+#include <type_traits>
 
+// state identifier of the automata with the default identifier width
 typedef uint32_t type_state_id;
 
 
@@ -30,6 +33,37 @@ public:
 };
 
 
+/**
+ * Position of a match inside the original text, expressed in bytes: [begin_offset, end_offset).
+ */
+class PatternSpan {
+public:
+    size_t begin_offset;
+    size_t end_offset;
+
+public:
+    PatternSpan(size_t begin_offset, size_t end_offset) :
+            begin_offset(begin_offset),
+            end_offset(end_offset) {}
+};
+
+
+/**
+ * Which matches are reported:
+ *  - MATCH_ALL: all the matches ordered by end position (with the suffixes if they are included);
+ *  - MATCH_LEFTMOST_FIRST: non-overlapping matches, from left to right; among the matches that start in the same
+ *    position the one with the highest priority is chosen, i.e. the pattern inserted first (the lowest key with
+ *    DenseKeys);
+ *  - MATCH_LEFTMOST_LONGEST: non-overlapping matches, from left to right; among the matches that start in the same
+ *    position the longest one is chosen.
+ */
+enum MatchSemantics {
+    MATCH_ALL,
+    MATCH_LEFTMOST_FIRST,
+    MATCH_LEFTMOST_LONGEST
+};
+
+
 /**
  *
  * @tparam KeyType
@@ -38,22 +72,340 @@ template<typename KeyType>
 class PatternMatches : public std::vector<PatternMatch<KeyType>> {
 private:
     bool b_include_suffixes;
+    bool b_include_spans;
+    MatchSemantics semantics;
+    // when the spans are included, the i-th span refers to the i-th match
+    std::vector<PatternSpan> v_spans;
 
 public:
-    PatternMatches(bool include_suffixes = true) :
-            b_include_suffixes(include_suffixes) {}
+    /**
+     * @param include_suffixes Whether the suffixes of the matches are included (only with MATCH_ALL)
+     * @param include_spans Whether the byte spans of the matches are recorded
+     * @param semantics Which matches are reported
+     */
+    PatternMatches(bool include_suffixes = true, bool include_spans = false, MatchSemantics semantics = MATCH_ALL) :
+            b_include_suffixes(include_suffixes && semantics == MATCH_ALL),
+            b_include_spans(include_spans),
+            semantics(semantics) {}
 
     bool include_suffixes() const {
         return this->b_include_suffixes;
     }
+
+    MatchSemantics get_semantics() const {
+        return this->semantics;
+    }
+
+    bool include_spans() const {
+        return this->b_include_spans;
+    }
+
+    const std::vector<PatternSpan> &spans() const {
+        return this->v_spans;
+    }
+
+    void push_span(const PatternSpan &span) {
+        this->v_spans.push_back(span);
+    }
+
+    void clear() {
+        std::vector<PatternMatch<KeyType>>::clear();
+        this->v_spans.clear();
+    }
+};
+
+
+/**
+ * Selection of the non-overlapping leftmost matches during a scan. The candidates are received by end position and the
+ * emission of a match is deferred until no later candidate can start before it or in the same position, i.e. for
+ * max_pattern_length words. Only the best candidate of each start position is kept, hence the window never contains
+ * more than max_pattern_length candidates.
+ * @tparam KeyType
+ */
+template<typename KeyType>
+class LeftmostMatchSelector {
+private:
+    class Candidate {
+    public:
+        KeyType pattern;
+        size_t begin_pos;
+        size_t end_pos;
+        size_t priority;
+        size_t begin_offset;
+        size_t end_offset;
+
+    public:
+        Candidate(const KeyType &pattern, size_t begin_pos, size_t end_pos, size_t priority, size_t begin_offset,
+                  size_t end_offset) :
+                pattern(pattern),
+                begin_pos(begin_pos),
+                end_pos(end_pos),
+                priority(priority),
+                begin_offset(begin_offset),
+                end_offset(end_offset) {}
+    };
+
+    MatchSemantics semantics;
+    size_t max_pattern_length;
+    // the candidates that start before this position overlap an emitted match
+    size_t min_begin_pos;
+    std::vector<Candidate> v_window;
+
+public:
+    LeftmostMatchSelector(MatchSemantics semantics, size_t max_pattern_length) :
+            semantics(semantics),
+            max_pattern_length(max_pattern_length),
+            min_begin_pos(0) {}
+
+    /**
+     * Add a candidate that ends in the current position.
+     * @param priority The priority of the pattern (the lower the better), used by MATCH_LEFTMOST_FIRST
+     */
+    void
+    add_candidate(
+            const KeyType &pattern,
+            size_t begin_pos,
+            size_t end_pos,
+            size_t priority,
+            size_t begin_offset = 0,
+            size_t end_offset = 0
+    ) {
+        if (begin_pos < this->min_begin_pos) {
+            return;
+        }
+        for (size_t i = 0, i_max = this->v_window.size(); i < i_max; ++i) {
+            Candidate &candidate = this->v_window[i];
+            if (candidate.begin_pos == begin_pos) {
+                // the candidates with the same start end in order, hence the new one is the longest
+                if (this->semantics == MATCH_LEFTMOST_LONGEST || priority < candidate.priority) {
+                    candidate = Candidate(pattern, begin_pos, end_pos, priority, begin_offset, end_offset);
+                }
+                return;
+            }
+        }
+        this->v_window.push_back(Candidate(pattern, begin_pos, end_pos, priority, begin_offset, end_offset));
+    }
+
+    /**
+     * Emit the matches that cannot be changed by the candidates of the next positions.
+     * @param end_pos The position of the last scanned word
+     * @param matches Where to put the selected matches
+     */
+    void
+    flush(
+            size_t end_pos,
+            PatternMatches<KeyType> &matches
+    ) {
+        // the next candidates end after end_pos, hence they start at least in end_pos + 2 - max_pattern_length
+        const size_t min_next_begin_pos = (end_pos + 2 > this->max_pattern_length)
+                                          ? end_pos + 2 - this->max_pattern_length : 0;
+        this->_emit(min_next_begin_pos, matches);
+    }
+
+    /**
+     * Emit all the remaining matches at the end of the text.
+     */
+    void
+    finish(
+            PatternMatches<KeyType> &matches
+    ) {
+        this->_emit((size_t) -1, matches);
+    }
+
+private:
+    void
+    _emit(
+            size_t min_next_begin_pos,
+            PatternMatches<KeyType> &matches
+    ) {
+        while (!this->v_window.empty()) {
+            size_t best = 0;
+            for (size_t i = 1, i_max = this->v_window.size(); i < i_max; ++i) {
+                if (this->v_window[i].begin_pos < this->v_window[best].begin_pos) {
+                    best = i;
+                }
+            }
+            if (this->v_window[best].begin_pos >= min_next_begin_pos) {
+                return;
+            }
+
+            const Candidate &candidate = this->v_window[best];
+            matches.push_back(PatternMatch<KeyType>(candidate.pattern, candidate.end_pos));
+            if (matches.include_spans()) {
+                matches.push_span(PatternSpan(candidate.begin_offset, candidate.end_offset));
+            }
+            // drop the candidates that overlap the emitted match
+            this->min_begin_pos = candidate.end_pos + 1;
+            size_t num_kept = 0;
+            for (size_t i = 0, i_max = this->v_window.size(); i < i_max; ++i) {
+                if (this->v_window[i].begin_pos >= this->min_begin_pos) {
+                    this->v_window[num_kept++] = this->v_window[i];
+                }
+            }
+            this->v_window.erase(this->v_window.begin() + num_kept, this->v_window.end());
+        }
+    }
+};
+
+
+/**
+ * Policies that define how the pattern keys are mapped to the internal pattern identifiers.
+ * SparseKeys accepts any hashable key, while DenseKeys requires the keys to be small non-negative integers (ideally
+ * 0..N-1) and uses them directly as internal identifiers, without any hash table.
+ */
+struct SparseKeys {
+};
+
+struct DenseKeys {
+};
+
+
+/**
+ *
+ * @tparam KeyType
+ * @tparam IdType
+ * @tparam KeyPolicy
+ */
+template<typename KeyType, typename IdType, typename KeyPolicy>
+class PatternKeyMap;
+
+template<typename KeyType, typename IdType>
+class PatternKeyMap<KeyType, IdType, SparseKeys> {
+private:
+    std::vector<KeyType> v_pattern_id_to_pattern_key;
+    std::unordered_map<KeyType, IdType> h_pattern_key_to_pattern_id;
+
+public:
+    bool
+    find(
+            const KeyType &key,
+            IdType &pattern_id
+    ) const {
+        auto it = this->h_pattern_key_to_pattern_id.find(key);
+        if (it == this->h_pattern_key_to_pattern_id.end()) {
+            return false;
+        }
+        pattern_id = it->second;
+        return true;
+    }
+
+    IdType
+    insert(
+            const KeyType &key
+    ) {
+        const size_t next_pattern_id = this->v_pattern_id_to_pattern_key.size();
+        if (next_pattern_id >= (size_t) (IdType) -1) {
+            throw std::runtime_error("Too many patterns have been inserted");
+        }
+        this->v_pattern_id_to_pattern_key.push_back(key);
+        this->h_pattern_key_to_pattern_id[key] = (IdType) next_pattern_id;
+        return (IdType) next_pattern_id;
+    }
+
+    const KeyType &
+    get_key(
+            IdType pattern_id
+    ) const {
+        return this->v_pattern_id_to_pattern_key[pattern_id];
+    }
+
+    size_t
+    size() const {
+        return this->v_pattern_id_to_pattern_key.size();
+    }
+
+    void
+    reserve(
+            size_t num_patterns
+    ) {
+        this->v_pattern_id_to_pattern_key.reserve(num_patterns);
+        this->h_pattern_key_to_pattern_id.reserve(num_patterns * 2);
+    }
+
+    void
+    reduce_memory_footprint() {
+        this->v_pattern_id_to_pattern_key.shrink_to_fit();
+        // for the hash table we ensures a load factor of 0.5
+        this->h_pattern_key_to_pattern_id.rehash(this->h_pattern_key_to_pattern_id.size() * 2);
+    }
+};
+
+template<typename KeyType, typename IdType>
+class PatternKeyMap<KeyType, IdType, DenseKeys> {
+private:
+    std::vector<bool> v_pattern_id_is_used;
+
+public:
+    bool
+    find(
+            const KeyType &key,
+            IdType &pattern_id
+    ) const {
+        if ((size_t) key >= this->v_pattern_id_is_used.size() || !this->v_pattern_id_is_used[(size_t) key]) {
+            return false;
+        }
+        pattern_id = (IdType) key;
+        return true;
+    }
+
+    IdType
+    insert(
+            const KeyType &key
+    ) {
+        if (key < 0 || (size_t) key >= (size_t) (IdType) -1) {
+            throw std::invalid_argument("The given key cannot be used as a dense pattern identifier");
+        }
+        if ((size_t) key >= this->v_pattern_id_is_used.size()) {
+            this->v_pattern_id_is_used.resize((size_t) key + 1, false);
+        }
+        this->v_pattern_id_is_used[(size_t) key] = true;
+        return (IdType) key;
+    }
+
+    KeyType
+    get_key(
+            IdType pattern_id
+    ) const {
+        return (KeyType) pattern_id;
+    }
+
+    size_t
+    size() const {
+        return this->v_pattern_id_is_used.size();
+    }
+
+    void
+    reserve(
+            size_t num_patterns
+    ) {
+        this->v_pattern_id_is_used.reserve(num_patterns);
+    }
+
+    void
+    reduce_memory_footprint() {
+        this->v_pattern_id_is_used.shrink_to_fit();
+    }
 };
 
 
-template<typename KeyType, typename SequenceType>
+/**
+ *
+ * @tparam KeyType
+ * @tparam SequenceType
+ * @tparam KeyPolicy How the keys are mapped to the pattern identifiers (SparseKeys or DenseKeys)
+ * @tparam IdType Unsigned integer used for the state, goto and pattern identifiers: a narrow type keeps the small
+ * dictionaries compact, while uint64_t allows more than 2^32 states
+ */
+template<typename KeyType, typename SequenceType, typename KeyPolicy = SparseKeys, typename IdType = uint32_t>
 class AhoCorasickAutomaton {
+    static_assert(std::is_unsigned<IdType>::value, "IdType must be an unsigned integer type");
+
+public:
+    typedef IdType type_state_id;
+
 private:
-    typedef uint32_t type_pattern_id;
-    typedef uint32_t type_goto_id;
+    typedef IdType type_pattern_id;
+    typedef IdType type_goto_id;
     typedef std::unordered_map<SequenceType, type_state_id> GotoTableType;
     typedef typename GotoTableType::const_iterator GotoTableIteratorType;
 
@@ -97,9 +449,8 @@ private:
     bool b_is_compiled;
     std::vector<AhoCorasickAutomaton::AhoCorasickNode> v_state_id_to_node;
     std::vector<AhoCorasickAutomaton::GotoTableType> v_goto_id_to_goto;
-    std::vector<KeyType> v_pattern_id_to_pattern_key;
+    PatternKeyMap<KeyType, type_pattern_id, KeyPolicy> pattern_keys;
     std::vector<type_pattern_id> v_pattern_id_to_longest_suffix_pattern_id;
-    std::unordered_map<KeyType, type_pattern_id> h_pattern_key_to_pattern_id;
 
 public:
     /**
@@ -109,9 +460,7 @@ public:
             b_is_compiled(false),
             v_state_id_to_node({AhoCorasickNode(0, AhoCorasickAutomaton::NO_PATTERN_ID)}),
             v_goto_id_to_goto(1),
-            v_pattern_id_to_pattern_key(0),
-            v_pattern_id_to_longest_suffix_pattern_id(0),
-            h_pattern_key_to_pattern_id(0) {}
+            v_pattern_id_to_longest_suffix_pattern_id(0) {}
 
     /**
      * Add a new pattern into the trie.
@@ -166,15 +515,14 @@ public:
         const size_t dst_initial_size = dst_matches.size();
         for (size_t i = 0, i_max = src_matches.size(); i < i_max; ++i) {
             // look for the pattern in the dictionary
-            auto it = this->h_pattern_key_to_pattern_id.find(((PatternMatch<KeyType>) src_matches[i]).pattern);
-            if (it == this->h_pattern_key_to_pattern_id.end()) {
+            type_pattern_id current_pattern_id;
+            if (!this->pattern_keys.find(((PatternMatch<KeyType>) src_matches[i]).pattern, current_pattern_id)) {
                 // the pattern is not in, hence I remove the inserted matches and then throws an exception
                 for (size_t j = 0, j_max = dst_matches.size() - dst_initial_size; j < j_max; ++j) {
                     dst_matches.pop_back();
                 }
                 throw std::runtime_error("One of the patterns inside the source matches have not been found");
             }
-            type_pattern_id current_pattern_id = it->second;
             const size_t end_pos = ((PatternMatch<KeyType>) src_matches[i]).end_pos;
 
             // insert the starting match
@@ -185,7 +533,7 @@ public:
                 if (current_pattern_id == AhoCorasickAutomaton::NO_PATTERN_ID)
                     break;
                 dst_matches.push_back(
-                        PatternMatch<KeyType>(this->v_pattern_id_to_pattern_key[current_pattern_id], end_pos));
+                        PatternMatch<KeyType>(this->pattern_keys.get_key(current_pattern_id), end_pos));
             }
         }
     }
@@ -222,17 +570,17 @@ public:
     ) const {
         type_state_id next_state_id = this->_get_next_state_id(current_state_id, sequence_element);
 
-        type_pattern_id current_pattern_id = this->v_state_id_to_node[next_state_id].l_output_pattern_id;
+        type_pattern_id current_pattern_id = this->v_state_id_to_node[next_state_id].l_pattern_id;
 
         // fill the patterns_accumulator
         if (current_pattern_id != AhoCorasickAutomaton::NO_PATTERN_ID) {
-            patterns_accumulator.push_back(this->v_pattern_id_to_pattern_key[current_pattern_id]);
+            patterns_accumulator.push_back(this->pattern_keys.get_key(current_pattern_id));
 
             while (true) {
                 current_pattern_id = this->v_pattern_id_to_longest_suffix_pattern_id[current_pattern_id];
                 if (current_pattern_id == AhoCorasickAutomaton::NO_PATTERN_ID)
                     break;
-                patterns_accumulator.push_back(this->v_pattern_id_to_pattern_key[current_pattern_id]);
+                patterns_accumulator.push_back(this->pattern_keys.get_key(current_pattern_id));
             }
         }
 
@@ -262,7 +610,7 @@ public:
 
         // fill the matches vector
         if (current_pattern_id != AhoCorasickAutomaton::NO_PATTERN_ID) {
-            matches.push_back(PatternMatch<KeyType>(this->v_pattern_id_to_pattern_key[current_pattern_id], pos));
+            matches.push_back(PatternMatch<KeyType>(this->pattern_keys.get_key(current_pattern_id), pos));
 
             if (matches.include_suffixes()) {
                 while (true) {
@@ -270,7 +618,7 @@ public:
                     if (current_pattern_id == AhoCorasickAutomaton::NO_PATTERN_ID)
                         break;
                     matches.push_back(
-                            PatternMatch<KeyType>(this->v_pattern_id_to_pattern_key[current_pattern_id], pos));
+                            PatternMatch<KeyType>(this->pattern_keys.get_key(current_pattern_id), pos));
                 }
             }
         }
@@ -279,6 +627,25 @@ public:
         return next_state_id;
     }
 
+    /**
+     * Call callback(key, pattern_id) for the pattern of a state and for all its suffixes, from the longest to the
+     * shortest one. The pattern identifiers follow the insertion order with SparseKeys and are the keys with DenseKeys.
+     * @param state_id The state identifier
+     * @param callback The function to call for each pattern
+     */
+    template<typename Callback>
+    void
+    for_each_state_pattern(
+            type_state_id state_id,
+            Callback callback
+    ) const {
+        type_pattern_id current_pattern_id = this->v_state_id_to_node[state_id].l_pattern_id;
+        while (current_pattern_id != AhoCorasickAutomaton::NO_PATTERN_ID) {
+            callback(this->pattern_keys.get_key(current_pattern_id), current_pattern_id);
+            current_pattern_id = this->v_pattern_id_to_longest_suffix_pattern_id[current_pattern_id];
+        }
+    }
+
     /**
      * Reduce the memory footprint of the internal data structures
      */
@@ -291,11 +658,10 @@ public:
         // I shrink and rehash the main data structures to reduce the amount of memory
         this->v_state_id_to_node.shrink_to_fit();
         this->v_goto_id_to_goto.shrink_to_fit();
-        this->v_pattern_id_to_pattern_key.shrink_to_fit();
         this->v_pattern_id_to_longest_suffix_pattern_id.shrink_to_fit();
+        this->pattern_keys.reduce_memory_footprint();
         // for the hash tables we ensures a load factor of 0.5
         const size_t size_multiplier = 2;
-        this->h_pattern_key_to_pattern_id.rehash(this->h_pattern_key_to_pattern_id.size() * size_multiplier);
         for (size_t i = 0, i_max = this->v_goto_id_to_goto.size(); i < i_max; ++i) {
             this->v_goto_id_to_goto[i].rehash(this->v_goto_id_to_goto[i].size() * size_multiplier);
         }
@@ -317,8 +683,7 @@ public:
         }
         this->v_state_id_to_node.reserve(num_patterns);
         this->v_goto_id_to_goto.reserve(num_patterns);
-        this->v_pattern_id_to_pattern_key.reserve(num_patterns);
-        this->h_pattern_key_to_pattern_id.reserve(num_patterns * 2);
+        this->pattern_keys.reserve(num_patterns);
     }
 
 
@@ -335,7 +700,8 @@ private:
             SequenceType const *pattern_begin,
             SequenceType const *pattern_end
     ) {
-        if (this->h_pattern_key_to_pattern_id.count(key) > 0) {
+        type_pattern_id existing_pattern_id;
+        if (this->pattern_keys.find(key, existing_pattern_id)) {
             throw std::invalid_argument("The given key has been already inserted");
         }
 
@@ -352,7 +718,7 @@ private:
             // check if the node has a goto table (otherwise create it)
             if (curr_node->l_goto_id == AhoCorasickAutomaton::NO_GOTO_ID) {
                 const size_t next_goto = this->v_goto_id_to_goto.size();
-                if (next_goto == AhoCorasickAutomaton::NO_GOTO_ID) {
+                if (next_goto >= (size_t) AhoCorasickAutomaton::NO_GOTO_ID) {
                     throw std::runtime_error("Too many branches have been inserted in the trie");
                 }
                 this->v_goto_id_to_goto.push_back(GotoTableType());
@@ -369,10 +735,10 @@ private:
             if (perform_find && (find_result = goto_table->find(*pattern_element)) != goto_table->end()) {
                 next_state_id = find_result->second;
             } else {
-                next_state_id = (type_state_id) this->v_state_id_to_node.size();
-                if (next_state_id == (type_state_id) -1) {
+                if (this->v_state_id_to_node.size() >= (size_t) (type_state_id) -1) {
                     throw std::runtime_error("Too many nodes have been inserted in the automaton");
                 }
+                next_state_id = (type_state_id) this->v_state_id_to_node.size();
                 this->v_state_id_to_node.push_back(
                         AhoCorasickNode(AhoCorasickAutomaton::NO_GOTO_ID, AhoCorasickAutomaton::NO_PATTERN_ID));
                 goto_table->operator[](*pattern_element) = next_state_id;
@@ -388,20 +754,12 @@ private:
         }
 
         // update the internal data structures _first, and then the destination node;
-        size_t next_pattern_id = this->v_pattern_id_to_pattern_key.size();
-        if (next_pattern_id == AhoCorasickAutomaton::NO_PATTERN_ID) {
-            throw std::runtime_error("Too many patterns have been inserted");
-        }
-
-        type_pattern_id pattern_id = this->v_pattern_id_to_pattern_key.size();
-        this->v_pattern_id_to_pattern_key.push_back(key);
-        this->h_pattern_key_to_pattern_id[key] = pattern_id;
-        curr_node->l_pattern_id = pattern_id;
+        curr_node->l_pattern_id = this->pattern_keys.insert(key);
     }
 
     void
     _compile() {
-        this->v_pattern_id_to_longest_suffix_pattern_id.resize(this->v_pattern_id_to_pattern_key.size(),
+        this->v_pattern_id_to_longest_suffix_pattern_id.resize(this->pattern_keys.size(),
                                                                AhoCorasickAutomaton::NO_PATTERN_ID);
 
         // the following queue is used to perform a bfs and update all the goto tables, the l_pattern_id and
@@ -0,0 +1,554 @@
+#ifndef BYTEPATTERNMATCHER_HPP
+#define BYTEPATTERNMATCHER_HPP
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "BufferManager.hpp"
+#include "AhoCorasickAutomaton.hpp"
+
+
+/**
+ * Byte-level (substring) pattern matcher. Differently from PatternMatcher, the text is not split into words and the
+ * patterns are matched as raw byte sequences everywhere in the text (URLs, hashtags, languages without spaces, ...).
+ * The end_pos of each match is the byte offset of the last byte of the pattern.
+ *
+ * After the compilation the automaton uses:
+ *  - an alphabet compressed into equivalence classes (all the bytes that do not appear in any pattern share a class);
+ *  - states numbered in BFS order, where the first (hot) states have a dense transition row of the full DFA and the
+ *    remaining ones keep their sorted trie edges plus a failure link;
+ *  - a prefilter that, from the initial state, jumps to the next occurrence of a rare byte of the patterns (SIMD) and
+ *    skips the regions of the text that cannot contain any match.
+ * @tparam KeyType
+ */
+template<typename KeyType>
+class BytePatternMatcher {
+private:
+    typedef uint32_t byte_state_id_t;
+    typedef uint32_t byte_pattern_id_t;
+    typedef uint16_t byte_class_t;
+
+    const byte_state_id_t NO_STATE_ID = (byte_state_id_t) -1;
+    const byte_pattern_id_t NO_PATTERN_ID = (byte_pattern_id_t) -1;
+    static const size_t MAX_PREFILTER_BYTES = 3;
+
+    enum PrefilterKind {
+        PREFILTER_NONE,
+        PREFILTER_BYTES,
+        PREFILTER_TABLE
+    };
+
+private:
+    bool b_is_compiled;
+    BufferManager buffer_manager;
+    std::unordered_set<MyString> pattern_set;
+    std::vector<MyString> v_pattern_id_to_pattern;
+    std::vector<KeyType> v_pattern_id_to_pattern_key;
+    std::vector<byte_pattern_id_t> v_pattern_id_to_longest_suffix_pattern_id;
+    size_t max_pattern_size;
+
+    // alphabet compression
+    byte_class_t byte_to_class[256];
+    size_t num_classes;
+
+    // dense rows of the hot states (the first num_dense_states states in BFS order)
+    const size_t max_dense_table_bytes;
+    size_t num_dense_states;
+    std::vector<byte_state_id_t> v_dense_transitions;
+
+    // sparse trie edges and failure links of the remaining states
+    std::vector<uint32_t> v_state_id_to_edges_begin;
+    std::vector<byte_class_t> v_edge_class;
+    std::vector<byte_state_id_t> v_edge_target;
+    std::vector<byte_state_id_t> v_state_id_to_fail_state_id;
+    std::vector<byte_pattern_id_t> v_state_id_to_pattern_id;
+
+    // prefilter
+    PrefilterKind prefilter_kind;
+    size_t num_prefilter_bytes;
+    uint8_t prefilter_bytes[MAX_PREFILTER_BYTES];
+    bool prefilter_table[256];
+    size_t prefilter_max_offset;
+
+public:
+    /**
+     * Create a new byte-level matcher.
+     * @param max_dense_table_bytes Memory budget for the dense transition rows of the hot states
+     */
+    BytePatternMatcher(size_t max_dense_table_bytes = 16 * 1024 * 1024) :
+            b_is_compiled(false),
+            max_pattern_size(0),
+            num_classes(0),
+            max_dense_table_bytes(max_dense_table_bytes),
+            num_dense_states(0),
+            prefilter_kind(PREFILTER_NONE),
+            num_prefilter_bytes(0),
+            prefilter_max_offset(0) {
+        memset(this->byte_to_class, 0, sizeof(this->byte_to_class));
+        memset(this->prefilter_table, 0, sizeof(this->prefilter_table));
+    }
+
+    void
+    add_pattern(
+            KeyType pattern_id,
+            const std::string &pattern
+    ) {
+        if (this->b_is_compiled) {
+            throw std::runtime_error("This method cannot be called after the matcher has been compiled");
+        }
+        if (pattern.empty()) {
+            throw std::invalid_argument("The empty pattern cannot be inserted");
+        }
+        if (this->pattern_set.count(MyString(pattern.c_str(), pattern.size()))) {
+            throw std::runtime_error("This pattern has been already inserted");
+        }
+        if (this->v_pattern_id_to_pattern.size() == BytePatternMatcher::NO_PATTERN_ID) {
+            throw std::runtime_error("Too many patterns have been inserted");
+        }
+
+        MyString pattern_block = this->buffer_manager.createDataBlock(&pattern[0], pattern.size());
+        this->pattern_set.insert(pattern_block);
+        this->v_pattern_id_to_pattern.push_back(pattern_block);
+        this->v_pattern_id_to_pattern_key.push_back(pattern_id);
+        this->max_pattern_size = std::max(this->max_pattern_size, pattern.size());
+    }
+
+    void
+    compile() {
+        if (this->b_is_compiled) {
+            return;
+        }
+        this->_compute_byte_classes();
+        this->_build_automaton();
+        this->_build_prefilter();
+        this->b_is_compiled = true;
+    }
+
+    void
+    find_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        if (!this->b_is_compiled) {
+            throw std::runtime_error("This method cannot be called before the matcher compilation");
+        }
+
+        if (matches.get_semantics() != MATCH_ALL) {
+            this->_find_leftmost_patterns(text, matches);
+            return;
+        }
+
+        const uint8_t *data = (const uint8_t *) text.data();
+        const size_t size = text.size();
+        byte_state_id_t current_state_id = 0;
+        // the prefilter is used only from the initial state and past the last candidate found
+        size_t prefilter_barrier = 0;
+
+        for (size_t pos = 0; pos < size; ++pos) {
+            if (current_state_id == 0 && pos >= prefilter_barrier && this->prefilter_kind != PREFILTER_NONE) {
+                const size_t candidate_pos = this->_prefilter_find(data, pos, size);
+                if (candidate_pos == size) {
+                    break;
+                }
+                // restart a bit before the candidate, since the rare byte can be in the middle of a pattern
+                if (candidate_pos - pos > this->prefilter_max_offset) {
+                    pos = candidate_pos - this->prefilter_max_offset;
+                }
+                prefilter_barrier = candidate_pos + 1;
+            }
+
+            current_state_id = this->_get_next_state_id(current_state_id, this->byte_to_class[data[pos]]);
+
+            byte_pattern_id_t current_pattern_id = this->v_state_id_to_pattern_id[current_state_id];
+            if (current_pattern_id != BytePatternMatcher::NO_PATTERN_ID) {
+                this->_push_match(current_pattern_id, pos, matches);
+
+                if (matches.include_suffixes()) {
+                    while (true) {
+                        current_pattern_id = this->v_pattern_id_to_longest_suffix_pattern_id[current_pattern_id];
+                        if (current_pattern_id == BytePatternMatcher::NO_PATTERN_ID)
+                            break;
+                        this->_push_match(current_pattern_id, pos, matches);
+                    }
+                }
+            }
+        }
+    }
+
+    size_t
+    get_num_classes() const {
+        return this->num_classes;
+    }
+
+    size_t
+    get_num_states() const {
+        return this->v_state_id_to_pattern_id.size();
+    }
+
+    size_t
+    get_num_dense_states() const {
+        return this->num_dense_states;
+    }
+
+    void
+    reserve(
+            size_t num_patterns
+    ) {
+        this->pattern_set.reserve(num_patterns);
+        this->v_pattern_id_to_pattern.reserve(num_patterns);
+        this->v_pattern_id_to_pattern_key.reserve(num_patterns);
+    }
+
+private:
+    /**
+     * Leftmost scan: the positions are byte offsets and the priority of a pattern is its insertion order. The
+     * prefilter is not used, since the deferred candidates need every position to be flushed.
+     */
+    void
+    _find_leftmost_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        const uint8_t *data = (const uint8_t *) text.data();
+        const size_t size = text.size();
+        byte_state_id_t current_state_id = 0;
+        LeftmostMatchSelector<KeyType> selector(matches.get_semantics(), this->max_pattern_size);
+
+        for (size_t pos = 0; pos < size; ++pos) {
+            current_state_id = this->_get_next_state_id(current_state_id, this->byte_to_class[data[pos]]);
+
+            byte_pattern_id_t current_pattern_id = this->v_state_id_to_pattern_id[current_state_id];
+            while (current_pattern_id != BytePatternMatcher::NO_PATTERN_ID) {
+                const size_t pattern_size = this->v_pattern_id_to_pattern[current_pattern_id].size();
+                selector.add_candidate(this->v_pattern_id_to_pattern_key[current_pattern_id], pos + 1 - pattern_size,
+                                       pos, current_pattern_id, pos + 1 - pattern_size, pos + 1);
+                current_pattern_id = this->v_pattern_id_to_longest_suffix_pattern_id[current_pattern_id];
+            }
+            selector.flush(pos, matches);
+        }
+        selector.finish(matches);
+    }
+
+    void
+    _push_match(
+            byte_pattern_id_t pattern_id,
+            size_t pos,
+            PatternMatches<KeyType> &matches
+    ) const {
+        matches.push_back(PatternMatch<KeyType>(this->v_pattern_id_to_pattern_key[pattern_id], pos));
+        if (matches.include_spans()) {
+            matches.push_span(PatternSpan(pos + 1 - this->v_pattern_id_to_pattern[pattern_id].size(), pos + 1));
+        }
+    }
+
+    /**
+     * Assign a class to each byte: the bytes used by the patterns have their own class, all the others share the 0.
+     */
+    void
+    _compute_byte_classes() {
+        bool is_used[256] = {false};
+        for (size_t i = 0, i_max = this->v_pattern_id_to_pattern.size(); i < i_max; ++i) {
+            const MyString &pattern = this->v_pattern_id_to_pattern[i];
+            for (size_t j = 0, j_max = pattern.size(); j < j_max; ++j) {
+                is_used[(uint8_t) pattern.data()[j]] = true;
+            }
+        }
+
+        // the shared class exists only if at least one byte is not used
+        this->num_classes = (std::count(is_used, is_used + 256, true) == 256) ? 0 : 1;
+        for (size_t b = 0; b < 256; ++b) {
+            this->byte_to_class[b] = is_used[b] ? (byte_class_t) this->num_classes++ : 0;
+        }
+    }
+
+    void
+    _build_automaton() {
+        // 1) build a temporary trie over the byte classes
+        std::vector<std::vector<std::pair<byte_class_t, byte_state_id_t>>> trie_edges(1);
+        std::vector<byte_pattern_id_t> trie_pattern_id(1, BytePatternMatcher::NO_PATTERN_ID);
+
+        for (size_t pattern_id = 0, i_max = this->v_pattern_id_to_pattern.size(); pattern_id < i_max; ++pattern_id) {
+            const MyString &pattern = this->v_pattern_id_to_pattern[pattern_id];
+            byte_state_id_t curr_state_id = 0;
+            for (size_t j = 0, j_max = pattern.size(); j < j_max; ++j) {
+                const byte_class_t cls = this->byte_to_class[(uint8_t) pattern.data()[j]];
+                byte_state_id_t next_state_id = BytePatternMatcher::NO_STATE_ID;
+                for (size_t e = 0, e_max = trie_edges[curr_state_id].size(); e < e_max; ++e) {
+                    if (trie_edges[curr_state_id][e].first == cls) {
+                        next_state_id = trie_edges[curr_state_id][e].second;
+                        break;
+                    }
+                }
+                if (next_state_id == BytePatternMatcher::NO_STATE_ID) {
+                    if (trie_edges.size() == BytePatternMatcher::NO_STATE_ID) {
+                        throw std::runtime_error("Too many nodes have been inserted in the automaton");
+                    }
+                    next_state_id = (byte_state_id_t) trie_edges.size();
+                    trie_edges[curr_state_id].push_back(std::make_pair(cls, next_state_id));
+                    trie_edges.push_back(std::vector<std::pair<byte_class_t, byte_state_id_t>>());
+                    trie_pattern_id.push_back(BytePatternMatcher::NO_PATTERN_ID);
+                }
+                curr_state_id = next_state_id;
+            }
+            trie_pattern_id[curr_state_id] = (byte_pattern_id_t) pattern_id;
+        }
+
+        // 2) renumber the states in BFS order (with sorted children), so that the hot states come first
+        const size_t num_states = trie_edges.size();
+        std::vector<byte_state_id_t> bfs_order;
+        bfs_order.reserve(num_states);
+        std::vector<byte_state_id_t> old_to_new(num_states);
+        bfs_order.push_back(0);
+        for (size_t i = 0; i < bfs_order.size(); ++i) {
+            std::vector<std::pair<byte_class_t, byte_state_id_t>> &edges = trie_edges[bfs_order[i]];
+            std::sort(edges.begin(), edges.end());
+            for (size_t e = 0, e_max = edges.size(); e < e_max; ++e) {
+                bfs_order.push_back(edges[e].second);
+            }
+        }
+        for (size_t i = 0; i < num_states; ++i) {
+            old_to_new[bfs_order[i]] = (byte_state_id_t) i;
+        }
+
+        this->v_state_id_to_edges_begin.assign(num_states + 1, 0);
+        this->v_edge_class.clear();
+        this->v_edge_target.clear();
+        this->v_edge_class.reserve(num_states - 1);
+        this->v_edge_target.reserve(num_states - 1);
+        this->v_state_id_to_pattern_id.resize(num_states);
+        for (size_t i = 0; i < num_states; ++i) {
+            const std::vector<std::pair<byte_class_t, byte_state_id_t>> &edges = trie_edges[bfs_order[i]];
+            this->v_state_id_to_edges_begin[i] = (uint32_t) this->v_edge_class.size();
+            for (size_t e = 0, e_max = edges.size(); e < e_max; ++e) {
+                this->v_edge_class.push_back(edges[e].first);
+                this->v_edge_target.push_back(old_to_new[edges[e].second]);
+            }
+            this->v_state_id_to_pattern_id[i] = trie_pattern_id[bfs_order[i]];
+        }
+        this->v_state_id_to_edges_begin[num_states] = (uint32_t) this->v_edge_class.size();
+        trie_edges.clear();
+        trie_edges.shrink_to_fit();
+
+        // 3) compute the failure links and the output links (the parents are always before their children)
+        this->v_state_id_to_fail_state_id.assign(num_states, 0);
+        this->v_pattern_id_to_longest_suffix_pattern_id.assign(this->v_pattern_id_to_pattern.size(),
+                                                               BytePatternMatcher::NO_PATTERN_ID);
+        for (size_t state_id = 0; state_id < num_states; ++state_id) {
+            for (uint32_t e = this->v_state_id_to_edges_begin[state_id],
+                         e_max = this->v_state_id_to_edges_begin[state_id + 1]; e < e_max; ++e) {
+                const byte_state_id_t child_id = this->v_edge_target[e];
+                const byte_state_id_t fail_id = (state_id == 0) ? 0 : this->_get_next_trie_state_id(
+                        this->v_state_id_to_fail_state_id[state_id], this->v_edge_class[e]);
+                this->v_state_id_to_fail_state_id[child_id] = fail_id;
+
+                const byte_pattern_id_t fail_pattern_id = this->v_state_id_to_pattern_id[fail_id];
+                if (fail_pattern_id != BytePatternMatcher::NO_PATTERN_ID) {
+                    if (this->v_state_id_to_pattern_id[child_id] != BytePatternMatcher::NO_PATTERN_ID) {
+                        this->v_pattern_id_to_longest_suffix_pattern_id[this->v_state_id_to_pattern_id[child_id]] =
+                                fail_pattern_id;
+                    } else {
+                        this->v_state_id_to_pattern_id[child_id] = fail_pattern_id;
+                    }
+                }
+            }
+        }
+
+        // 4) fill the dense rows of the hot states within the memory budget
+        const size_t row_bytes = this->num_classes * sizeof(byte_state_id_t);
+        this->num_dense_states = std::min(num_states, std::max((size_t) 1, this->max_dense_table_bytes / row_bytes));
+        this->v_dense_transitions.assign(this->num_dense_states * this->num_classes, 0);
+        for (size_t state_id = 0; state_id < this->num_dense_states; ++state_id) {
+            byte_state_id_t *row = &this->v_dense_transitions[state_id * this->num_classes];
+            // the failure state has a smaller BFS id, hence its row is already complete
+            if (state_id != 0) {
+                const byte_state_id_t fail_id = this->v_state_id_to_fail_state_id[state_id];
+                memcpy(row, &this->v_dense_transitions[fail_id * this->num_classes], row_bytes);
+            }
+            for (uint32_t e = this->v_state_id_to_edges_begin[state_id],
+                         e_max = this->v_state_id_to_edges_begin[state_id + 1]; e < e_max; ++e) {
+                row[this->v_edge_class[e]] = this->v_edge_target[e];
+            }
+        }
+    }
+
+    /**
+     * Choose the prefilter: for each pattern one of its rarest bytes; if they are too many, the set of first bytes.
+     */
+    void
+    _build_prefilter() {
+        bool is_chosen[256] = {false};
+        size_t num_chosen = 0;
+        size_t max_offset = 0;
+
+        for (size_t i = 0, i_max = this->v_pattern_id_to_pattern.size(); i < i_max; ++i) {
+            const MyString &pattern = this->v_pattern_id_to_pattern[i];
+            // reuse an already chosen byte if possible, otherwise pick the rarest one
+            size_t best_offset = pattern.size();
+            for (size_t j = 0, j_max = pattern.size(); j < j_max && best_offset == pattern.size(); ++j) {
+                if (is_chosen[(uint8_t) pattern.data()[j]]) {
+                    best_offset = j;
+                }
+            }
+            if (best_offset == pattern.size()) {
+                best_offset = 0;
+                for (size_t j = 1, j_max = pattern.size(); j < j_max; ++j) {
+                    if (_byte_frequency_rank((uint8_t) pattern.data()[j]) <
+                        _byte_frequency_rank((uint8_t) pattern.data()[best_offset])) {
+                        best_offset = j;
+                    }
+                }
+                is_chosen[(uint8_t) pattern.data()[best_offset]] = true;
+                ++num_chosen;
+            }
+            max_offset = std::max(max_offset, best_offset);
+        }
+
+        if (num_chosen == 0) {
+            this->prefilter_kind = PREFILTER_NONE;
+        } else if (num_chosen <= BytePatternMatcher::MAX_PREFILTER_BYTES) {
+            this->prefilter_kind = PREFILTER_BYTES;
+            this->num_prefilter_bytes = 0;
+            for (size_t b = 0; b < 256; ++b) {
+                if (is_chosen[b]) {
+                    this->prefilter_bytes[this->num_prefilter_bytes++] = (uint8_t) b;
+                }
+            }
+            this->prefilter_max_offset = max_offset;
+        } else {
+            // skip all the bytes that cannot start a pattern, i.e. the root transitions to itself
+            this->prefilter_kind = PREFILTER_TABLE;
+            size_t num_first_bytes = 0;
+            for (size_t b = 0; b < 256; ++b) {
+                this->prefilter_table[b] = this->_get_next_state_id(0, this->byte_to_class[b]) != 0;
+                num_first_bytes += this->prefilter_table[b];
+            }
+            this->prefilter_max_offset = 0;
+            // when almost every byte is a candidate the prefilter is only overhead
+            if (num_first_bytes > 128) {
+                this->prefilter_kind = PREFILTER_NONE;
+            }
+        }
+    }
+
+    /**
+     * Find the position of the next candidate byte starting from pos (or size if there is none).
+     */
+    size_t
+    _prefilter_find(
+            const uint8_t *data,
+            size_t pos,
+            size_t size
+    ) const {
+        if (this->prefilter_kind == PREFILTER_TABLE) {
+            while (pos < size && !this->prefilter_table[data[pos]]) {
+                ++pos;
+            }
+            return pos;
+        }
+
+        if (this->num_prefilter_bytes == 1) {
+            const void *found = memchr(data + pos, this->prefilter_bytes[0], size - pos);
+            return found ? (size_t) ((const uint8_t *) found - data) : size;
+        }
+
+#if defined(__SSE2__)
+        const __m128i needle0 = _mm_set1_epi8((char) this->prefilter_bytes[0]);
+        const __m128i needle1 = _mm_set1_epi8((char) this->prefilter_bytes[1]);
+        const __m128i needle2 = _mm_set1_epi8(
+                (char) this->prefilter_bytes[this->num_prefilter_bytes == 3 ? 2 : 1]);
+        for (; pos + 16 <= size; pos += 16) {
+            const __m128i block = _mm_loadu_si128((const __m128i *) (data + pos));
+            const __m128i eq = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(block, needle0), _mm_cmpeq_epi8(block, needle1)),
+                    _mm_cmpeq_epi8(block, needle2));
+            const int mask = _mm_movemask_epi8(eq);
+            if (mask != 0) {
+                return pos + __builtin_ctz((unsigned int) mask);
+            }
+        }
+#endif
+        for (; pos < size; ++pos) {
+            for (size_t i = 0; i < this->num_prefilter_bytes; ++i) {
+                if (data[pos] == this->prefilter_bytes[i]) {
+                    return pos;
+                }
+            }
+        }
+        return size;
+    }
+
+    /**
+     * Approximate frequency of a byte in common text: the higher, the more frequent.
+     */
+    static size_t
+    _byte_frequency_rank(
+            uint8_t byte
+    ) {
+        static const char *common_bytes = " etaoinsrhldcumfpgwybvkxjqzETAOINSRHLDCUMFPGWYBVKXJQZ0123456789.,-/:_'\"\n\t";
+        const char *found = (byte == 0) ? nullptr : strchr(common_bytes, (char) byte);
+        return found ? strlen(common_bytes) - (size_t) (found - common_bytes) : 0;
+    }
+
+    /**
+     * Follow the trie edge of a sparse state (or NO_STATE_ID if there is none).
+     */
+    byte_state_id_t
+    _find_edge(
+            byte_state_id_t state_id,
+            byte_class_t cls
+    ) const {
+        const byte_class_t *begin = this->v_edge_class.data() + this->v_state_id_to_edges_begin[state_id];
+        const byte_class_t *end = this->v_edge_class.data() + this->v_state_id_to_edges_begin[state_id + 1];
+        const byte_class_t *found = std::lower_bound(begin, end, cls);
+        if (found == end || *found != cls) {
+            return BytePatternMatcher::NO_STATE_ID;
+        }
+        return this->v_edge_target[found - this->v_edge_class.data()];
+    }
+
+    /**
+     * Transition computed only through the trie edges and the failure links (used during the compilation).
+     */
+    byte_state_id_t
+    _get_next_trie_state_id(
+            byte_state_id_t state_id,
+            byte_class_t cls
+    ) const {
+        while (true) {
+            const byte_state_id_t next_state_id = this->_find_edge(state_id, cls);
+            if (next_state_id != BytePatternMatcher::NO_STATE_ID) {
+                return next_state_id;
+            }
+            if (state_id == 0) {
+                return 0;
+            }
+            state_id = this->v_state_id_to_fail_state_id[state_id];
+        }
+    }
+
+    byte_state_id_t
+    _get_next_state_id(
+            byte_state_id_t state_id,
+            byte_class_t cls
+    ) const {
+        // the dense states have the full row, the sparse ones follow the failure links until a dense state
+        while (state_id >= this->num_dense_states) {
+            const byte_state_id_t next_state_id = this->_find_edge(state_id, cls);
+            if (next_state_id != BytePatternMatcher::NO_STATE_ID) {
+                return next_state_id;
+            }
+            state_id = this->v_state_id_to_fail_state_id[state_id];
+        }
+        return this->v_dense_transitions[state_id * this->num_classes + cls];
+    }
+};
+
+#endif //BYTEPATTERNMATCHER_HPP
@@ -0,0 +1,542 @@
+#ifndef EXTERNALMATCHERBUILDER_HPP
+#define EXTERNALMATCHERBUILDER_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "SuccinctPatternMatcher.hpp"
+
+
+/**
+ * Out-of-core compilation of a SuccinctPatternMatcher, for the dictionaries whose build does not fit in memory.
+ *
+ * The patterns are tokenized as they are added and appended to a file in the work directory, hence only the vocabulary
+ * stays in memory. The build then:
+ *  1) reads the patterns back in chunks that fit in the RAM budget, sorts each chunk and writes it as a sorted run;
+ *  2) merges the runs, obtaining the patterns in lexicographic order, i.e. the trie in DFS order: every node is written
+ *     to the file of its depth when its subtree is complete, so that reading the files one after the other gives the
+ *     nodes in the BFS order of SuccinctPatternMatcher;
+ *  3) streams the level files into the LOUDS trie, computes the failure links in BFS order and saves the compiled
+ *     matcher, which can then be loaded with SuccinctPatternMatcher::load.
+ * The peak memory is the RAM budget (the sort of a chunk, or the buffers of the merge) plus the vocabulary plus the
+ * compiled automaton, independently of the number and of the size of the patterns. The result is the same of
+ * SuccinctPatternMatcher::compile with the patterns added in the same order.
+ * @tparam KeyType A trivially copyable type
+ */
+template<typename KeyType>
+class ExternalMatcherBuilder {
+private:
+    const size_t MAX_PATTERN_WORDS = 32;
+    const size_t MIN_STREAM_BUFFER_BYTES = 64 * 1024;
+    // estimated memory of a word in the vocabulary, besides its bytes
+    const size_t VOCABULARY_ENTRY_BYTES = 64;
+
+    /**
+     * Sequential reader of the pattern records: the number of words, the key and the words.
+     */
+    class PatternReader {
+    private:
+        std::vector<char> v_buffer;
+        std::ifstream input;
+
+    public:
+        std::vector<uint32_t> v_words;
+        KeyType key;
+
+    public:
+        PatternReader(const std::string &path, size_t buffer_bytes) :
+                v_buffer(buffer_bytes) {
+            this->input.rdbuf()->pubsetbuf(&this->v_buffer[0], this->v_buffer.size());
+            this->input.open(path.c_str(), std::ios::binary);
+            if (!this->input) {
+                throw std::runtime_error("Unable to open " + path);
+            }
+        }
+
+        /**
+         * @return Whether a pattern has been read, false at the end of the file
+         */
+        bool
+        next() {
+            uint32_t num_words;
+            if (!this->input.read((char *) &num_words, sizeof(num_words))) {
+                return false;
+            }
+            this->v_words.resize(num_words);
+            this->input.read((char *) &this->key, sizeof(KeyType));
+            if (num_words > 0) {
+                this->input.read((char *) &this->v_words[0], num_words * sizeof(uint32_t));
+            }
+            if (!this->input) {
+                throw std::runtime_error("Truncated file of patterns");
+            }
+            return true;
+        }
+    };
+
+    std::string work_directory;
+    size_t ram_budget_bytes;
+    bool b_is_built;
+    TextNormalizer normalizer;
+    std::string scratch_word;
+    std::vector<uint32_t> v_scratch_words;
+    std::vector<std::string> v_temporary_paths;
+
+    // vocabulary, the words have temporary identifiers in order of appearance
+    std::unordered_map<std::string, uint32_t> h_word_to_word_id;
+    size_t vocabulary_bytes;
+    // final identifiers 1..R of the words that start a pattern, in order of appearance (see SuccinctPatternMatcher)
+    std::vector<uint32_t> v_word_id_to_first_word_id;
+    size_t num_first_words;
+
+    std::string patterns_path;
+    std::ofstream patterns_output;
+    size_t num_patterns;
+    size_t num_runs;
+
+public:
+    /**
+     * @param work_directory Directory of the temporary files, which need about twice the size of the tokenized patterns
+     * @param ram_budget_bytes Memory used to sort and to merge the patterns
+     */
+    ExternalMatcherBuilder(const std::string &work_directory, size_t ram_budget_bytes = 256 * 1024 * 1024) :
+            work_directory(work_directory),
+            ram_budget_bytes(ram_budget_bytes),
+            b_is_built(false),
+            vocabulary_bytes(0),
+            v_word_id_to_first_word_id(1, 0),
+            num_first_words(0),
+            num_patterns(0),
+            num_runs(0) {
+        static_assert(std::is_trivially_copyable<KeyType>::value, "The keys must be trivially copyable");
+        this->patterns_path = this->_make_temporary_path("patterns");
+        this->patterns_output.open(this->patterns_path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!this->patterns_output) {
+            throw std::runtime_error("Unable to create " + this->patterns_path);
+        }
+    }
+
+    ~ExternalMatcherBuilder() {
+        this->_remove_temporary_files();
+    }
+
+    ExternalMatcherBuilder(const ExternalMatcherBuilder &) = delete;
+
+    ExternalMatcherBuilder &operator=(const ExternalMatcherBuilder &) = delete;
+
+    /**
+     * Set the normalization applied to both the patterns and the texts. It must be set before adding the patterns.
+     */
+    void
+    set_normalizer(
+            const TextNormalizer &normalizer
+    ) {
+        if (this->num_patterns > 0) {
+            throw std::runtime_error("The normalizer cannot be changed after adding the patterns");
+        }
+        this->normalizer = normalizer;
+    }
+
+    void
+    add_pattern(
+            KeyType pattern_id,
+            const std::string &pattern
+    ) {
+        if (this->b_is_built) {
+            throw std::runtime_error("This method cannot be called after the build");
+        }
+        this->v_scratch_words.clear();
+        this->normalizer.for_each_word(
+                pattern.data(), pattern.size(), this->scratch_word,
+                [this](const MyString &word, size_t, size_t) {
+                    if (this->v_scratch_words.size() == this->MAX_PATTERN_WORDS) {
+                        throw std::invalid_argument("The given pattern has too many words");
+                    }
+                    const std::string word_string(word.data(), word.size());
+                    auto find_word_it = this->h_word_to_word_id.find(word_string);
+                    if (find_word_it == this->h_word_to_word_id.end()) {
+                        const uint32_t word_id = (uint32_t) this->h_word_to_word_id.size() + 1;
+                        this->h_word_to_word_id[word_string] = word_id;
+                        this->v_word_id_to_first_word_id.push_back(0);
+                        this->vocabulary_bytes += word.size() + this->VOCABULARY_ENTRY_BYTES;
+                        this->v_scratch_words.push_back(word_id);
+                    } else {
+                        this->v_scratch_words.push_back(find_word_it->second);
+                    }
+                });
+        if (!this->v_scratch_words.empty()) {
+            uint32_t &first_word_id = this->v_word_id_to_first_word_id[this->v_scratch_words[0]];
+            if (first_word_id == 0) {
+                first_word_id = (uint32_t) ++this->num_first_words;
+            }
+        }
+        this->_write_pattern(this->patterns_output, pattern_id, this->v_scratch_words.data(),
+                             this->v_scratch_words.size());
+        ++this->num_patterns;
+    }
+
+    /**
+     * Compile the patterns into a file that can be loaded with SuccinctPatternMatcher::load, and remove the temporary
+     * files.
+     */
+    void
+    build(
+            const std::string &output_path
+    ) {
+        if (this->b_is_built) {
+            throw std::runtime_error("The matcher has been already built");
+        }
+        this->b_is_built = true;
+        this->patterns_output.close();
+        if (!this->patterns_output) {
+            throw std::runtime_error("Unable to write " + this->patterns_path);
+        }
+
+        try {
+            const std::vector<uint32_t> v_final_word_ids = this->_compute_final_word_ids();
+            const std::vector<std::string> run_paths = this->_write_sorted_runs(v_final_word_ids);
+            std::vector<size_t> v_level_sizes;
+            const std::vector<std::string> level_paths = this->_write_levels(run_paths, v_level_sizes);
+
+            SuccinctPatternMatcher<KeyType> matcher;
+            matcher.normalizer = this->normalizer;
+            this->_build_automaton(level_paths, v_level_sizes, matcher);
+            this->_remove_temporary_files();
+
+            // the vocabulary is compiled by the matcher, with the final identifiers
+            for (auto it = this->h_word_to_word_id.begin(), it_end = this->h_word_to_word_id.end();
+                 it != it_end; ++it) {
+                it->second = v_final_word_ids[it->second];
+            }
+            matcher.h_word_to_word_id.swap(this->h_word_to_word_id);
+            matcher._compile_vocabulary();
+            matcher.b_is_compiled = true;
+            matcher.save(output_path);
+        } catch (...) {
+            this->_remove_temporary_files();
+            throw;
+        }
+    }
+
+    size_t
+    get_num_patterns() const {
+        return this->num_patterns;
+    }
+
+    /**
+     * @return The number of sorted runs written by the build
+     */
+    size_t
+    get_num_runs() const {
+        return this->num_runs;
+    }
+
+private:
+    std::string
+    _make_temporary_path(
+            const std::string &name
+    ) {
+        const std::string path = this->work_directory + "/matcher_build_" + std::to_string(getpid()) + "_" +
+                                 std::to_string((uintptr_t) this) + "_" + name;
+        this->v_temporary_paths.push_back(path);
+        return path;
+    }
+
+    void
+    _remove_temporary_files() {
+        if (this->patterns_output.is_open()) {
+            this->patterns_output.close();
+        }
+        for (size_t i = 0, i_max = this->v_temporary_paths.size(); i < i_max; ++i) {
+            remove(this->v_temporary_paths[i].c_str());
+        }
+        this->v_temporary_paths.clear();
+    }
+
+    void
+    _write_pattern(
+            std::ostream &output,
+            const KeyType &key,
+            const uint32_t *words,
+            size_t num_words
+    ) const {
+        const uint32_t size = (uint32_t) num_words;
+        output.write((const char *) &size, sizeof(size));
+        output.write((const char *) &key, sizeof(KeyType));
+        output.write((const char *) words, num_words * sizeof(uint32_t));
+    }
+
+    /**
+     * Map the temporary word identifiers to the final ones: the words that start a pattern take 1..R, the others
+     * follow in order of appearance, like in SuccinctPatternMatcher.
+     */
+    std::vector<uint32_t>
+    _compute_final_word_ids() const {
+        const size_t num_words = this->h_word_to_word_id.size();
+        std::vector<uint32_t> v_final_word_ids(num_words + 1, 0);
+        uint32_t next_word_id = (uint32_t) this->num_first_words + 1;
+        for (size_t word_id = 1; word_id <= num_words; ++word_id) {
+            const uint32_t first_word_id = this->v_word_id_to_first_word_id[word_id];
+            v_final_word_ids[word_id] = (first_word_id != 0) ? first_word_id : next_word_id++;
+        }
+        return v_final_word_ids;
+    }
+
+    /**
+     * Phase 1: read the patterns in chunks of the RAM budget and write each chunk sorted by the final identifiers.
+     */
+    std::vector<std::string>
+    _write_sorted_runs(
+            const std::vector<uint32_t> &v_final_word_ids
+    ) {
+        // the buffers of the streams are not counted, they are small compared to the budget
+        const size_t chunk_bytes = (this->ram_budget_bytes > this->vocabulary_bytes + 2 * this->MIN_STREAM_BUFFER_BYTES)
+                                   ? this->ram_budget_bytes - this->vocabulary_bytes
+                                   : 2 * this->MIN_STREAM_BUFFER_BYTES;
+        const size_t pattern_bytes = sizeof(size_t) + sizeof(KeyType) + sizeof(uint32_t);
+        std::vector<std::string> run_paths;
+        PatternReader reader(this->patterns_path, this->MIN_STREAM_BUFFER_BYTES);
+        std::vector<uint32_t> v_words;
+        std::vector<size_t> v_begins;
+        std::vector<KeyType> v_keys;
+        std::vector<uint32_t> v_order;
+
+        bool has_pattern = reader.next();
+        while (has_pattern) {
+            v_words.clear();
+            v_begins.assign(1, 0);
+            v_keys.clear();
+            // at least one pattern per chunk
+            do {
+                for (size_t i = 0, i_max = reader.v_words.size(); i < i_max; ++i) {
+                    v_words.push_back(v_final_word_ids[reader.v_words[i]]);
+                }
+                v_begins.push_back(v_words.size());
+                v_keys.push_back(reader.key);
+                has_pattern = reader.next();
+            } while (has_pattern &&
+                     v_words.size() * sizeof(uint32_t) + v_keys.size() * pattern_bytes < chunk_bytes);
+
+            v_order.resize(v_keys.size());
+            for (size_t i = 0, i_max = v_order.size(); i < i_max; ++i) {
+                v_order[i] = (uint32_t) i;
+            }
+            std::sort(v_order.begin(), v_order.end(), [&v_words, &v_begins](uint32_t a, uint32_t b) {
+                return std::lexicographical_compare(
+                        v_words.begin() + v_begins[a], v_words.begin() + v_begins[a + 1],
+                        v_words.begin() + v_begins[b], v_words.begin() + v_begins[b + 1]);
+            });
+
+            run_paths.push_back(this->_make_temporary_path("run_" + std::to_string(run_paths.size())));
+            std::ofstream output(run_paths.back().c_str(), std::ios::binary | std::ios::trunc);
+            for (size_t i = 0, i_max = v_order.size(); i < i_max; ++i) {
+                const uint32_t pattern = v_order[i];
+                this->_write_pattern(output, v_keys[pattern], v_words.data() + v_begins[pattern],
+                                     v_begins[pattern + 1] - v_begins[pattern]);
+            }
+            output.close();
+            if (!output) {
+                throw std::runtime_error("Unable to write " + run_paths.back());
+            }
+        }
+        this->num_runs = run_paths.size();
+        remove(this->patterns_path.c_str());
+        return run_paths;
+    }
+
+    /**
+     * Phase 2: merge the runs and write the nodes of the trie to the files of their depths. Each node is written when
+     * its subtree is complete, with its label, its number of children and its pattern if any.
+     */
+    std::vector<std::string>
+    _write_levels(
+            const std::vector<std::string> &run_paths,
+            std::vector<size_t> &v_level_sizes
+    ) {
+        const size_t num_levels = this->MAX_PATTERN_WORDS + 1;
+        const size_t buffer_bytes = std::max(this->MIN_STREAM_BUFFER_BYTES,
+                                             this->ram_budget_bytes / 2 / std::max((size_t) 1, run_paths.size()));
+        std::vector<std::unique_ptr<PatternReader>> readers;
+        for (size_t i = 0, i_max = run_paths.size(); i < i_max; ++i) {
+            readers.push_back(std::unique_ptr<PatternReader>(new PatternReader(run_paths[i], buffer_bytes)));
+        }
+        std::vector<std::string> level_paths;
+        std::vector<std::unique_ptr<std::ofstream>> level_outputs;
+        for (size_t depth = 0; depth < num_levels; ++depth) {
+            level_paths.push_back(this->_make_temporary_path("level_" + std::to_string(depth)));
+            level_outputs.push_back(std::unique_ptr<std::ofstream>(
+                    new std::ofstream(level_paths.back().c_str(), std::ios::binary | std::ios::trunc)));
+            if (!*level_outputs.back()) {
+                throw std::runtime_error("Unable to create " + level_paths.back());
+            }
+        }
+        v_level_sizes.assign(num_levels, 0);
+
+        // min-heap of the readers by their current pattern
+        auto is_greater = [&readers](size_t a, size_t b) {
+            return std::lexicographical_compare(readers[b]->v_words.begin(), readers[b]->v_words.end(),
+                                                readers[a]->v_words.begin(), readers[a]->v_words.end());
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(is_greater)> heap(is_greater);
+        for (size_t i = 0, i_max = readers.size(); i < i_max; ++i) {
+            if (readers[i]->next()) {
+                heap.push(i);
+            }
+        }
+
+        // the open nodes are the path from the root to the node of the last pattern
+        std::vector<uint32_t> v_labels(num_levels, 0);
+        std::vector<uint32_t> v_degrees(num_levels, 0);
+        std::vector<bool> v_is_terminal(num_levels, false);
+        std::vector<KeyType> v_keys(num_levels);
+        std::vector<uint32_t> v_last_words;
+        bool has_last = false;
+        size_t depth = 0;
+
+        while (!heap.empty()) {
+            PatternReader &reader = *readers[heap.top()];
+            const std::vector<uint32_t> &words = reader.v_words;
+            if (has_last && words == v_last_words) {
+                throw std::invalid_argument("The given pattern was already inside the automaton");
+            }
+            size_t common_size = 0;
+            while (common_size < words.size() && common_size < v_last_words.size() &&
+                   words[common_size] == v_last_words[common_size]) {
+                ++common_size;
+            }
+            for (; depth > common_size; --depth) {
+                this->_write_node(*level_outputs[depth], v_labels[depth], v_degrees[depth], v_is_terminal[depth],
+                                  v_keys[depth]);
+                ++v_level_sizes[depth];
+            }
+            for (; depth < words.size(); ++depth) {
+                ++v_degrees[depth];
+                v_labels[depth + 1] = words[depth];
+                v_degrees[depth + 1] = 0;
+                v_is_terminal[depth + 1] = false;
+            }
+            v_is_terminal[depth] = true;
+            v_keys[depth] = reader.key;
+            v_last_words = words;
+            has_last = true;
+
+            const size_t reader_id = heap.top();
+            heap.pop();
+            if (reader.next()) {
+                heap.push(reader_id);
+            }
+        }
+        while (true) {
+            this->_write_node(*level_outputs[depth], v_labels[depth], v_degrees[depth], v_is_terminal[depth],
+                              v_keys[depth]);
+            ++v_level_sizes[depth];
+            if (depth == 0) {
+                break;
+            }
+            --depth;
+        }
+
+        for (size_t i = 0; i < num_levels; ++i) {
+            level_outputs[i]->close();
+            if (!*level_outputs[i]) {
+                throw std::runtime_error("Unable to write " + level_paths[i]);
+            }
+        }
+        readers.clear();
+        for (size_t i = 0, i_max = run_paths.size(); i < i_max; ++i) {
+            remove(run_paths[i].c_str());
+        }
+        return level_paths;
+    }
+
+    void
+    _write_node(
+            std::ostream &output,
+            uint32_t label,
+            uint32_t degree,
+            bool is_terminal,
+            const KeyType &key
+    ) const {
+        const uint8_t terminal = is_terminal ? 1 : 0;
+        output.write((const char *) &label, sizeof(label));
+        output.write((const char *) &degree, sizeof(degree));
+        output.write((const char *) &terminal, sizeof(terminal));
+        if (is_terminal) {
+            output.write((const char *) &key, sizeof(KeyType));
+        }
+    }
+
+    /**
+     * Phase 3: read the levels in order, i.e. the nodes in BFS order, into the LOUDS trie of the matcher, then compute
+     * the failure links.
+     */
+    void
+    _build_automaton(
+            const std::vector<std::string> &level_paths,
+            const std::vector<size_t> &v_level_sizes,
+            SuccinctPatternMatcher<KeyType> &matcher
+    ) {
+        size_t num_states = 0;
+        for (size_t i = 0, i_max = v_level_sizes.size(); i < i_max; ++i) {
+            num_states += v_level_sizes[i];
+        }
+        matcher.num_states = num_states;
+        matcher.num_first_words = this->num_first_words;
+        matcher.labels = PackedIntArray(num_states - 1, this->h_word_to_word_id.size());
+        matcher.pattern_lengths = PackedIntArray(this->num_patterns, this->MAX_PATTERN_WORDS);
+        matcher.v_pattern_id_to_key.resize(this->num_patterns);
+        PackedIntArray state_to_output(num_states, this->num_patterns);
+
+        size_t state = 0;
+        size_t pattern_id = 0;
+        std::vector<char> v_buffer(this->MIN_STREAM_BUFFER_BYTES);
+        for (size_t depth = 0, depth_max = level_paths.size(); depth < depth_max; ++depth) {
+            std::ifstream input;
+            input.rdbuf()->pubsetbuf(&v_buffer[0], v_buffer.size());
+            input.open(level_paths[depth].c_str(), std::ios::binary);
+            for (size_t i = 0; i < v_level_sizes[depth]; ++i, ++state) {
+                uint32_t label, degree;
+                uint8_t terminal;
+                input.read((char *) &label, sizeof(label));
+                input.read((char *) &degree, sizeof(degree));
+                input.read((char *) &terminal, sizeof(terminal));
+                if (!input) {
+                    throw std::runtime_error("Truncated file of the trie level " + std::to_string(depth));
+                }
+                for (uint32_t child = 0; child < degree; ++child) {
+                    matcher.louds.push_back(true);
+                }
+                matcher.louds.push_back(false);
+                if (state > 0) {
+                    matcher.labels.set(state - 1, label);
+                }
+                if (terminal) {
+                    KeyType key;
+                    input.read((char *) &key, sizeof(KeyType));
+                    matcher.v_pattern_id_to_key[pattern_id] = key;
+                    matcher.pattern_lengths.set(pattern_id, depth);
+                    if (depth > matcher.max_pattern_length) {
+                        matcher.max_pattern_length = (pattern_length_t) depth;
+                    }
+                    // the outputs are shifted by one, 0 means no output
+                    state_to_output.set(state, ++pattern_id);
+                }
+            }
+            input.close();
+            remove(level_paths[depth].c_str());
+        }
+        matcher.louds.build_index();
+        matcher._compile_links(state_to_output, this->num_patterns);
+    }
+};
+
+#endif //EXTERNALMATCHERBUILDER_HPP
@@ -0,0 +1,239 @@
+#ifndef IDSEQUENCEMATCHER_HPP
+#define IDSEQUENCEMATCHER_HPP
+
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+#include "AhoCorasickAutomaton.hpp"
+#include "PatternMatcher.hpp"
+
+
+/**
+ * Matches of a batch of sequences in CSR layout: the matches of the sequence i are in the positions
+ * [v_offsets[i], v_offsets[i + 1]) of the other vectors, and each match spans the elements [begin, end) of its sequence.
+ * @tparam KeyType
+ */
+template<typename KeyType>
+class IdSequenceMatchesBatch {
+public:
+    std::vector<uint64_t> v_offsets;
+    std::vector<KeyType> v_keys;
+    std::vector<uint64_t> v_begins;
+    std::vector<uint64_t> v_ends;
+
+public:
+    void
+    clear() {
+        this->v_offsets.clear();
+        this->v_keys.clear();
+        this->v_begins.clear();
+        this->v_ends.clear();
+    }
+
+    size_t
+    get_num_matches() const {
+        return this->v_keys.size();
+    }
+};
+
+
+/**
+ * Matcher of patterns given as sequences of integer identifiers, e.g. the token ids of an external tokenizer: the
+ * automaton moves on the identifiers themselves, hence neither the patterns nor the texts pass through the
+ * normalization and the word dictionary of PatternMatcher. Any identifier is valid, the ones that are not in the
+ * patterns restart from the root.
+ * The positions of the matches are the indexes of the elements of the sequence, and the spans of PatternMatches are
+ * the element ranges [begin, end) of the matches.
+ * @tparam KeyType
+ * @tparam TokenType Integer type of the identifiers
+ * @tparam KeyPolicy How the keys are mapped to the pattern identifiers (SparseKeys or DenseKeys)
+ * @tparam IdType Unsigned integer used for the state identifiers of the automaton
+ */
+template<typename KeyType, typename TokenType = uint32_t, typename KeyPolicy = SparseKeys, typename IdType = uint32_t>
+class IdSequenceMatcher {
+private:
+    typedef AhoCorasickAutomaton<KeyType, TokenType, KeyPolicy, IdType> AutomatonType;
+    typedef typename AutomatonType::type_state_id type_state_id;
+
+    const size_t MAX_PATTERN_LENGTH = (pattern_length_t) -2;
+
+private:
+    AutomatonType automaton;
+    PatternLengthMap<KeyType, KeyPolicy> pattern_id_to_length;
+    pattern_length_t max_pattern_length;
+    bool b_is_compiled;
+
+public:
+    IdSequenceMatcher() :
+            max_pattern_length(0),
+            b_is_compiled(false) {}
+
+    /**
+     * Add a new pattern.
+     * @param pattern_id The key of the pattern
+     * @param pattern A pointer to the identifiers of the pattern
+     * @param size The number of identifiers of the pattern
+     */
+    void
+    add_pattern(
+            KeyType pattern_id,
+            const TokenType *pattern,
+            size_t size
+    ) {
+        if (size == 0) {
+            throw std::invalid_argument("The given pattern is empty");
+        }
+        if (size > this->MAX_PATTERN_LENGTH) {
+            throw std::invalid_argument("The given pattern is too long");
+        }
+        this->automaton.add_pattern(pattern_id, pattern, pattern + size);
+        this->pattern_id_to_length.set_length(pattern_id, (pattern_length_t) size);
+        if (size > this->max_pattern_length) {
+            this->max_pattern_length = (pattern_length_t) size;
+        }
+    }
+
+    void
+    add_pattern(
+            KeyType pattern_id,
+            const std::vector<TokenType> &pattern
+    ) {
+        this->add_pattern(pattern_id, pattern.data(), pattern.size());
+    }
+
+    void
+    compile() {
+        this->automaton.compile();
+        this->b_is_compiled = true;
+    }
+
+    /**
+     * Find the patterns inside a sequence of identifiers.
+     * @param sequence A pointer to the identifiers of the sequence
+     * @param size The number of identifiers of the sequence
+     * @param matches The vector where to append the matches
+     */
+    void
+    find_patterns(
+            const TokenType *sequence,
+            size_t size,
+            PatternMatches<KeyType> &matches
+    ) const {
+        if (!this->b_is_compiled) {
+            throw std::runtime_error("The matcher must be compiled before finding the patterns");
+        }
+        if (matches.get_semantics() != MATCH_ALL) {
+            this->_find_leftmost_patterns(sequence, size, matches);
+            return;
+        }
+
+        const bool include_spans = matches.include_spans();
+        type_state_id current_state_id = 0;
+        for (size_t pos = 0; pos < size; ++pos) {
+            const size_t num_matches = matches.size();
+            current_state_id = this->automaton.get_next_state_id(current_state_id, sequence[pos], matches, pos);
+            if (include_spans) {
+                for (size_t i = num_matches, i_max = matches.size(); i < i_max; ++i) {
+                    const pattern_length_t length = this->get_pattern_length(matches[i].pattern);
+                    matches.push_span(PatternSpan(pos + 1 - length, pos + 1));
+                }
+            }
+        }
+    }
+
+    void
+    find_patterns(
+            const std::vector<TokenType> &sequence,
+            PatternMatches<KeyType> &matches
+    ) const {
+        this->find_patterns(sequence.data(), sequence.size(), matches);
+    }
+
+    /**
+     * Find the patterns inside a batch of sequences in CSR layout, i.e. the sequence i is made by the identifiers
+     * [offsets[i], offsets[i + 1]) of the flat array.
+     * @param sequences The identifiers of all the sequences
+     * @param size The number of identifiers
+     * @param offsets The num_sequences + 1 offsets of the sequences inside the flat array
+     * @param num_sequences The number of sequences
+     * @param include_suffixes Whether the suffixes of the matches are included (only with MATCH_ALL)
+     * @param semantics Which matches are reported
+     * @param batch The matches of the sequences, in the same CSR layout
+     */
+    void
+    find_patterns_batch(
+            const TokenType *sequences,
+            size_t size,
+            const uint64_t *offsets,
+            size_t num_sequences,
+            bool include_suffixes,
+            MatchSemantics semantics,
+            IdSequenceMatchesBatch<KeyType> &batch
+    ) const {
+        for (size_t i = 0; i < num_sequences; ++i) {
+            if (offsets[i] > offsets[i + 1] || offsets[i + 1] > size) {
+                throw std::invalid_argument("The offsets of the sequences are not valid");
+            }
+        }
+
+        batch.clear();
+        batch.v_offsets.reserve(num_sequences + 1);
+        batch.v_offsets.push_back(0);
+        PatternMatches<KeyType> matches(include_suffixes, true, semantics);
+        for (size_t i = 0; i < num_sequences; ++i) {
+            matches.clear();
+            this->find_patterns(sequences + offsets[i], (size_t) (offsets[i + 1] - offsets[i]), matches);
+            for (size_t j = 0, j_max = matches.size(); j < j_max; ++j) {
+                batch.v_keys.push_back(matches[j].pattern);
+                batch.v_begins.push_back(matches.spans()[j].begin_offset);
+                batch.v_ends.push_back(matches.spans()[j].end_offset);
+            }
+            batch.v_offsets.push_back(batch.v_keys.size());
+        }
+    }
+
+    pattern_length_t
+    get_pattern_length(
+            KeyType pattern_id
+    ) const {
+        pattern_length_t length;
+        if (!this->pattern_id_to_length.find_length(pattern_id, length))
+            throw std::runtime_error("The given pattern has not been found");
+        return length;
+    }
+
+    void
+    reserve(
+            size_t num_patterns
+    ) {
+        this->automaton.reserve(num_patterns);
+    }
+
+private:
+    /**
+     * Scan for MATCH_LEFTMOST_FIRST and MATCH_LEFTMOST_LONGEST, like PatternMatcher.
+     */
+    void
+    _find_leftmost_patterns(
+            const TokenType *sequence,
+            size_t size,
+            PatternMatches<KeyType> &matches
+    ) const {
+        LeftmostMatchSelector<KeyType> selector(matches.get_semantics(), std::max<size_t>(this->max_pattern_length, 1));
+        type_state_id current_state_id = 0;
+        for (size_t pos = 0; pos < size; ++pos) {
+            current_state_id = this->automaton.get_next_state_id(current_state_id, sequence[pos]);
+            this->automaton.for_each_state_pattern(
+                    current_state_id,
+                    [&](const KeyType &pattern, size_t priority) {
+                        const pattern_length_t length = this->get_pattern_length(pattern);
+                        selector.add_candidate(pattern, pos + 1 - length, pos, priority, pos + 1 - length, pos + 1);
+                    });
+            selector.flush(pos, matches);
+        }
+        selector.finish(matches);
+    }
+};
+
+#endif //IDSEQUENCEMATCHER_HPP
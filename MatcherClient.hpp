@@ -0,0 +1,194 @@
+#ifndef MATCHERCLIENT_HPP
+#define MATCHERCLIENT_HPP
+
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "MatcherServer.hpp"
+
+
+/**
+ * Client of a MatcherServer. The single requests travel on the socket, while the batches are written into the
+ * shared-memory rings and the socket is only used to notify the server.
+ */
+class MatcherClient {
+private:
+    int fd;
+    matcher_protocol::ShmRegion shm_region;
+    std::string payload;
+
+public:
+    MatcherClient() :
+            fd(-1) {}
+
+    ~MatcherClient() {
+        this->close();
+    }
+
+    void
+    connect(
+            const std::string &socket_path
+    ) {
+        struct sockaddr_un address;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("The socket path is too long");
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+        this->close();
+        this->fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (this->fd < 0) {
+            throw std::runtime_error("Unable to create the socket");
+        }
+        if (::connect(this->fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+            ::close(this->fd);
+            this->fd = -1;
+            throw std::runtime_error("Unable to connect to " + socket_path);
+        }
+    }
+
+    void
+    close() {
+        if (this->fd >= 0) {
+            ::close(this->fd);
+            this->fd = -1;
+        }
+        this->shm_region.close();
+    }
+
+    /**
+     * Find the patterns in the text.
+     * @param text The text
+     * @param include_suffixes Whether the matches of the suffixes are included
+     * @param matches Where to put the (pattern, end_pos) pairs
+     */
+    void
+    find_patterns(
+            const std::string &text,
+            bool include_suffixes,
+            std::vector<uint32_t> &matches
+    ) {
+        this->_call(include_suffixes ? matcher_protocol::OP_FIND_PATTERNS_WITH_SUFFIXES
+                                     : matcher_protocol::OP_FIND_PATTERNS, text, matches);
+    }
+
+    /**
+     * Segment the text.
+     * @param text The text
+     * @param segments_bounds Where to put the [start, end) word positions of the selected segments
+     */
+    void
+    segment(
+            const std::string &text,
+            std::vector<uint32_t> &segments_bounds
+    ) {
+        this->_call(matcher_protocol::OP_SEGMENT, text, segments_bounds);
+    }
+
+    /**
+     * Create a shared-memory region and attach it to the server, so that the batches can be used.
+     * @param name The name of the region (e.g. "/matcher-1234")
+     * @param ring_capacity The size in bytes of each of the two rings
+     */
+    void
+    attach_shared_memory(
+            const std::string &name,
+            size_t ring_capacity
+    ) {
+        this->shm_region.close();
+        this->shm_region.create(name, ring_capacity);
+        uint32_t status;
+        matcher_protocol::write_frame(this->fd, matcher_protocol::OP_ATTACH_SHM, name.data(), name.size());
+        if (!matcher_protocol::read_frame(this->fd, status, this->payload, (uint32_t) -1) ||
+            status != matcher_protocol::STATUS_OK) {
+            this->shm_region.close();
+            throw std::runtime_error("The server is unable to attach the shared memory " + name);
+        }
+    }
+
+    /**
+     * Process a batch of texts through the shared memory. The batch must fit in the rings, otherwise nothing is sent.
+     * @param operation The operation applied to each text (one of matcher_protocol::OP_*)
+     * @param texts The texts
+     * @param results Where to put the results, in the same order of the texts
+     * @param statuses Where to put the status of each result
+     */
+    void
+    process_batch(
+            uint32_t operation,
+            const std::vector<std::string> &texts,
+            std::vector<std::vector<uint32_t>> &results,
+            std::vector<uint32_t> &statuses
+    ) {
+        if (!this->shm_region.is_open()) {
+            throw std::runtime_error("The shared memory has not been attached");
+        }
+        // the records of a batch that does not fit are removed, since the server would read them with the next batch
+        const uint64_t tail = this->shm_region.requests.get_tail();
+        for (size_t i = 0, i_max = texts.size(); i < i_max; ++i) {
+            if (!this->shm_region.requests.push(operation, texts[i].data(), texts[i].size())) {
+                this->shm_region.requests.rollback_tail(tail);
+                throw std::runtime_error("The batch does not fit in the shared memory");
+            }
+        }
+        const uint32_t num_requests = (uint32_t) texts.size();
+        uint32_t status, num_responses;
+        matcher_protocol::write_frame(this->fd, matcher_protocol::OP_SHM_BATCH, &num_requests, sizeof(uint32_t));
+        if (!matcher_protocol::read_frame(this->fd, status, this->payload, (uint32_t) -1)) {
+            throw std::runtime_error("The connection has been closed by the server");
+        }
+        if (this->payload.size() != sizeof(uint32_t)) {
+            throw std::runtime_error("Invalid response of the server");
+        }
+        memcpy(&num_responses, this->payload.data(), sizeof(uint32_t));
+
+        // the responses written are consumed even on errors, so that the ring stays aligned with the next batches
+        results.resize(std::min(num_responses, num_requests));
+        statuses.resize(results.size());
+        uint64_t position = this->shm_region.responses.get_head();
+        for (size_t i = 0, i_max = results.size(); i < i_max; ++i) {
+            const char *result_payload;
+            size_t result_payload_size;
+            position = this->shm_region.responses.peek(position, statuses[i], result_payload, result_payload_size);
+            results[i].resize(result_payload_size / sizeof(uint32_t));
+            if (result_payload_size > 0) {
+                memcpy(results[i].data(), result_payload, result_payload_size);
+            }
+        }
+        this->shm_region.responses.consume_until(position);
+        if (status != matcher_protocol::STATUS_OK || num_responses != num_requests) {
+            throw std::runtime_error("The server is unable to process the batch");
+        }
+    }
+
+private:
+    void
+    _call(
+            uint32_t operation,
+            const std::string &text,
+            std::vector<uint32_t> &result
+    ) {
+        uint32_t status;
+        matcher_protocol::write_frame(this->fd, operation, text.data(), text.size());
+        if (!matcher_protocol::read_frame(this->fd, status, this->payload, (uint32_t) -1)) {
+            throw std::runtime_error("The connection has been closed by the server");
+        }
+        if (status != matcher_protocol::STATUS_OK) {
+            throw std::runtime_error("The server is unable to process the request");
+        }
+        result.resize(this->payload.size() / sizeof(uint32_t));
+        if (!this->payload.empty()) {
+            memcpy(result.data(), this->payload.data(), this->payload.size());
+        }
+    }
+};
+
+#endif //MATCHERCLIENT_HPP
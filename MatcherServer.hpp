@@ -0,0 +1,744 @@
+#ifndef MATCHERSERVER_HPP
+#define MATCHERSERVER_HPP
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Segmenter.hpp"
+#include "WorkerPool.hpp"
+
+
+/**
+ * Protocol of the matcher server. Every message on the Unix domain socket is a frame made of a little-endian header
+ * {uint32 code, uint32 payload size} followed by the payload; the code of a request is the operation, the code of a
+ * response is the status. The results are arrays of uint32 pairs: (pattern, end_pos) for find_patterns and
+ * (start, end) word positions of the selected segments for segment.
+ *
+ * The bulk clients attach a shared-memory region with two single-producer single-consumer rings (requests and
+ * responses): they enqueue a batch of records in the request ring and send a single OP_SHM_BATCH frame with the number
+ * of records, the server processes the batch with its worker pool, enqueues the responses in the same order and replies
+ * with the number of responses written, which the client consumes even when the status is an error (then the requests
+ * have been dropped, or only the first responses have been written). Each record is {uint32 size, payload} padded to
+ * 8 bytes, where the payload of a request is {uint32 operation, text} and the one of a response is {uint32 status,
+ * result}. The server closes the connections that send a frame larger than MAX_REQUEST_FRAME_SIZE.
+ */
+namespace matcher_protocol {
+    const uint32_t OP_FIND_PATTERNS = 1;
+    const uint32_t OP_FIND_PATTERNS_WITH_SUFFIXES = 2;
+    const uint32_t OP_SEGMENT = 3;
+    const uint32_t OP_ATTACH_SHM = 4;
+    const uint32_t OP_SHM_BATCH = 5;
+
+    const uint32_t STATUS_OK = 0;
+    const uint32_t STATUS_ERROR = 1;
+
+    const uint64_t SHM_MAGIC = 0x4d48535245484354ULL;
+    // layout of the shared-memory region: the ring indexes lie on different cache lines
+    const size_t SHM_CAPACITY_OFFSET = 8;
+    const size_t SHM_REQUEST_HEAD_OFFSET = 64;
+    const size_t SHM_REQUEST_TAIL_OFFSET = 72;
+    const size_t SHM_RESPONSE_HEAD_OFFSET = 128;
+    const size_t SHM_RESPONSE_TAIL_OFFSET = 136;
+    const size_t SHM_HEADER_SIZE = 256;
+
+    const uint32_t RING_WRAP_MARKER = (uint32_t) -1;
+    const size_t RING_ALIGNMENT = 8;
+
+    // maximum payload of a frame read by the server, the connections that send a larger one are closed
+    const uint32_t MAX_REQUEST_FRAME_SIZE = 64 * 1024 * 1024;
+
+    inline void
+    write_all(
+            int fd,
+            const void *data,
+            size_t size
+    ) {
+        const char *pointer = (const char *) data;
+        while (size > 0) {
+            const ssize_t written = ::send(fd, pointer, size, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                throw std::runtime_error("Unable to write on the socket");
+            }
+            pointer += written;
+            size -= (size_t) written;
+        }
+    }
+
+    /**
+     * @return false if the connection has been closed before reading anything
+     */
+    inline bool
+    read_all(
+            int fd,
+            void *data,
+            size_t size
+    ) {
+        char *pointer = (char *) data;
+        const size_t total_size = size;
+        while (size > 0) {
+            const ssize_t num_read = ::recv(fd, pointer, size, 0);
+            if (num_read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (num_read == 0 && size == total_size) {
+                return false;
+            }
+            if (num_read <= 0) {
+                throw std::runtime_error("Unable to read from the socket");
+            }
+            pointer += num_read;
+            size -= (size_t) num_read;
+        }
+        return true;
+    }
+
+    inline void
+    write_frame(
+            int fd,
+            uint32_t code,
+            const void *payload,
+            size_t payload_size
+    ) {
+        const uint32_t header[2] = {code, (uint32_t) payload_size};
+        write_all(fd, header, sizeof(header));
+        if (payload_size > 0) {
+            write_all(fd, payload, payload_size);
+        }
+    }
+
+    /**
+     * @param max_payload_size The maximum size of the payload, a larger one is an error
+     * @return false if the connection has been closed
+     */
+    inline bool
+    read_frame(
+            int fd,
+            uint32_t &code,
+            std::string &payload,
+            uint32_t max_payload_size = MAX_REQUEST_FRAME_SIZE
+    ) {
+        uint32_t header[2];
+        if (!read_all(fd, header, sizeof(header))) {
+            return false;
+        }
+        if (header[1] > max_payload_size) {
+            throw std::runtime_error("The frame is too large");
+        }
+        code = header[0];
+        payload.resize(header[1]);
+        if (header[1] > 0 && !read_all(fd, &payload[0], header[1])) {
+            throw std::runtime_error("The connection has been closed in the middle of a frame");
+        }
+        return true;
+    }
+
+
+    /**
+     * Single-producer single-consumer ring of variable-size records inside a shared-memory region. The head and the
+     * tail are monotonic byte counters: the producer advances the tail and the consumer the head.
+     */
+    class ShmRing {
+    private:
+        uint64_t *head;
+        uint64_t *tail;
+        char *data;
+        uint64_t capacity;
+
+    public:
+        ShmRing() :
+                head(nullptr),
+                tail(nullptr),
+                data(nullptr),
+                capacity(0) {}
+
+        ShmRing(char *region, size_t head_offset, size_t tail_offset, size_t data_offset, uint64_t capacity) :
+                head((uint64_t *) (region + head_offset)),
+                tail((uint64_t *) (region + tail_offset)),
+                data(region + data_offset),
+                capacity(capacity) {}
+
+        /**
+         * Append a record made of a 4 bytes code and a payload.
+         * @return false if there is not enough free space
+         */
+        bool
+        push(
+                uint32_t code,
+                const void *payload,
+                size_t payload_size
+        ) {
+            const uint64_t record_size = _record_size(sizeof(uint32_t) + payload_size);
+            const uint64_t head_value = __atomic_load_n(this->head, __ATOMIC_ACQUIRE);
+            uint64_t tail_value = __atomic_load_n(this->tail, __ATOMIC_RELAXED);
+
+            // the records are contiguous: skip the end of the ring if the record does not fit there
+            uint64_t offset = tail_value % this->capacity;
+            uint64_t skip = (offset + record_size > this->capacity) ? this->capacity - offset : 0;
+            if (record_size > this->capacity || tail_value + skip + record_size - head_value > this->capacity) {
+                return false;
+            }
+            if (skip > 0) {
+                *((uint32_t *) (this->data + offset)) = RING_WRAP_MARKER;
+                tail_value += skip;
+                offset = 0;
+            }
+
+            const uint32_t record_payload_size = (uint32_t) (sizeof(uint32_t) + payload_size);
+            memcpy(this->data + offset, &record_payload_size, sizeof(uint32_t));
+            memcpy(this->data + offset + sizeof(uint32_t), &code, sizeof(uint32_t));
+            if (payload_size > 0) {
+                memcpy(this->data + offset + 2 * sizeof(uint32_t), payload, payload_size);
+            }
+            __atomic_store_n(this->tail, tail_value + record_size, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        /**
+         * Read the record at the given position without consuming it.
+         * @param position The position of the record (the head for the first one)
+         * @param code The code of the record
+         * @param payload The payload of the record, valid until it is consumed
+         * @param payload_size The size of the payload
+         * @return The position of the next record
+         */
+        uint64_t
+        peek(
+                uint64_t position,
+                uint32_t &code,
+                const char *&payload,
+                size_t &payload_size
+        ) const {
+            // the records are written by the other process, hence they must lie inside both the ring and [head, tail)
+            const uint64_t tail_value = __atomic_load_n(this->tail, __ATOMIC_ACQUIRE);
+            if (position >= tail_value) {
+                throw std::runtime_error("The ring does not contain the requested record");
+            }
+            uint64_t offset = position % this->capacity;
+            if (offset + sizeof(uint32_t) > this->capacity) {
+                throw std::runtime_error("The ring contains a corrupted record");
+            }
+            uint32_t record_payload_size;
+            memcpy(&record_payload_size, this->data + offset, sizeof(uint32_t));
+            if (record_payload_size == RING_WRAP_MARKER) {
+                position += this->capacity - offset;
+                offset = 0;
+                if (position >= tail_value) {
+                    throw std::runtime_error("The ring contains a corrupted record");
+                }
+                memcpy(&record_payload_size, this->data, sizeof(uint32_t));
+            }
+            const uint64_t record_size = _record_size(record_payload_size);
+            if (record_payload_size < sizeof(uint32_t) || offset + record_size > this->capacity ||
+                position + record_size > tail_value) {
+                throw std::runtime_error("The ring contains a corrupted record");
+            }
+            memcpy(&code, this->data + offset + sizeof(uint32_t), sizeof(uint32_t));
+            payload = this->data + offset + 2 * sizeof(uint32_t);
+            payload_size = record_payload_size - sizeof(uint32_t);
+            return position + record_size;
+        }
+
+        uint64_t
+        get_head() const {
+            return __atomic_load_n(this->head, __ATOMIC_ACQUIRE);
+        }
+
+        uint64_t
+        get_tail() const {
+            return __atomic_load_n(this->tail, __ATOMIC_ACQUIRE);
+        }
+
+        uint64_t
+        get_capacity() const {
+            return this->capacity;
+        }
+
+        /**
+         * Discard the records pushed after the given tail (producer side), which must not have been announced to the
+         * consumer yet.
+         */
+        void
+        rollback_tail(
+                uint64_t position
+        ) {
+            __atomic_store_n(this->tail, position, __ATOMIC_RELEASE);
+        }
+
+        /**
+         * Release all the records before the given position.
+         */
+        void
+        consume_until(
+                uint64_t position
+        ) {
+            __atomic_store_n(this->head, position, __ATOMIC_RELEASE);
+        }
+
+    private:
+        static uint64_t
+        _record_size(
+                size_t payload_size
+        ) {
+            const size_t size = sizeof(uint32_t) + payload_size;
+            return (size + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+        }
+    };
+
+
+    /**
+     * Mapping of a shared-memory region with the request and response rings.
+     */
+    class ShmRegion {
+    private:
+        std::string name;
+        char *region;
+        size_t region_size;
+        bool b_is_owner;
+
+    public:
+        ShmRing requests;
+        ShmRing responses;
+
+    public:
+        ShmRegion() :
+                region(nullptr),
+                region_size(0),
+                b_is_owner(false) {}
+
+        ~ShmRegion() {
+            this->close();
+        }
+
+        /**
+         * Create a new region (client side).
+         */
+        void
+        create(
+                const std::string &name,
+                size_t ring_capacity
+        ) {
+            ring_capacity = (ring_capacity + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+            const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0) {
+                throw std::runtime_error("Unable to create the shared memory " + name);
+            }
+            const size_t size = SHM_HEADER_SIZE + 2 * ring_capacity;
+            if (::ftruncate(fd, (off_t) size) != 0) {
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                throw std::runtime_error("Unable to resize the shared memory " + name);
+            }
+            this->_map(fd, name, size);
+            this->b_is_owner = true;
+            memset(this->region, 0, SHM_HEADER_SIZE);
+            memcpy(this->region, &SHM_MAGIC, sizeof(uint64_t));
+            memcpy(this->region + SHM_CAPACITY_OFFSET, &ring_capacity, sizeof(uint64_t));
+            this->_init_rings(ring_capacity);
+        }
+
+        /**
+         * Open an existing region (server side).
+         */
+        void
+        open(
+                const std::string &name
+        ) {
+            const int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd < 0) {
+                throw std::runtime_error("Unable to open the shared memory " + name);
+            }
+            struct stat info;
+            if (::fstat(fd, &info) != 0 || (size_t) info.st_size < SHM_HEADER_SIZE) {
+                ::close(fd);
+                throw std::runtime_error("Invalid shared memory " + name);
+            }
+            this->_map(fd, name, (size_t) info.st_size);
+            uint64_t magic, ring_capacity;
+            memcpy(&magic, this->region, sizeof(uint64_t));
+            memcpy(&ring_capacity, this->region + SHM_CAPACITY_OFFSET, sizeof(uint64_t));
+            // the capacity is written by the client: the rings must be non-empty, aligned and inside the region
+            if (magic != SHM_MAGIC || ring_capacity == 0 || ring_capacity % RING_ALIGNMENT != 0 ||
+                ring_capacity > (this->region_size - SHM_HEADER_SIZE) / 2) {
+                this->close();
+                throw std::runtime_error("Invalid shared memory " + name);
+            }
+            this->_init_rings(ring_capacity);
+        }
+
+        void
+        close() {
+            if (this->region != nullptr) {
+                ::munmap(this->region, this->region_size);
+                this->region = nullptr;
+                if (this->b_is_owner) {
+                    ::shm_unlink(this->name.c_str());
+                }
+            }
+        }
+
+        bool
+        is_open() const {
+            return this->region != nullptr;
+        }
+
+        uint64_t
+        get_ring_capacity() const {
+            uint64_t ring_capacity;
+            memcpy(&ring_capacity, this->region + SHM_CAPACITY_OFFSET, sizeof(uint64_t));
+            return ring_capacity;
+        }
+
+    private:
+        void
+        _map(
+                int fd,
+                const std::string &name,
+                size_t size
+        ) {
+            void *address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (address == MAP_FAILED) {
+                throw std::runtime_error("Unable to map the shared memory " + name);
+            }
+            this->name = name;
+            this->region = (char *) address;
+            this->region_size = size;
+        }
+
+        /**
+         * @param ring_capacity The validated capacity, which is not read again from the shared memory
+         */
+        void
+        _init_rings(
+                uint64_t ring_capacity
+        ) {
+            this->requests = ShmRing(this->region, SHM_REQUEST_HEAD_OFFSET, SHM_REQUEST_TAIL_OFFSET,
+                                     SHM_HEADER_SIZE, ring_capacity);
+            this->responses = ShmRing(this->region, SHM_RESPONSE_HEAD_OFFSET, SHM_RESPONSE_TAIL_OFFSET,
+                                      SHM_HEADER_SIZE + ring_capacity, ring_capacity);
+        }
+    };
+}
+
+
+/**
+ * Server that shares a single compiled Segmenter (and its PatternMatcher) among many client processes through a Unix
+ * domain socket and, for the bulk clients, shared-memory rings. Each connection is served by its own thread, while the
+ * batches received through the shared memory are processed by the worker pool.
+ */
+class MatcherServer {
+private:
+    const Segmenter &segmenter;
+    WorkerPool worker_pool;
+    std::string socket_path;
+    int listen_fd;
+    std::thread accept_thread;
+    std::mutex connections_mutex;
+    std::vector<int> v_connection_fds;
+    std::vector<std::thread> v_connection_threads;
+    // the connection threads that have finished, joined by the accept loop
+    std::vector<std::thread::id> v_finished_thread_ids;
+    std::atomic<bool> b_is_running;
+
+public:
+    /**
+     * @param segmenter The compiled segmenter to serve (it must outlive the server)
+     * @param num_workers Number of threads used to process the shared-memory batches
+     */
+    MatcherServer(const Segmenter &segmenter, size_t num_workers) :
+            segmenter(segmenter),
+            worker_pool(num_workers),
+            listen_fd(-1),
+            b_is_running(false) {}
+
+    ~MatcherServer() {
+        this->stop();
+    }
+
+    /**
+     * Start to accept the connections on the given socket path.
+     */
+    void
+    start(
+            const std::string &socket_path
+    ) {
+        if (this->b_is_running) {
+            throw std::runtime_error("The server is already running");
+        }
+        struct sockaddr_un address;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("The socket path is too long");
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+        this->listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (this->listen_fd < 0) {
+            throw std::runtime_error("Unable to create the socket");
+        }
+        ::unlink(socket_path.c_str());
+        if (::bind(this->listen_fd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+            ::listen(this->listen_fd, 128) != 0) {
+            ::close(this->listen_fd);
+            this->listen_fd = -1;
+            throw std::runtime_error("Unable to listen on " + socket_path);
+        }
+        this->socket_path = socket_path;
+        this->b_is_running = true;
+        this->accept_thread = std::thread([this]() { this->_accept_loop(); });
+    }
+
+    /**
+     * Stop the server, closing all the connections.
+     */
+    void
+    stop() {
+        if (!this->b_is_running) {
+            return;
+        }
+        this->b_is_running = false;
+        ::shutdown(this->listen_fd, SHUT_RDWR);
+        ::close(this->listen_fd);
+        this->accept_thread.join();
+        {
+            std::lock_guard<std::mutex> lock(this->connections_mutex);
+            for (size_t i = 0, i_max = this->v_connection_fds.size(); i < i_max; ++i) {
+                ::shutdown(this->v_connection_fds[i], SHUT_RDWR);
+            }
+        }
+        for (size_t i = 0, i_max = this->v_connection_threads.size(); i < i_max; ++i) {
+            this->v_connection_threads[i].join();
+        }
+        this->v_connection_threads.clear();
+        this->v_finished_thread_ids.clear();
+        this->v_connection_fds.clear();
+        ::unlink(this->socket_path.c_str());
+    }
+
+    /**
+     * @return The number of connection threads not joined yet: the open connections plus the ones closed after the
+     * last accepted connection
+     */
+    size_t
+    get_num_connection_threads() {
+        std::lock_guard<std::mutex> lock(this->connections_mutex);
+        return this->v_connection_threads.size();
+    }
+
+    /**
+     * Process a single request.
+     * @param operation The operation to perform
+     * @param text The text
+     * @param result Where to put the uint32 pairs of the result
+     * @return The status of the response
+     */
+    uint32_t
+    process_request(
+            uint32_t operation,
+            const std::string &text,
+            std::vector<uint32_t> &result
+    ) const {
+        result.clear();
+        try {
+            if (operation == matcher_protocol::OP_SEGMENT) {
+                this->segmenter.segment(text, result);
+                return matcher_protocol::STATUS_OK;
+            }
+            if (operation == matcher_protocol::OP_FIND_PATTERNS ||
+                operation == matcher_protocol::OP_FIND_PATTERNS_WITH_SUFFIXES) {
+                PatternMatches<uint32_t> matches(operation == matcher_protocol::OP_FIND_PATTERNS_WITH_SUFFIXES);
+                this->segmenter.get_matcher().find_patterns(text, matches);
+                result.reserve(2 * matches.size());
+                for (size_t i = 0, i_max = matches.size(); i < i_max; ++i) {
+                    result.push_back(matches[i].pattern);
+                    result.push_back((uint32_t) matches[i].end_pos);
+                }
+                return matcher_protocol::STATUS_OK;
+            }
+        } catch (std::exception &) {
+        }
+        return matcher_protocol::STATUS_ERROR;
+    }
+
+private:
+    void
+    _accept_loop() {
+        while (this->b_is_running) {
+            const int connection_fd = ::accept(this->listen_fd, nullptr, nullptr);
+            if (connection_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                return;
+            }
+            std::lock_guard<std::mutex> lock(this->connections_mutex);
+            if (!this->b_is_running) {
+                ::close(connection_fd);
+                return;
+            }
+            this->_reap_connection_threads();
+            this->v_connection_fds.push_back(connection_fd);
+            this->v_connection_threads.push_back(std::thread([this, connection_fd]() {
+                try {
+                    this->_serve_connection(connection_fd);
+                } catch (std::exception &) {
+                    // the connection is broken, it is simply closed
+                }
+                this->_close_connection(connection_fd);
+            }));
+        }
+    }
+
+    /**
+     * Join and remove the threads of the closed connections, so that a long-running server does not keep them. It
+     * must be called with the connections mutex held.
+     */
+    void
+    _reap_connection_threads() {
+        for (size_t i = 0, i_max = this->v_finished_thread_ids.size(); i < i_max; ++i) {
+            for (size_t j = 0, j_max = this->v_connection_threads.size(); j < j_max; ++j) {
+                if (this->v_connection_threads[j].get_id() == this->v_finished_thread_ids[i]) {
+                    // the thread does not use the server anymore, hence it terminates without the mutex
+                    this->v_connection_threads[j].join();
+                    this->v_connection_threads.erase(this->v_connection_threads.begin() + j);
+                    break;
+                }
+            }
+        }
+        this->v_finished_thread_ids.clear();
+    }
+
+    /**
+     * Close the connection and mark its thread as finished (it is the last operation of the thread).
+     */
+    void
+    _close_connection(
+            int connection_fd
+    ) {
+        std::lock_guard<std::mutex> lock(this->connections_mutex);
+        for (size_t i = 0, i_max = this->v_connection_fds.size(); i < i_max; ++i) {
+            if (this->v_connection_fds[i] == connection_fd) {
+                this->v_connection_fds.erase(this->v_connection_fds.begin() + i);
+                break;
+            }
+        }
+        ::close(connection_fd);
+        this->v_finished_thread_ids.push_back(std::this_thread::get_id());
+    }
+
+
+    void
+    _serve_connection(
+            int connection_fd
+    ) {
+        matcher_protocol::ShmRegion shm_region;
+        std::vector<uint32_t> result;
+        std::string payload;
+        uint32_t operation;
+
+        while (matcher_protocol::read_frame(connection_fd, operation, payload)) {
+            if (operation == matcher_protocol::OP_ATTACH_SHM) {
+                try {
+                    shm_region.close();
+                    shm_region.open(payload);
+                    matcher_protocol::write_frame(connection_fd, matcher_protocol::STATUS_OK, nullptr, 0);
+                } catch (std::exception &) {
+                    matcher_protocol::write_frame(connection_fd, matcher_protocol::STATUS_ERROR, nullptr, 0);
+                }
+            } else if (operation == matcher_protocol::OP_SHM_BATCH) {
+                uint32_t num_requests = 0, num_responses = 0;
+                if (!shm_region.is_open() || payload.size() != sizeof(uint32_t)) {
+                    matcher_protocol::write_frame(connection_fd, matcher_protocol::STATUS_ERROR, &num_responses,
+                                                  sizeof(uint32_t));
+                    continue;
+                }
+                memcpy(&num_requests, payload.data(), sizeof(uint32_t));
+                const uint32_t status = this->_process_batch(shm_region, num_requests, num_responses);
+                matcher_protocol::write_frame(connection_fd, status, &num_responses, sizeof(uint32_t));
+            } else {
+                const uint32_t status = this->process_request(operation, payload, result);
+                matcher_protocol::write_frame(connection_fd, status, result.data(), result.size() * sizeof(uint32_t));
+            }
+        }
+    }
+
+    /**
+     * Process the requests of the ring and write their responses. On a malformed batch all the pending requests are
+     * dropped, so that the next batch starts from a clean ring.
+     * @param num_responses The number of responses written (all of them unless the response ring is full)
+     * @return The status of the batch
+     */
+    uint32_t
+    _process_batch(
+            matcher_protocol::ShmRegion &shm_region,
+            uint32_t num_requests,
+            uint32_t &num_responses
+    ) {
+        num_responses = 0;
+
+        // locate the requests inside the ring: a record takes at least RING_ALIGNMENT bytes, hence a larger count
+        // cannot be in the ring and it is rejected before allocating anything
+        std::vector<uint32_t> v_operations;
+        std::vector<std::string> v_texts;
+        uint64_t position = shm_region.requests.get_head();
+        try {
+            if (num_requests > shm_region.requests.get_capacity() / matcher_protocol::RING_ALIGNMENT) {
+                throw std::runtime_error("The batch is larger than the ring");
+            }
+            v_operations.reserve(num_requests);
+            v_texts.reserve(num_requests);
+            for (uint32_t i = 0; i < num_requests; ++i) {
+                uint32_t operation;
+                const char *request_payload;
+                size_t request_payload_size;
+                position = shm_region.requests.peek(position, operation, request_payload, request_payload_size);
+                v_operations.push_back(operation);
+                v_texts.push_back(std::string(request_payload, request_payload_size));
+            }
+        } catch (std::exception &) {
+            shm_region.requests.consume_until(shm_region.requests.get_tail());
+            return matcher_protocol::STATUS_ERROR;
+        }
+        shm_region.requests.consume_until(position);
+
+        // process them in parallel
+        std::vector<std::vector<uint32_t>> v_results(num_requests);
+        std::vector<uint32_t> v_statuses(num_requests);
+        this->worker_pool.parallel_for(
+                num_requests,
+                [this, &v_operations, &v_texts, &v_results, &v_statuses](size_t i, size_t) {
+                    v_statuses[i] = this->process_request(v_operations[i], v_texts[i], v_results[i]);
+                });
+
+        // write the responses in the same order (a result that does not fit is replaced by an error), the client
+        // consumes the ones written even if the ring gets full
+        for (uint32_t i = 0; i < num_requests; ++i) {
+            if (!shm_region.responses.push(v_statuses[i], v_results[i].data(),
+                                           v_results[i].size() * sizeof(uint32_t)) &&
+                !shm_region.responses.push(matcher_protocol::STATUS_ERROR, nullptr, 0)) {
+                return matcher_protocol::STATUS_ERROR;
+            }
+            ++num_responses;
+        }
+        return matcher_protocol::STATUS_OK;
+    }
+};
+
+#endif //MATCHERSERVER_HPP
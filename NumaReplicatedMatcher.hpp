@@ -0,0 +1,337 @@
+#ifndef NUMAREPLICATEDMATCHER_HPP
+#define NUMAREPLICATEDMATCHER_HPP
+
+#include <algorithm>
+#include <dirent.h>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "WorkerPool.hpp"
+
+
+/**
+ * NUMA nodes of the host with their CPUs and free memory, read from sysfs (no libnuma is required). When the sysfs
+ * directory is missing the host is seen as a single node with all the CPUs.
+ */
+class NumaTopology {
+public:
+    class NumaNode {
+    public:
+        size_t node_id;
+        std::vector<int> cpus;
+        uint64_t free_bytes;
+
+    public:
+        NumaNode(size_t node_id) :
+                node_id(node_id),
+                free_bytes(0) {}
+    };
+
+private:
+    // memory policies of set_mempolicy(2), defined here to avoid the dependency on numaif.h
+    const int MPOL_DEFAULT_POLICY = 0;
+    const int MPOL_INTERLEAVE_POLICY = 3;
+
+    std::vector<NumaNode> v_nodes;
+
+public:
+    /**
+     * @param sysfs_path The sysfs directory of the nodes (a different one can be given for testing)
+     */
+    NumaTopology(const std::string &sysfs_path = "/sys/devices/system/node") {
+        DIR *directory = opendir(sysfs_path.c_str());
+        if (directory != nullptr) {
+            std::vector<size_t> node_ids;
+            for (struct dirent *entry = readdir(directory); entry != nullptr; entry = readdir(directory)) {
+                const std::string name = entry->d_name;
+                if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                    name.find_first_not_of("0123456789", 4) == std::string::npos) {
+                    node_ids.push_back(strtoul(name.c_str() + 4, nullptr, 10));
+                }
+            }
+            closedir(directory);
+            std::sort(node_ids.begin(), node_ids.end());
+
+            for (size_t i = 0, i_max = node_ids.size(); i < i_max; ++i) {
+                const std::string node_path = sysfs_path + "/node" + std::to_string(node_ids[i]);
+                NumaNode node(node_ids[i]);
+                std::ifstream cpulist_file((node_path + "/cpulist").c_str());
+                std::string cpulist;
+                std::getline(cpulist_file, cpulist);
+                parse_cpulist(cpulist, node.cpus);
+                node.free_bytes = _read_free_bytes(node_path + "/meminfo");
+                // the nodes without CPUs (e.g. memory expanders) cannot run the workers
+                if (!node.cpus.empty()) {
+                    this->v_nodes.push_back(node);
+                }
+            }
+        }
+
+        if (this->v_nodes.empty()) {
+            NumaNode node(0);
+            const int num_cpus = (int) std::max(1u, std::thread::hardware_concurrency());
+            for (int cpu = 0; cpu < num_cpus; ++cpu) {
+                node.cpus.push_back(cpu);
+            }
+            node.free_bytes = (uint64_t) sysconf(_SC_AVPHYS_PAGES) * (uint64_t) sysconf(_SC_PAGESIZE);
+            this->v_nodes.push_back(node);
+        }
+    }
+
+    /**
+     * Parse a sysfs list of CPUs, like "0-3,8,10-11".
+     */
+    static void
+    parse_cpulist(
+            const std::string &cpulist,
+            std::vector<int> &cpus
+    ) {
+        std::stringstream stream(cpulist);
+        std::string range;
+        while (std::getline(stream, range, ',')) {
+            if (range.empty() || range[0] < '0' || range[0] > '9') {
+                continue;
+            }
+            const size_t dash_pos = range.find('-');
+            const int first_cpu = atoi(range.c_str());
+            const int last_cpu = (dash_pos == std::string::npos) ? first_cpu : atoi(range.c_str() + dash_pos + 1);
+            for (int cpu = first_cpu; cpu <= last_cpu; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    size_t
+    get_num_nodes() const {
+        return this->v_nodes.size();
+    }
+
+    const NumaNode &
+    get_node(
+            size_t node_index
+    ) const {
+        return this->v_nodes.at(node_index);
+    }
+
+    /**
+     * Bind the calling thread to the CPUs of a node.
+     * @param node_index The index of the node (not its sysfs identifier)
+     * @return false if the affinity cannot be set
+     */
+    bool
+    pin_current_thread(
+            size_t node_index
+    ) const {
+        const NumaNode &node = this->get_node(node_index);
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (size_t i = 0, i_max = node.cpus.size(); i < i_max; ++i) {
+            if (node.cpus[i] < CPU_SETSIZE) {
+                CPU_SET(node.cpus[i], &cpu_set);
+            }
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+    }
+
+    /**
+     * Interleave the pages allocated by the calling thread on all the nodes.
+     * @return false if the memory policy cannot be set (e.g. the kernel has no NUMA support)
+     */
+    bool
+    interleave_current_thread_memory() const {
+        const size_t bits_per_word = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> node_mask;
+        for (size_t i = 0, i_max = this->v_nodes.size(); i < i_max; ++i) {
+            const size_t node_id = this->v_nodes[i].node_id;
+            if (node_id / bits_per_word >= node_mask.size()) {
+                node_mask.resize(node_id / bits_per_word + 1, 0);
+            }
+            node_mask[node_id / bits_per_word] |= 1UL << (node_id % bits_per_word);
+        }
+        return syscall(SYS_set_mempolicy, this->MPOL_INTERLEAVE_POLICY, node_mask.data(),
+                       node_mask.size() * bits_per_word + 1) == 0;
+    }
+
+    void
+    reset_current_thread_memory() const {
+        syscall(SYS_set_mempolicy, this->MPOL_DEFAULT_POLICY, nullptr, 0);
+    }
+
+private:
+    /**
+     * Read the "Node N MemFree: X kB" line of a node meminfo file.
+     */
+    static uint64_t
+    _read_free_bytes(
+            const std::string &meminfo_path
+    ) {
+        std::ifstream meminfo_file(meminfo_path.c_str());
+        std::string line;
+        while (std::getline(meminfo_file, line)) {
+            const size_t key_pos = line.find("MemFree:");
+            if (key_pos != std::string::npos) {
+                return strtoull(line.c_str() + key_pos + 8, nullptr, 10) * 1024;
+            }
+        }
+        return 0;
+    }
+};
+
+
+/**
+ * Read-only copies of a compiled matcher (or any copy-constructible object, like a Segmenter) on the local memory of
+ * each NUMA node, so that the threads of a node never read the automaton and the vocabulary through the interconnect.
+ * Each replica is copied by a thread pinned to its node, hence the first-touch policy of the kernel places its pages on
+ * that node. The nodes without enough free memory share a single replica interleaved on all the nodes.
+ * @tparam MatcherType
+ */
+template<typename MatcherType>
+class NumaReplicatedMatcher {
+private:
+    std::vector<std::unique_ptr<MatcherType>> v_replicas;
+    std::vector<size_t> v_node_index_to_replica_index;
+    std::vector<bool> v_node_index_is_local;
+
+public:
+    /**
+     * @param matcher The compiled matcher to replicate, it can be dropped afterwards
+     * @param topology The NUMA topology of the host
+     * @param replica_bytes Estimated size of a replica (0 to always replicate)
+     * @param max_free_memory_fraction Maximum fraction of the free memory of a node that a replica can take
+     */
+    NumaReplicatedMatcher(
+            const MatcherType &matcher,
+            const NumaTopology &topology,
+            size_t replica_bytes = 0,
+            double max_free_memory_fraction = 0.5
+    ) {
+        const size_t num_nodes = topology.get_num_nodes();
+        this->v_node_index_to_replica_index.resize(num_nodes);
+        this->v_node_index_is_local.resize(num_nodes);
+
+        // choose the nodes with a local replica, the others share the interleaved one
+        std::vector<size_t> v_local_node_indexes;
+        bool has_interleaved_replica = false;
+        for (size_t i = 0; i < num_nodes; ++i) {
+            if (replica_bytes == 0 ||
+                (double) replica_bytes <= max_free_memory_fraction * (double) topology.get_node(i).free_bytes) {
+                this->v_node_index_to_replica_index[i] = v_local_node_indexes.size();
+                this->v_node_index_is_local[i] = true;
+                v_local_node_indexes.push_back(i);
+            } else {
+                has_interleaved_replica = true;
+            }
+        }
+        for (size_t i = 0; i < num_nodes; ++i) {
+            if (!this->v_node_index_is_local[i]) {
+                this->v_node_index_to_replica_index[i] = v_local_node_indexes.size();
+            }
+        }
+
+        // copy the replicas in parallel, each one from a thread running on its node
+        const size_t num_replicas = v_local_node_indexes.size() + (has_interleaved_replica ? 1 : 0);
+        this->v_replicas.resize(num_replicas);
+        std::vector<std::exception_ptr> exceptions(num_replicas);
+        std::vector<std::thread> threads;
+        for (size_t replica_index = 0; replica_index < num_replicas; ++replica_index) {
+            const bool is_local = replica_index < v_local_node_indexes.size();
+            const size_t node_index = is_local ? v_local_node_indexes[replica_index] : 0;
+            std::unique_ptr<MatcherType> *replica = &this->v_replicas[replica_index];
+            std::exception_ptr *exception = &exceptions[replica_index];
+            threads.push_back(std::thread([&matcher, &topology, is_local, node_index, replica, exception]() {
+                try {
+                    if (is_local) {
+                        topology.pin_current_thread(node_index);
+                    } else {
+                        topology.interleave_current_thread_memory();
+                    }
+                    replica->reset(new MatcherType(matcher));
+                } catch (...) {
+                    *exception = std::current_exception();
+                }
+                if (!is_local) {
+                    topology.reset_current_thread_memory();
+                }
+            }));
+        }
+        for (size_t i = 0, i_max = threads.size(); i < i_max; ++i) {
+            threads[i].join();
+        }
+        for (size_t i = 0, i_max = exceptions.size(); i < i_max; ++i) {
+            if (exceptions[i]) {
+                std::rethrow_exception(exceptions[i]);
+            }
+        }
+    }
+
+    /**
+     * Get the replica to use from the threads running on a node.
+     * @param node_index The index of the node in the topology
+     */
+    const MatcherType &
+    get_replica(
+            size_t node_index
+    ) const {
+        return *this->v_replicas[this->v_node_index_to_replica_index.at(node_index)];
+    }
+
+    /**
+     * @return false if the node uses the interleaved replica
+     */
+    bool
+    is_local_replica(
+            size_t node_index
+    ) const {
+        return this->v_node_index_is_local.at(node_index);
+    }
+
+    size_t
+    get_num_replicas() const {
+        return this->v_replicas.size();
+    }
+};
+
+
+/**
+ * Pool of threads pinned to the NUMA nodes: every task receives the index of the node of the worker that runs it, so
+ * that it can use the node-local replica of a NumaReplicatedMatcher.
+ */
+class NumaWorkerPool : public WorkerPool {
+public:
+    /**
+     * @param topology The NUMA topology of the host
+     * @param workers_per_node Number of workers of each node (0 to use one worker per CPU)
+     */
+    NumaWorkerPool(const NumaTopology &topology, size_t workers_per_node = 0) :
+            WorkerPool(NumaWorkerPool::_get_worker_node_indexes(topology, workers_per_node),
+                       [topology](size_t node_index) { topology.pin_current_thread(node_index); }) {}
+
+private:
+    static std::vector<size_t>
+    _get_worker_node_indexes(
+            const NumaTopology &topology,
+            size_t workers_per_node
+    ) {
+        std::vector<size_t> worker_node_indexes;
+        for (size_t node_index = 0, num_nodes = topology.get_num_nodes(); node_index < num_nodes; ++node_index) {
+            const size_t num_workers = (workers_per_node == 0) ? topology.get_node(node_index).cpus.size()
+                                                               : workers_per_node;
+            worker_node_indexes.insert(worker_node_indexes.end(), num_workers, node_index);
+        }
+        return worker_node_indexes;
+    }
+};
+
+#endif //NUMAREPLICATEDMATCHER_HPP
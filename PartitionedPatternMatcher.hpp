@@ -0,0 +1,257 @@
+#ifndef PARTITIONEDPATTERNMATCHER_HPP
+#define PARTITIONEDPATTERNMATCHER_HPP
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "PatternMatcher.hpp"
+
+
+/**
+ * Pattern matcher split into independent partitions (shards) according to the first word of each pattern. Every
+ * partition is a PatternMatcher on its own, hence it can be built and compiled independently of the others, and a
+ * process can host only a subset of the partitions of a dictionary that does not fit in its memory.
+ * The matches of the hosted partitions are merged in the same order produced by a single PatternMatcher, i.e. by end
+ * position and, for the same end position, from the longest pattern to the shortest one.
+ * @tparam KeyType
+ * @tparam KeyPolicy
+ * @tparam IdType
+ */
+template<typename KeyType, typename KeyPolicy = SparseKeys, typename IdType = uint32_t>
+class PartitionedPatternMatcher {
+public:
+    typedef PatternMatcher<KeyType, KeyPolicy, IdType> PartitionType;
+
+private:
+    std::vector<std::unique_ptr<PartitionType>> v_partition_id_to_partition;
+    std::vector<size_t> v_hosted_partition_ids;
+    TextNormalizer normalizer;
+
+public:
+    /**
+     * Create a matcher that hosts all the partitions.
+     * @param num_partitions Number of partitions of the dictionary
+     */
+    PartitionedPatternMatcher(size_t num_partitions) :
+            v_partition_id_to_partition(num_partitions) {
+        if (num_partitions == 0) {
+            throw std::invalid_argument("The number of partitions must be greater than 0");
+        }
+        for (size_t i = 0; i < num_partitions; ++i) {
+            this->v_partition_id_to_partition[i].reset(new PartitionType());
+            this->v_hosted_partition_ids.push_back(i);
+        }
+    }
+
+    /**
+     * Create a matcher that hosts only some of the partitions: the patterns of the other ones are ignored.
+     * @param num_partitions Number of partitions of the dictionary
+     * @param hosted_partition_ids Identifiers of the partitions to host
+     */
+    PartitionedPatternMatcher(size_t num_partitions, const std::vector<size_t> &hosted_partition_ids) :
+            v_partition_id_to_partition(num_partitions) {
+        if (num_partitions == 0) {
+            throw std::invalid_argument("The number of partitions must be greater than 0");
+        }
+        for (size_t i = 0, i_max = hosted_partition_ids.size(); i < i_max; ++i) {
+            const size_t partition_id = hosted_partition_ids[i];
+            if (partition_id >= num_partitions) {
+                throw std::invalid_argument("The given partition identifier is out of range");
+            }
+            if (!this->v_partition_id_to_partition[partition_id]) {
+                this->v_partition_id_to_partition[partition_id].reset(new PartitionType());
+                this->v_hosted_partition_ids.push_back(partition_id);
+            }
+        }
+    }
+
+    /**
+     * Add a pattern to its partition.
+     * @return false if the partition of the pattern is not hosted by this matcher
+     */
+    bool
+    add_pattern(
+            KeyType pattern_id,
+            const std::string &pattern
+    ) {
+        PartitionType *partition = this->v_partition_id_to_partition[this->get_partition_id(pattern)].get();
+        if (partition == nullptr) {
+            return false;
+        }
+        partition->add_pattern(pattern_id, pattern);
+        return true;
+    }
+
+    /**
+     * Compile the hosted partitions in parallel.
+     */
+    void
+    compile() {
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> exceptions(this->v_hosted_partition_ids.size());
+        for (size_t i = 0, i_max = this->v_hosted_partition_ids.size(); i < i_max; ++i) {
+            PartitionType *partition = this->v_partition_id_to_partition[this->v_hosted_partition_ids[i]].get();
+            std::exception_ptr *exception = &exceptions[i];
+            threads.push_back(std::thread([partition, exception]() {
+                try {
+                    partition->compile();
+                } catch (...) {
+                    *exception = std::current_exception();
+                }
+            }));
+        }
+        for (size_t i = 0, i_max = threads.size(); i < i_max; ++i) {
+            threads[i].join();
+        }
+        for (size_t i = 0, i_max = exceptions.size(); i < i_max; ++i) {
+            if (exceptions[i]) {
+                std::rethrow_exception(exceptions[i]);
+            }
+        }
+    }
+
+    void
+    find_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        const size_t num_hosted = this->v_hosted_partition_ids.size();
+        if (num_hosted == 1) {
+            this->v_partition_id_to_partition[this->v_hosted_partition_ids[0]]->find_patterns(text, matches);
+            return;
+        }
+        if (matches.get_semantics() != MATCH_ALL) {
+            throw std::invalid_argument("The leftmost semantics require a single hosted partition");
+        }
+
+        // find the matches of each partition
+        std::vector<PatternMatches<KeyType>> v_partition_matches(
+                num_hosted, PatternMatches<KeyType>(matches.include_suffixes(), matches.include_spans()));
+        std::vector<const PartitionType *> v_partitions(num_hosted);
+        for (size_t i = 0; i < num_hosted; ++i) {
+            v_partitions[i] = this->v_partition_id_to_partition[this->v_hosted_partition_ids[i]].get();
+            v_partitions[i]->find_patterns(text, v_partition_matches[i]);
+        }
+
+        // merge them by end position and decreasing length, caching the length of the head of each partition
+        std::vector<size_t> v_heads(num_hosted, 0);
+        std::vector<pattern_length_t> v_head_lengths(num_hosted, 0);
+        for (size_t i = 0; i < num_hosted; ++i) {
+            if (!v_partition_matches[i].empty()) {
+                v_head_lengths[i] = v_partitions[i]->get_pattern_length(v_partition_matches[i][0].pattern);
+            }
+        }
+        bool has_last = false;
+        size_t last_end_pos = 0;
+        while (true) {
+            size_t best = num_hosted;
+            for (size_t i = 0; i < num_hosted; ++i) {
+                if (v_heads[i] == v_partition_matches[i].size()) {
+                    continue;
+                }
+                if (best == num_hosted) {
+                    best = i;
+                    continue;
+                }
+                const size_t end_pos = v_partition_matches[i][v_heads[i]].end_pos;
+                const size_t best_end_pos = v_partition_matches[best][v_heads[best]].end_pos;
+                if (end_pos < best_end_pos || (end_pos == best_end_pos && v_head_lengths[i] > v_head_lengths[best])) {
+                    best = i;
+                }
+            }
+            if (best == num_hosted) {
+                break;
+            }
+
+            // without suffixes only the longest match of each end position is kept
+            const PatternMatch<KeyType> &match = v_partition_matches[best][v_heads[best]];
+            if (matches.include_suffixes() || !has_last || last_end_pos != match.end_pos) {
+                matches.push_back(match);
+                if (matches.include_spans()) {
+                    matches.push_span(v_partition_matches[best].spans()[v_heads[best]]);
+                }
+            }
+            has_last = true;
+            last_end_pos = match.end_pos;
+
+            if (++v_heads[best] < v_partition_matches[best].size()) {
+                v_head_lengths[best] = v_partitions[best]->get_pattern_length(
+                        v_partition_matches[best][v_heads[best]].pattern);
+            }
+        }
+    }
+
+    /**
+     * Set the normalization of all the partitions; it is also used to find the first word of the patterns.
+     */
+    void
+    set_normalizer(
+            const TextNormalizer &normalizer
+    ) {
+        for (size_t i = 0, i_max = this->v_hosted_partition_ids.size(); i < i_max; ++i) {
+            this->v_partition_id_to_partition[this->v_hosted_partition_ids[i]]->set_normalizer(normalizer);
+        }
+        this->normalizer = normalizer;
+    }
+
+    /**
+     * Get the partition of a pattern according to its first (normalized) word.
+     */
+    size_t
+    get_partition_id(
+            const std::string &pattern
+    ) const {
+        std::string scratch_word;
+        size_t first_word_hash = 0;
+        bool is_first_word = true;
+        this->normalizer.for_each_word(
+                pattern.data(), pattern.size(), scratch_word,
+                [&first_word_hash, &is_first_word](const MyString &word, size_t, size_t) {
+                    if (is_first_word) {
+                        first_word_hash = std::hash<MyString>()(word);
+                        is_first_word = false;
+                    }
+                });
+        return first_word_hash % this->v_partition_id_to_partition.size();
+    }
+
+    size_t
+    get_num_partitions() const {
+        return this->v_partition_id_to_partition.size();
+    }
+
+    const std::vector<size_t> &
+    get_hosted_partition_ids() const {
+        return this->v_hosted_partition_ids;
+    }
+
+    /**
+     * Get a hosted partition (nullptr if it is not hosted).
+     */
+    PartitionType *
+    get_partition(
+            size_t partition_id
+    ) {
+        return this->v_partition_id_to_partition.at(partition_id).get();
+    }
+
+    pattern_length_t
+    get_pattern_length(
+            KeyType pattern_id
+    ) const {
+        for (size_t i = 0, i_max = this->v_hosted_partition_ids.size(); i < i_max; ++i) {
+            pattern_length_t length;
+            const PartitionType *partition = this->v_partition_id_to_partition[this->v_hosted_partition_ids[i]].get();
+            if (partition->get_pattern_length_map().find_length(pattern_id, length)) {
+                return length;
+            }
+        }
+        throw std::runtime_error("The given pattern has not been found");
+    }
+};
+
+#endif //PARTITIONEDPATTERNMATCHER_HPP
@@ -1,39 +1,145 @@
 #ifndef PATTERNMATCHER_HPP
 #define PATTERNMATCHER_HPP
 
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
 #include <string.h>
+#include <utility>
 #include <vector>
 
 #include "BufferManager.hpp"
 #include "AhoCorasickAutomaton.hpp"
+#include "ResultCache.hpp"
+#include "TextNormalizer.hpp"
 
 typedef uint16_t pattern_length_t;
 
 
-template <typename KeyType>
+/**
+ * Length (in words) of each pattern, stored according to the key policy: a hash map for SparseKeys and a flat array
+ * indexed by the key for DenseKeys.
+ * @tparam KeyType
+ * @tparam KeyPolicy
+ */
+template<typename KeyType, typename KeyPolicy>
+class PatternLengthMap;
+
+template<typename KeyType>
+class PatternLengthMap<KeyType, SparseKeys> : public std::unordered_map<KeyType, pattern_length_t> {
+public:
+    bool
+    find_length(
+            const KeyType &key,
+            pattern_length_t &length
+    ) const {
+        auto it = this->find(key);
+        if (it == this->end()) {
+            return false;
+        }
+        length = it->second;
+        return true;
+    }
+
+    void
+    set_length(
+            const KeyType &key,
+            pattern_length_t length
+    ) {
+        this->operator[](key) = length;
+    }
+};
+
+template<typename KeyType>
+class PatternLengthMap<KeyType, DenseKeys> : public std::vector<pattern_length_t> {
+private:
+    static const pattern_length_t NO_LENGTH = (pattern_length_t) -1;
+
+public:
+    bool
+    find_length(
+            const KeyType &key,
+            pattern_length_t &length
+    ) const {
+        if ((size_t) key >= this->size() || this->operator[]((size_t) key) == NO_LENGTH) {
+            return false;
+        }
+        length = this->operator[]((size_t) key);
+        return true;
+    }
+
+    void
+    set_length(
+            const KeyType &key,
+            pattern_length_t length
+    ) {
+        if ((size_t) key >= this->size()) {
+            this->resize((size_t) key + 1, (pattern_length_t) NO_LENGTH);
+        }
+        this->operator[]((size_t) key) = length;
+    }
+};
+
+
+template <typename KeyType, typename KeyPolicy = SparseKeys, typename IdType = uint32_t>
 class PatternMatcher {
 private:
     typedef uint32_t word_identifier_t;
+    typedef AhoCorasickAutomaton<KeyType, word_identifier_t, KeyPolicy, IdType> AutomatonType;
+    typedef typename AutomatonType::type_state_id type_state_id;
+
+    static const size_t MAX_PATTERN_WORDS = 32;
+
+public:
+    // compact representation of the matches (without suffixes) stored in the result cache
+    typedef std::vector<std::pair<KeyType, uint32_t>> CachedMatchesType;
+    typedef ShardedResultCache<CachedMatchesType> ResultCacheType;
 
 private:
-    AhoCorasickAutomaton<KeyType, word_identifier_t> automaton;
+    AutomatonType automaton;
     BufferManager buffer_manager;
     std::unordered_set<MyString> pattern_set;
-    std::unordered_map<KeyType, pattern_length_t> pattern_id_to_length;
+    PatternLengthMap<KeyType, KeyPolicy> pattern_id_to_length;
     std::unordered_map<MyString, word_identifier_t> word_to_word_id;
+    std::unique_ptr<ResultCacheType> result_cache;
+    pattern_length_t max_pattern_length;
+    TextNormalizer normalizer;
+    std::string scratch_word;
 
 public:
-    PatternMatcher() {
+    PatternMatcher() :
+            max_pattern_length(0) {
+    }
+
+    /**
+     * Deep copy of a matcher: the words and the patterns are copied into the buffers of the new matcher, hence all
+     * its memory is allocated (and first touched) by the calling thread. The result cache is not copied.
+     */
+    PatternMatcher(const PatternMatcher &other) :
+            automaton(other.automaton),
+            pattern_id_to_length(other.pattern_id_to_length),
+            max_pattern_length(other.max_pattern_length),
+            normalizer(other.normalizer) {
+        this->pattern_set.reserve(other.pattern_set.size());
+        for (auto it = other.pattern_set.cbegin(), it_end = other.pattern_set.cend(); it != it_end; ++it) {
+            this->pattern_set.insert(this->buffer_manager.createDataBlock(it->data(), it->size()));
+        }
+        this->word_to_word_id.reserve(other.word_to_word_id.size());
+        for (auto it = other.word_to_word_id.cbegin(), it_end = other.word_to_word_id.cend(); it != it_end; ++it) {
+            this->word_to_word_id[this->buffer_manager.createDataBlock(it->first.data(), it->first.size())] =
+                    it->second;
+        }
     }
 
+    PatternMatcher &operator=(const PatternMatcher &) = delete;
+
     void
     add_pattern(
             KeyType pattern_id,
             const std::string &pattern
     ) {
-        word_identifier_t word_ids[32];
+        word_identifier_t word_ids[PatternMatcher::MAX_PATTERN_WORDS];
 
         // check if the same pattern has been already inserted
         if (pattern_set.count(MyString(pattern.c_str(), pattern.size()))) {
@@ -43,38 +149,66 @@ public:
         MyString pattern_block = this->buffer_manager.createDataBlock(&pattern[0], pattern.size());
 
         pattern_length_t num_words = 0;
-        for (size_t marker_pos = 0, space_pos = 0, max_space_pos = pattern_block.size();
-             marker_pos < max_space_pos;
-             marker_pos = space_pos + 1
-                ) {
-            space_pos = pattern_block.find(' ', marker_pos);
-
-            // skip empty sub portions
-            if (marker_pos >= space_pos) {
-                continue;
-            }
-            // store this word into the map
-            MyString word = pattern_block.sub(marker_pos, space_pos - marker_pos);
-
-            auto find_word_it = this->word_to_word_id.find(word);
-            if (find_word_it == this->word_to_word_id.end()) {
-                word_ids[num_words] = this->word_to_word_id[word] = (word_identifier_t) this->word_to_word_id.size() + 1;
-            } else {
-                word_ids[num_words] = find_word_it->second;
-            }
-            // increase the number of words
-            ++num_words;
-        }
+        this->normalizer.for_each_word(
+                pattern_block.data(), pattern_block.size(), this->scratch_word,
+                [this, &pattern_block, &word_ids, &num_words](const MyString &word, size_t begin_offset, size_t) {
+                    if (num_words == PatternMatcher::MAX_PATTERN_WORDS) {
+                        throw std::invalid_argument("The given pattern has too many words");
+                    }
+                    // store this word into the map
+                    auto find_word_it = this->word_to_word_id.find(word);
+                    if (find_word_it == this->word_to_word_id.end()) {
+                        // the normalized words are not inside the pattern block, hence they are copied
+                        const word_identifier_t word_id = (word_identifier_t) this->word_to_word_id.size() + 1;
+                        if (word.data() == pattern_block.data() + begin_offset) {
+                            this->word_to_word_id[word] = word_id;
+                        } else {
+                            this->word_to_word_id[this->buffer_manager.createDataBlock(word.data(), word.size())] =
+                                    word_id;
+                        }
+                        word_ids[num_words] = word_id;
+                    } else {
+                        word_ids[num_words] = find_word_it->second;
+                    }
+                    // increase the number of words
+                    ++num_words;
+                });
 
         this->pattern_set.insert(pattern_block);
         this->automaton.add_pattern(pattern_id, &word_ids[0], &word_ids[num_words]);
-        this->pattern_id_to_length[pattern_id] = num_words;
+        this->pattern_id_to_length.set_length(pattern_id, num_words);
+        if (num_words > this->max_pattern_length) {
+            this->max_pattern_length = num_words;
+        }
+    }
+
+    /**
+     * Set the normalization applied to both the patterns and the texts. It must be set before adding the patterns.
+     * @param normalizer The normalizer to use
+     */
+    void
+    set_normalizer(
+            const TextNormalizer &normalizer
+    ) {
+        if (!this->pattern_set.empty()) {
+            throw std::runtime_error("The normalizer cannot be changed after adding the patterns");
+        }
+        this->normalizer = normalizer;
+    }
+
+    const TextNormalizer &
+    get_normalizer() const {
+        return this->normalizer;
     }
 
     void
     compile() {
         this->automaton.compile();
         this->automaton.reduce_memory_footprint();
+        // the cached results could refer to the patterns before the compilation
+        if (this->result_cache) {
+            this->result_cache->clear();
+        }
     }
 
     void
@@ -82,6 +216,9 @@ public:
             PatternMatches<KeyType> &src_matches,
             PatternMatches<KeyType> &dst_matches
     ) const {
+        if (dst_matches.include_spans()) {
+            throw std::runtime_error("The spans of the suffixes cannot be computed without the text");
+        }
         this->automaton.complete_with_suffix_matches(src_matches, dst_matches);
     }
 
@@ -90,50 +227,73 @@ public:
             const std::string &text,
             PatternMatches<KeyType> &matches
     ) const {
-        type_state_id current_state_id = 0;
-        size_t pos = 0;
-        word_identifier_t current_word_id = 0;
-        MyString text_block = MyString(&text[0], text.size());
-        auto find_result_it_end = this->word_to_word_id.cend();
-
-        for (size_t marker_pos = 0, space_pos = 0, max_space_pos = text_block.size();
-             marker_pos < max_space_pos;
-             marker_pos = space_pos + 1
-                ) {
-            space_pos = text_block.find(' ', marker_pos);
+        // the cache stores neither the spans nor the leftmost matches
+        if (!this->result_cache || matches.include_spans() || matches.get_semantics() != MATCH_ALL) {
+            this->_find_patterns(text, matches);
+            return;
+        }
 
-            // skip empty sub portions
-            if (marker_pos >= space_pos) {
-                continue;
+        // the cache stores the matches without suffixes, which are added back when requested
+        CachedMatchesType cached_matches;
+        PatternMatches<KeyType> text_matches(false);
+        if (this->result_cache->find(text, cached_matches)) {
+            text_matches.reserve(cached_matches.size());
+            for (size_t i = 0, i_max = cached_matches.size(); i < i_max; ++i) {
+                text_matches.push_back(PatternMatch<KeyType>(cached_matches[i].first, cached_matches[i].second));
             }
-            // recognize the current word
-            MyString word = text_block.sub(marker_pos, space_pos - marker_pos);
-            auto find_word_it = this->word_to_word_id.find(word);
-            if (find_word_it != find_result_it_end) {
-                current_word_id = find_word_it->second;
-            } else {
-                current_word_id = 0;
+        } else {
+            this->_find_patterns(text, text_matches);
+            cached_matches.reserve(text_matches.size());
+            for (size_t i = 0, i_max = text_matches.size(); i < i_max; ++i) {
+                cached_matches.push_back(std::make_pair(text_matches[i].pattern, (uint32_t) text_matches[i].end_pos));
             }
+            this->result_cache->insert(text, cached_matches);
+        }
 
-            // go to the next state
-            current_state_id = this->automaton.get_next_state_id(current_state_id, current_word_id, matches, pos);
-
-            // advance the counter
-            ++pos;
+        if (matches.include_suffixes()) {
+            this->automaton.complete_with_suffix_matches(text_matches, matches);
+        } else {
+            for (size_t i = 0, i_max = text_matches.size(); i < i_max; ++i) {
+                matches.push_back(text_matches[i]);
+            }
         }
     }
 
+    /**
+     * Cache the matches of the texts, so that the repeated ones are not scanned again. The cache is owned by this
+     * matcher, hence it is dropped together with it.
+     * @param max_bytes Memory budget of the cache
+     * @param num_shards Number of independent shards of the cache
+     */
+    void
+    enable_result_cache(
+            size_t max_bytes,
+            size_t num_shards = 16
+    ) {
+        this->result_cache.reset(new ResultCacheType(max_bytes, num_shards));
+    }
+
+    void
+    disable_result_cache() {
+        this->result_cache.reset();
+    }
+
+    const ResultCacheType *
+    get_result_cache() const {
+        return this->result_cache.get();
+    }
+
     pattern_length_t
     get_pattern_length(
             KeyType pattern_id
     ) const {
-        auto it = this->pattern_id_to_length.find(pattern_id);
-        if (it == this->pattern_id_to_length.end())
+        pattern_length_t length;
+        if (!this->pattern_id_to_length.find_length(pattern_id, length))
             throw std::runtime_error("The given pattern has not been found");
-        return it->second;
+        return length;
     }
 
-    const std::unordered_map<KeyType, pattern_length_t> &
+    const PatternLengthMap<KeyType, KeyPolicy> &
     get_pattern_length_map() const {
         return this->pattern_id_to_length;
     }
@@ -151,6 +311,117 @@ public:
         this->pattern_set.reserve(num_patterns);
         this->word_to_word_id.reserve(num_patterns);
     }
+
+private:
+    void
+    _find_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        if (matches.get_semantics() != MATCH_ALL) {
+            this->_find_leftmost_patterns(text, matches);
+            return;
+        }
+
+        type_state_id current_state_id = 0;
+        size_t pos = 0;
+        word_identifier_t current_word_id = 0;
+        auto find_result_it_end = this->word_to_word_id.cend();
+        std::string scratch_word;
+
+        // ring with the begin offsets of the last words, large enough to contain the longest pattern
+        const bool include_spans = matches.include_spans();
+        size_t ring_mask = 0;
+        std::vector<size_t> ring_word_begin;
+        if (include_spans) {
+            size_t ring_size = 1;
+            while (ring_size < this->max_pattern_length) {
+                ring_size <<= 1;
+            }
+            ring_word_begin.resize(ring_size);
+            ring_mask = ring_size - 1;
+        }
+
+        this->normalizer.for_each_word(
+                text.data(), text.size(), scratch_word,
+                [&](const MyString &word, size_t begin_offset, size_t end_offset) {
+                    // recognize the current word
+                    auto find_word_it = this->word_to_word_id.find(word);
+                    if (find_word_it != find_result_it_end) {
+                        current_word_id = find_word_it->second;
+                    } else {
+                        current_word_id = 0;
+                    }
+
+                    // go to the next state
+                    if (include_spans) {
+                        ring_word_begin[pos & ring_mask] = begin_offset;
+                        const size_t num_matches = matches.size();
+                        current_state_id = this->automaton.get_next_state_id(current_state_id, current_word_id,
+                                                                             matches, pos);
+                        for (size_t i = num_matches, i_max = matches.size(); i < i_max; ++i) {
+                            const pattern_length_t length = this->get_pattern_length(matches[i].pattern);
+                            const size_t begin_match_offset = (length == 0) ? end_offset
+                                    : ring_word_begin[(pos + 1 - length) & ring_mask];
+                            matches.push_span(PatternSpan(begin_match_offset, end_offset));
+                        }
+                    } else {
+                        current_state_id = this->automaton.get_next_state_id(current_state_id, current_word_id,
+                                                                             matches, pos);
+                    }
+
+                    // advance the counter
+                    ++pos;
+                });
+    }
+
+    /**
+     * Scan for MATCH_LEFTMOST_FIRST and MATCH_LEFTMOST_LONGEST: the patterns of each state are passed to the selector
+     * instead of being accumulated, and the priority of a pattern is its identifier inside the automaton.
+     */
+    void
+    _find_leftmost_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        LeftmostMatchSelector<KeyType> selector(matches.get_semantics(), std::max<size_t>(this->max_pattern_length, 1));
+        type_state_id current_state_id = 0;
+        size_t pos = 0;
+        auto find_result_it_end = this->word_to_word_id.cend();
+        std::string scratch_word;
+
+        // ring with the begin offsets of the last words, large enough to contain the longest pattern
+        size_t ring_size = 1;
+        while (ring_size < this->max_pattern_length) {
+            ring_size <<= 1;
+        }
+        std::vector<size_t> ring_word_begin(ring_size);
+        const size_t ring_mask = ring_size - 1;
+
+        this->normalizer.for_each_word(
+                text.data(), text.size(), scratch_word,
+                [&](const MyString &word, size_t begin_offset, size_t end_offset) {
+                    auto find_word_it = this->word_to_word_id.find(word);
+                    const word_identifier_t current_word_id = (find_word_it != find_result_it_end)
+                                                              ? find_word_it->second : 0;
+                    current_state_id = this->automaton.get_next_state_id(current_state_id, current_word_id);
+                    ring_word_begin[pos & ring_mask] = begin_offset;
+
+                    this->automaton.for_each_state_pattern(
+                            current_state_id,
+                            [&](const KeyType &pattern, size_t priority) {
+                                const pattern_length_t length = this->get_pattern_length(pattern);
+                                if (length == 0) {
+                                    return;
+                                }
+                                selector.add_candidate(pattern, pos + 1 - length, pos, priority,
+                                                       ring_word_begin[(pos + 1 - length) & ring_mask], end_offset);
+                            });
+                    selector.flush(pos, matches);
+                    ++pos;
+                });
+        selector.finish(matches);
+    }
 };
 
 #endif //PATTERNMATCHER_HPP
@@ -0,0 +1,246 @@
+#ifndef RESULTCACHE_HPP
+#define RESULTCACHE_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * Approximate amount of memory used by a cached value.
+ */
+template<typename _Tp>
+size_t
+cache_value_bytes(const std::vector<_Tp> &value) {
+    return sizeof(value) + value.size() * sizeof(_Tp);
+}
+
+
+/**
+ * Concurrent and memory-bounded cache that associates a text to the result of its processing (e.g. the matches found
+ * in it). The entries are split into shards, each protected by its own mutex, and indexed by the hash of the text; the
+ * text is stored too, so that two texts with the same hash are never confused. When a shard exceeds its memory budget
+ * the entries are evicted with the CLOCK (second chance) policy.
+ * @tparam ValueType
+ */
+template<typename ValueType>
+class ShardedResultCache {
+private:
+    class CacheEntry {
+    public:
+        std::string text;
+        ValueType value;
+        size_t bytes;
+        bool is_used;
+        bool is_referenced;
+
+    public:
+        CacheEntry() :
+                bytes(0),
+                is_used(false),
+                is_referenced(false) {}
+    };
+
+    class CacheShard {
+    public:
+        std::mutex mutex;
+        std::unordered_map<size_t, size_t> h_hash_to_slot;
+        std::vector<CacheEntry> v_slots;
+        std::vector<size_t> v_free_slots;
+        size_t clock_hand;
+        size_t used_bytes;
+
+    public:
+        CacheShard() :
+                clock_hand(0),
+                used_bytes(0) {}
+    };
+
+private:
+    const size_t max_bytes_per_shard;
+    std::vector<std::unique_ptr<CacheShard>> v_shards;
+    std::hash<std::string> text_hash;
+    std::atomic<uint64_t> num_hits;
+    std::atomic<uint64_t> num_misses;
+
+public:
+    /**
+     * Create a new cache.
+     * @param max_bytes Memory budget of the whole cache (texts and values)
+     * @param num_shards Number of independent shards, to reduce the contention between threads
+     */
+    ShardedResultCache(size_t max_bytes, size_t num_shards = 16) :
+            max_bytes_per_shard(max_bytes / (num_shards > 0 ? num_shards : 1)),
+            v_shards(num_shards > 0 ? num_shards : 1),
+            num_hits(0),
+            num_misses(0) {
+        for (size_t i = 0, i_max = this->v_shards.size(); i < i_max; ++i) {
+            this->v_shards[i].reset(new CacheShard());
+        }
+    }
+
+    /**
+     * Look for the result of the given text.
+     * @param text The text used as key
+     * @param value Where to copy the cached result (untouched in case of miss)
+     * @return true if the result has been found
+     */
+    bool
+    find(
+            const std::string &text,
+            ValueType &value
+    ) {
+        const size_t hash = this->text_hash(text);
+        CacheShard &shard = this->_get_shard(hash);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.h_hash_to_slot.find(hash);
+            if (it != shard.h_hash_to_slot.end()) {
+                CacheEntry &entry = shard.v_slots[it->second];
+                if (entry.text == text) {
+                    entry.is_referenced = true;
+                    value = entry.value;
+                    ++this->num_hits;
+                    return true;
+                }
+            }
+        }
+        ++this->num_misses;
+        return false;
+    }
+
+    /**
+     * Store the result of the given text, evicting the older entries if the memory budget is exceeded.
+     * @param text The text used as key
+     * @param value The result to store
+     */
+    void
+    insert(
+            const std::string &text,
+            const ValueType &value
+    ) {
+        const size_t bytes = sizeof(CacheEntry) + text.size() + cache_value_bytes(value);
+        if (bytes > this->max_bytes_per_shard) {
+            return;
+        }
+
+        const size_t hash = this->text_hash(text);
+        CacheShard &shard = this->_get_shard(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // replace the entry with the same hash (if any)
+        auto it = shard.h_hash_to_slot.find(hash);
+        if (it != shard.h_hash_to_slot.end()) {
+            this->_evict(shard, it->second);
+        }
+
+        // CLOCK eviction: the referenced entries get a second chance
+        while (shard.used_bytes + bytes > this->max_bytes_per_shard) {
+            if (shard.clock_hand >= shard.v_slots.size()) {
+                shard.clock_hand = 0;
+            }
+            CacheEntry &entry = shard.v_slots[shard.clock_hand];
+            if (entry.is_used) {
+                if (entry.is_referenced) {
+                    entry.is_referenced = false;
+                } else {
+                    this->_evict(shard, shard.clock_hand);
+                }
+            }
+            ++shard.clock_hand;
+        }
+
+        size_t slot;
+        if (shard.v_free_slots.empty()) {
+            slot = shard.v_slots.size();
+            shard.v_slots.push_back(CacheEntry());
+        } else {
+            slot = shard.v_free_slots.back();
+            shard.v_free_slots.pop_back();
+        }
+
+        CacheEntry &entry = shard.v_slots[slot];
+        entry.text = text;
+        entry.value = value;
+        entry.bytes = bytes;
+        entry.is_used = true;
+        entry.is_referenced = false;
+        shard.h_hash_to_slot[hash] = slot;
+        shard.used_bytes += bytes;
+    }
+
+    /**
+     * Remove all the entries (the counters are preserved).
+     */
+    void
+    clear() {
+        for (size_t i = 0, i_max = this->v_shards.size(); i < i_max; ++i) {
+            CacheShard &shard = *this->v_shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.h_hash_to_slot.clear();
+            shard.v_slots.clear();
+            shard.v_free_slots.clear();
+            shard.clock_hand = 0;
+            shard.used_bytes = 0;
+        }
+    }
+
+    uint64_t
+    get_num_hits() const {
+        return this->num_hits;
+    }
+
+    uint64_t
+    get_num_misses() const {
+        return this->num_misses;
+    }
+
+    size_t
+    size() const {
+        size_t num_entries = 0;
+        for (size_t i = 0, i_max = this->v_shards.size(); i < i_max; ++i) {
+            CacheShard &shard = *this->v_shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            num_entries += shard.h_hash_to_slot.size();
+        }
+        return num_entries;
+    }
+
+    size_t
+    get_used_bytes() const {
+        size_t used_bytes = 0;
+        for (size_t i = 0, i_max = this->v_shards.size(); i < i_max; ++i) {
+            CacheShard &shard = *this->v_shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            used_bytes += shard.used_bytes;
+        }
+        return used_bytes;
+    }
+
+private:
+    CacheShard &
+    _get_shard(
+            size_t hash
+    ) {
+        // the low bits are used by the hash table of the shard
+        return *this->v_shards[(hash >> 16) % this->v_shards.size()];
+    }
+
+    void
+    _evict(
+            CacheShard &shard,
+            size_t slot
+    ) {
+        CacheEntry &entry = shard.v_slots[slot];
+        shard.h_hash_to_slot.erase(this->text_hash(entry.text));
+        shard.used_bytes -= entry.bytes;
+        entry = CacheEntry();
+        shard.v_free_slots.push_back(slot);
+    }
+};
+
+#endif //RESULTCACHE_HPP
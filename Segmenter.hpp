@@ -0,0 +1,169 @@
+#ifndef SEGMENTER_HPP
+#define SEGMENTER_HPP
+
+#include <algorithm>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "PatternMatcher.hpp"
+
+
+/**
+ * Segmenter of texts into the most valuable non-overlapping multi-word segments. The segments are identified by their
+ * insertion position and each of them has a gain: the selected segments maximize the sum of their gains (the same
+ * dynamic programming of PySegmenter).
+ */
+class Segmenter {
+public:
+    typedef PatternMatcher<uint32_t, DenseKeys> MatcherType;
+
+private:
+    MatcherType matcher;
+    std::vector<uint64_t> v_segment_id_to_gain;
+
+public:
+    /**
+     * Gain used by PySegmenter: length ^ length * phrase frequency, saturated to the maximum value (e.g. from 17 words).
+     */
+    static uint64_t
+    default_gain(
+            uint64_t segment_length,
+            uint64_t phrase_freq
+    ) {
+        uint64_t gain = phrase_freq;
+        for (uint64_t i = 0; i < segment_length && gain != 0; ++i) {
+            if (gain > (uint64_t) -1 / segment_length) {
+                return (uint64_t) -1;
+            }
+            gain *= segment_length;
+        }
+        return gain;
+    }
+
+    /**
+     * Add a segment.
+     * @param segment The words of the segment
+     * @param gain The gain obtained when the segment is selected
+     * @return The identifier of the segment
+     */
+    uint32_t
+    add_segment(
+            const std::string &segment,
+            uint64_t gain
+    ) {
+        const uint32_t segment_id = (uint32_t) this->v_segment_id_to_gain.size();
+        this->matcher.add_pattern(segment_id, segment);
+        this->v_segment_id_to_gain.push_back(gain);
+        return segment_id;
+    }
+
+    void
+    compile() {
+        this->matcher.compile();
+        this->v_segment_id_to_gain.shrink_to_fit();
+    }
+
+    /**
+     * Find the best segmentation of the text.
+     * @param text The text to segment
+     * @param segments_bounds Where to put the pairs [start, end) of word positions of the selected segments, ordered
+     * from left to right
+     */
+    void
+    segment(
+            const std::string &text,
+            std::vector<uint32_t> &segments_bounds
+    ) const {
+        segments_bounds.clear();
+
+        PatternMatches<uint32_t> matches(true);
+        this->matcher.find_patterns(text, matches);
+        const size_t num_matches = matches.size();
+        if (num_matches == 0) {
+            return;
+        }
+
+        std::vector<uint32_t> start_vec(num_matches);
+        std::vector<uint32_t> end_vec(num_matches);
+        std::vector<int64_t> best_back_pos(num_matches);
+        std::vector<uint64_t> best_gain(num_matches);
+        std::vector<int64_t> best_pos(num_matches);
+
+        for (size_t pos = 0; pos < num_matches; ++pos) {
+            end_vec[pos] = (uint32_t) matches[pos].end_pos + 1;
+            start_vec[pos] = end_vec[pos] - this->matcher.get_pattern_length(matches[pos].pattern);
+        }
+
+        // SEGMENTATION using dynamic programming
+        for (size_t pos = 0; pos < num_matches; ++pos) {
+            uint64_t gain = 0;
+            best_back_pos[pos] = -1;
+
+            if (pos > 0) {
+                // check only the segments on the left of this one
+                // stop to go back when the segment is before the previous one (the list is sorted by right position)
+                int64_t prev_pos = (int64_t) pos - 1;
+                while (prev_pos >= 0 && end_vec[prev_pos] > start_vec[pos]) {
+                    --prev_pos;
+                }
+                if (prev_pos >= 0) {
+                    gain = best_gain[prev_pos];
+                    best_back_pos[pos] = best_pos[prev_pos];
+                }
+            }
+
+            // add the gain due to this segment (the sum saturates like the gains)
+            const uint64_t segment_gain = this->v_segment_id_to_gain[matches[pos].pattern];
+            gain = (gain > (uint64_t) -1 - segment_gain) ? (uint64_t) -1 : gain + segment_gain;
+
+            // store the best value and position encountered until now in this position
+            if (pos > 0 && gain <= best_gain[pos - 1]) {
+                best_gain[pos] = best_gain[pos - 1];
+                best_pos[pos] = best_pos[pos - 1];
+            } else {
+                best_gain[pos] = gain;
+                best_pos[pos] = (int64_t) pos;
+            }
+        }
+
+        // get the positions of the selected segments, from right to left
+        for (int64_t pos = best_pos[num_matches - 1]; pos != -1; pos = best_back_pos[pos]) {
+            segments_bounds.push_back(end_vec[pos]);
+            segments_bounds.push_back(start_vec[pos]);
+        }
+        std::reverse(segments_bounds.begin(), segments_bounds.end());
+    }
+
+    const MatcherType &
+    get_matcher() const {
+        return this->matcher;
+    }
+
+    MatcherType &
+    get_matcher() {
+        return this->matcher;
+    }
+
+    uint64_t
+    get_segment_gain(
+            uint32_t segment_id
+    ) const {
+        return this->v_segment_id_to_gain.at(segment_id);
+    }
+
+    size_t
+    size() const {
+        return this->v_segment_id_to_gain.size();
+    }
+
+    void
+    reserve(
+            size_t num_segments
+    ) {
+        this->matcher.reserve(num_segments);
+        this->v_segment_id_to_gain.reserve(num_segments);
+    }
+};
+
+#endif //SEGMENTER_HPP
@@ -0,0 +1,490 @@
+#ifndef SEGMENTERBUILDER_HPP
+#define SEGMENTERBUILDER_HPP
+
+#include <algorithm>
+#include <exception>
+#include <fcntl.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "Segmenter.hpp"
+
+
+/**
+ * Split [0, num_items) into contiguous ranges and call function(begin, end) for each of them in its own thread,
+ * rethrowing the first exception.
+ * @param num_threads The number of threads (0 means one per core)
+ */
+template<typename Function>
+void
+parallel_for_ranges(
+        size_t num_items,
+        size_t num_threads,
+        Function function
+) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::max((size_t) 1, std::min(num_threads, num_items));
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> exceptions(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        const size_t begin = num_items * i / num_threads;
+        const size_t end = num_items * (i + 1) / num_threads;
+        std::exception_ptr *exception = &exceptions[i];
+        threads.push_back(std::thread([&function, begin, end, exception]() {
+            try {
+                function(begin, end);
+            } catch (...) {
+                *exception = std::current_exception();
+            }
+        }));
+    }
+    for (size_t i = 0, i_max = threads.size(); i < i_max; ++i) {
+        threads[i].join();
+    }
+    for (size_t i = 0, i_max = exceptions.size(); i < i_max; ++i) {
+        if (exceptions[i]) {
+            std::rethrow_exception(exceptions[i]);
+        }
+    }
+}
+
+
+/**
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+private:
+    const char *p_data;
+    size_t data_size;
+
+public:
+    MappedFile(const std::string &path) :
+            p_data(nullptr),
+            data_size(0) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open " + path);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            throw std::runtime_error("Unable to read the size of " + path);
+        }
+        this->data_size = (size_t) file_stat.st_size;
+        if (this->data_size > 0) {
+            void *address = mmap(nullptr, this->data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Unable to map " + path);
+            }
+            this->p_data = (const char *) address;
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (this->p_data != nullptr) {
+            munmap((void *) this->p_data, this->data_size);
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *
+    data() const {
+        return this->p_data;
+    }
+
+    size_t
+    size() const {
+        return this->data_size;
+    }
+};
+
+
+/**
+ * Table of the frequencies of the segments (or of their words), with its own copy of the keys.
+ * The keys of an AND-frequency table are stored with their words sorted and joined by a single space, like the
+ * dictionary built by PySegmenter, so that the segments are looked up by the same canonical form.
+ */
+class FrequencyTable {
+private:
+    std::string keys;
+    std::unordered_map<MyString, uint64_t> h_key_to_freq;
+
+public:
+    /**
+     * @param keys The keys, separated by '\n'
+     * @param keys_size The size of the keys in bytes
+     * @param freqs The frequency of each key
+     * @param num_freqs The number of keys
+     * @param sort_words Whether the keys are stored with their words sorted
+     * @param num_threads The threads used to sort the words (0 means one per core)
+     */
+    FrequencyTable(
+            const char *keys,
+            size_t keys_size,
+            const uint64_t *freqs,
+            size_t num_freqs,
+            bool sort_words = false,
+            size_t num_threads = 0
+    ) :
+            keys(keys, keys_size) {
+        std::vector<uint64_t> v_freqs(freqs, freqs + num_freqs);
+        this->_build(v_freqs, sort_words, num_threads);
+    }
+
+    /**
+     * Load the table from a file with a key, a tab and its frequency in each line.
+     */
+    FrequencyTable(
+            const std::string &path,
+            bool sort_words = false,
+            size_t num_threads = 0
+    ) {
+        MappedFile file(path);
+        std::vector<uint64_t> v_freqs;
+        this->keys.reserve(file.size());
+        const char *data = file.data();
+        for (size_t begin = 0, size = file.size(); begin < size;) {
+            const char *line_end = (const char *) memchr(data + begin, '\n', size - begin);
+            const size_t end = (line_end == nullptr) ? size : (size_t) (line_end - data);
+            if (end > begin) {
+                const char *tab = (const char *) memchr(data + begin, '\t', end - begin);
+                if (tab == nullptr) {
+                    throw std::invalid_argument("Missing frequency in " + path + ": " +
+                                                std::string(data + begin, end - begin));
+                }
+                if (!v_freqs.empty()) {
+                    this->keys.push_back('\n');
+                }
+                this->keys.append(data + begin, tab - (data + begin));
+                v_freqs.push_back(strtoull(std::string(tab + 1, data + end).c_str(), nullptr, 10));
+            }
+            begin = end + 1;
+        }
+        this->_build(v_freqs, sort_words, num_threads);
+    }
+
+    FrequencyTable(const FrequencyTable &) = delete;
+
+    FrequencyTable &operator=(const FrequencyTable &) = delete;
+
+    /**
+     * @return Whether the key is in the table
+     */
+    bool
+    find(
+            const MyString &key,
+            uint64_t &freq
+    ) const {
+        auto find_it = this->h_key_to_freq.find(key);
+        if (find_it == this->h_key_to_freq.end()) {
+            return false;
+        }
+        freq = find_it->second;
+        return true;
+    }
+
+    size_t
+    size() const {
+        return this->h_key_to_freq.size();
+    }
+
+    /**
+     * Write into result the words of the segment (split by whitespace) sorted and joined by a single space, or the
+     * segment itself if it does not contain any space (" ".join(sorted(segment.split())) in PySegmenter).
+     */
+    static void
+    sort_words(
+            const char *segment,
+            size_t size,
+            std::vector<MyString> &scratch_words,
+            std::string &result
+    ) {
+        result.clear();
+        if (memchr(segment, ' ', size) == nullptr) {
+            result.assign(segment, size);
+            return;
+        }
+        scratch_words.clear();
+        for (size_t begin = 0; begin < size;) {
+            while (begin < size && FrequencyTable::_is_space(segment[begin])) {
+                ++begin;
+            }
+            size_t end = begin;
+            while (end < size && !FrequencyTable::_is_space(segment[end])) {
+                ++end;
+            }
+            if (end > begin) {
+                scratch_words.push_back(MyString(segment + begin, end - begin));
+            }
+            begin = end;
+        }
+        std::sort(scratch_words.begin(), scratch_words.end(), [](const MyString &a, const MyString &b) {
+            const int comparison = memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+            return comparison < 0 || (comparison == 0 && a.size() < b.size());
+        });
+        for (size_t i = 0, i_max = scratch_words.size(); i < i_max; ++i) {
+            if (i > 0) {
+                result.push_back(' ');
+            }
+            result.append(scratch_words[i].data(), scratch_words[i].size());
+        }
+    }
+
+    /**
+     * @return The number of words of the segment split by whitespace
+     */
+    static size_t
+    count_words(
+            const char *segment,
+            size_t size
+    ) {
+        size_t num_words = 0;
+        for (size_t i = 0; i < size; ++i) {
+            if (!FrequencyTable::_is_space(segment[i]) && (i == 0 || FrequencyTable::_is_space(segment[i - 1]))) {
+                ++num_words;
+            }
+        }
+        return num_words;
+    }
+
+private:
+    static bool
+    _is_space(
+            char c
+    ) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    void
+    _build(
+            const std::vector<uint64_t> &v_freqs,
+            bool sort_words,
+            size_t num_threads
+    ) {
+        // the beginning of each key, plus the end of the last one
+        std::vector<size_t> v_begins;
+        v_begins.reserve(v_freqs.size() + 1);
+        if (!v_freqs.empty()) {
+            v_begins.push_back(0);
+            for (const char *p = this->keys.data(), *p_end = p + this->keys.size();
+                 (p = (const char *) memchr(p, '\n', p_end - p)) != nullptr; ++p) {
+                v_begins.push_back(p - this->keys.data() + 1);
+            }
+        }
+        if (v_begins.size() != v_freqs.size()) {
+            throw std::invalid_argument("The number of keys and frequencies of the table differ");
+        }
+        v_begins.push_back(this->keys.size() + 1);
+
+        // the sorted words are never longer than the key, hence they are written in place
+        std::vector<size_t> v_sizes(v_freqs.size());
+        for (size_t i = 0, i_max = v_sizes.size(); i < i_max; ++i) {
+            v_sizes[i] = v_begins[i + 1] - 1 - v_begins[i];
+        }
+        if (sort_words) {
+            parallel_for_ranges(v_freqs.size(), num_threads, [this, &v_begins, &v_sizes](size_t begin, size_t end) {
+                std::vector<MyString> scratch_words;
+                std::string sorted_key;
+                for (size_t i = begin; i < end; ++i) {
+                    FrequencyTable::sort_words(&this->keys[v_begins[i]], v_sizes[i], scratch_words, sorted_key);
+                    memcpy(&this->keys[v_begins[i]], sorted_key.data(), sorted_key.size());
+                    v_sizes[i] = sorted_key.size();
+                }
+            });
+        }
+
+        // like in a dictionary, the last frequency of a key wins
+        this->h_key_to_freq.reserve(v_freqs.size());
+        for (size_t i = 0, i_max = v_freqs.size(); i < i_max; ++i) {
+            this->h_key_to_freq[MyString(this->keys.data() + v_begins[i], v_sizes[i])] = v_freqs[i];
+        }
+    }
+};
+
+
+/**
+ * Native construction of the segments of PySegmenter from the list of the candidate segments and their frequency
+ * tables. A candidate is kept if it has more than one word (it contains a space) and:
+ *  - phrase_freq >= min_segmentation_freq, and
+ *  - length ^ length * phrase_freq >= and_freq if min_segmentation_probability is -1, where the length is the number of
+ *    spaces plus one (the number of words if the segment contains a double space), or
+ *    phrase_freq >= min_segmentation_probability * max(and_freq, 1) otherwise.
+ * The gain of a kept segment is length ^ length * phrase_freq, with the length in words. The filters run in parallel,
+ * then the kept segments are added to the matcher in their input order, which gives their identifiers.
+ */
+class SegmenterBuilder {
+public:
+    typedef Segmenter::MatcherType MatcherType;
+
+private:
+    double min_segmentation_probability;
+    uint64_t min_segmentation_freq;
+    size_t num_threads;
+
+public:
+    /**
+     * @param min_segmentation_probability The minimum ratio between the phrase and the AND frequency, or -1 to compare
+     * the AND frequency with the gain
+     * @param min_segmentation_freq The minimum phrase frequency
+     * @param num_threads The threads used to filter the segments (0 means one per core)
+     */
+    SegmenterBuilder(double min_segmentation_probability, uint64_t min_segmentation_freq, size_t num_threads = 0) :
+            min_segmentation_probability(min_segmentation_probability),
+            min_segmentation_freq(min_segmentation_freq),
+            num_threads(num_threads) {
+        if (min_segmentation_probability < 0 && min_segmentation_probability != -1) {
+            throw std::invalid_argument("The minimum segmentation probability must be non-negative or -1");
+        }
+    }
+
+    /**
+     * Add the kept segments to the matcher and compile it.
+     * @param segments The candidate segments, separated by '\n'
+     * @param segments_size The size of the segments in bytes
+     * @param phrase_freqs The phrase frequency of each candidate segment
+     * @param and_freqs The AND frequency of each candidate segment, with the words sorted
+     * @param matcher An empty matcher where the segments are added by position
+     * @param v_segment_id_to_gain Where to put the gain of each kept segment
+     * @param v_segment_id_to_length Where to put the length in words of each kept segment
+     */
+    void
+    build(
+            const char *segments,
+            size_t segments_size,
+            const FrequencyTable &phrase_freqs,
+            const FrequencyTable &and_freqs,
+            MatcherType &matcher,
+            std::vector<uint64_t> &v_segment_id_to_gain,
+            std::vector<uint16_t> &v_segment_id_to_length
+    ) const {
+        std::vector<MyString> v_candidates;
+        std::vector<uint64_t> v_candidate_gains;
+        std::vector<uint8_t> v_is_kept;
+        this->_filter(segments, segments_size, phrase_freqs, and_freqs, v_candidates, v_candidate_gains, v_is_kept);
+
+        v_segment_id_to_gain.clear();
+        v_segment_id_to_length.clear();
+        matcher.reserve(v_candidates.size());
+        v_segment_id_to_gain.reserve(v_candidates.size());
+        v_segment_id_to_length.reserve(v_candidates.size());
+        std::string segment;
+        for (size_t i = 0, i_max = v_candidates.size(); i < i_max; ++i) {
+            if (!v_is_kept[i]) {
+                continue;
+            }
+            segment.assign(v_candidates[i].data(), v_candidates[i].size());
+            matcher.add_pattern((uint32_t) v_segment_id_to_gain.size(), segment);
+            v_segment_id_to_gain.push_back(v_candidate_gains[i]);
+            v_segment_id_to_length.push_back(
+                    (uint16_t) FrequencyTable::count_words(v_candidates[i].data(), v_candidates[i].size()));
+        }
+        matcher.compile();
+    }
+
+    /**
+     * Add the kept segments to the segmenter and compile it.
+     */
+    void
+    build(
+            const char *segments,
+            size_t segments_size,
+            const FrequencyTable &phrase_freqs,
+            const FrequencyTable &and_freqs,
+            Segmenter &segmenter
+    ) const {
+        std::vector<MyString> v_candidates;
+        std::vector<uint64_t> v_candidate_gains;
+        std::vector<uint8_t> v_is_kept;
+        this->_filter(segments, segments_size, phrase_freqs, and_freqs, v_candidates, v_candidate_gains, v_is_kept);
+
+        segmenter.reserve(v_candidates.size());
+        for (size_t i = 0, i_max = v_candidates.size(); i < i_max; ++i) {
+            if (v_is_kept[i]) {
+                segmenter.add_segment(std::string(v_candidates[i].data(), v_candidates[i].size()),
+                                      v_candidate_gains[i]);
+            }
+        }
+        segmenter.compile();
+    }
+
+private:
+    /**
+     * Split the candidates and compute in parallel whether each of them is kept, and its gain.
+     */
+    void
+    _filter(
+            const char *segments,
+            size_t segments_size,
+            const FrequencyTable &phrase_freqs,
+            const FrequencyTable &and_freqs,
+            std::vector<MyString> &v_candidates,
+            std::vector<uint64_t> &v_candidate_gains,
+            std::vector<uint8_t> &v_is_kept
+    ) const {
+        for (size_t begin = 0; begin < segments_size;) {
+            const char *line_end = (const char *) memchr(segments + begin, '\n', segments_size - begin);
+            const size_t end = (line_end == nullptr) ? segments_size : (size_t) (line_end - segments);
+            v_candidates.push_back(MyString(segments + begin, end - begin));
+            begin = end + 1;
+        }
+        v_candidate_gains.assign(v_candidates.size(), 0);
+        v_is_kept.assign(v_candidates.size(), 0);
+
+        parallel_for_ranges(v_candidates.size(), this->num_threads, [&](size_t begin, size_t end) {
+            std::vector<MyString> scratch_words;
+            std::string sorted_segment;
+            for (size_t i = begin; i < end; ++i) {
+                const MyString &segment = v_candidates[i];
+                if (memchr(segment.data(), ' ', segment.size()) == nullptr) {
+                    continue;
+                }
+                uint64_t phrase_freq, and_freq;
+                if (!phrase_freqs.find(segment, phrase_freq)) {
+                    throw std::invalid_argument("Missing phrase frequency of the segment " +
+                                                std::string(segment.data(), segment.size()));
+                }
+                FrequencyTable::sort_words(segment.data(), segment.size(), scratch_words, sorted_segment);
+                if (!and_freqs.find(MyString(sorted_segment.data(), sorted_segment.size()), and_freq)) {
+                    throw std::invalid_argument("Missing AND frequency of the segment " +
+                                                std::string(segment.data(), segment.size()));
+                }
+                if (phrase_freq < this->min_segmentation_freq) {
+                    continue;
+                }
+
+                const uint64_t num_words = FrequencyTable::count_words(segment.data(), segment.size());
+                if (this->min_segmentation_probability == -1) {
+                    const bool has_double_space = memmem(segment.data(), segment.size(), "  ", 2) != nullptr;
+                    const uint64_t length = has_double_space ? num_words
+                            : (uint64_t) std::count(segment.data(), segment.data() + segment.size(), ' ') + 1;
+                    if (Segmenter::default_gain(length, phrase_freq) < and_freq) {
+                        continue;
+                    }
+                } else if ((double) phrase_freq <
+                           this->min_segmentation_probability * (double) (and_freq > 0 ? and_freq : 1)) {
+                    continue;
+                }
+                v_candidate_gains[i] = Segmenter::default_gain(num_words, phrase_freq);
+                v_is_kept[i] = 1;
+            }
+        });
+    }
+};
+
+#endif //SEGMENTERBUILDER_HPP
@@ -0,0 +1,1002 @@
+#ifndef SUCCINCTPATTERNMATCHER_HPP
+#define SUCCINCTPATTERNMATCHER_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "PatternMatcher.hpp"
+
+
+/**
+ * Binary serialization of the compiled structures, in the byte order of the machine.
+ */
+namespace succinct_io {
+    template<typename T>
+    void
+    write_value(
+            std::ostream &output,
+            const T &value
+    ) {
+        output.write((const char *) &value, sizeof(T));
+    }
+
+    template<typename T>
+    T
+    read_value(
+            std::istream &input
+    ) {
+        T value;
+        if (!input.read((char *) &value, sizeof(T))) {
+            throw std::runtime_error("Unexpected end of the compiled matcher");
+        }
+        return value;
+    }
+
+    template<typename T>
+    void
+    write_vector(
+            std::ostream &output,
+            const std::vector<T> &values
+    ) {
+        write_value<uint64_t>(output, values.size());
+        if (!values.empty()) {
+            output.write((const char *) &values[0], values.size() * sizeof(T));
+        }
+    }
+
+    template<typename T>
+    void
+    read_vector(
+            std::istream &input,
+            std::vector<T> &values
+    ) {
+        values.resize((size_t) read_value<uint64_t>(input));
+        if (!values.empty() && !input.read((char *) &values[0], values.size() * sizeof(T))) {
+            throw std::runtime_error("Unexpected end of the compiled matcher");
+        }
+    }
+}
+
+
+/**
+ * Array of unsigned integers stored with a fixed number of bits each.
+ */
+class PackedIntArray {
+private:
+    std::vector<uint64_t> v_words;
+    size_t num_values;
+    unsigned width;
+    uint64_t mask;
+
+public:
+    PackedIntArray() :
+            num_values(0),
+            width(0),
+            mask(0) {}
+
+    /**
+     * @param num_values Number of values
+     * @param max_value The largest value that will be stored
+     */
+    PackedIntArray(size_t num_values, uint64_t max_value) :
+            num_values(num_values),
+            width(1) {
+        while (this->width < 64 && (max_value >> this->width) != 0) {
+            ++this->width;
+        }
+        this->mask = (this->width == 64) ? (uint64_t) -1 : ((uint64_t) 1 << this->width) - 1;
+        // one more word, so that get never reads outside the vector
+        this->v_words.resize((num_values * this->width + 63) / 64 + 1, 0);
+    }
+
+    uint64_t
+    get(
+            size_t index
+    ) const {
+        const size_t bit_pos = index * this->width;
+        const size_t word_pos = bit_pos / 64;
+        const unsigned shift = (unsigned) (bit_pos % 64);
+        uint64_t value = this->v_words[word_pos] >> shift;
+        if (shift + this->width > 64) {
+            value |= this->v_words[word_pos + 1] << (64 - shift);
+        }
+        return value & this->mask;
+    }
+
+    void
+    set(
+            size_t index,
+            uint64_t value
+    ) {
+        const size_t bit_pos = index * this->width;
+        const size_t word_pos = bit_pos / 64;
+        const unsigned shift = (unsigned) (bit_pos % 64);
+        value &= this->mask;
+        this->v_words[word_pos] = (this->v_words[word_pos] & ~(this->mask << shift)) | (value << shift);
+        if (shift + this->width > 64) {
+            const unsigned high_bits = shift + this->width - 64;
+            const uint64_t high_mask = ((uint64_t) 1 << high_bits) - 1;
+            this->v_words[word_pos + 1] = (this->v_words[word_pos + 1] & ~high_mask) | (value >> (64 - shift));
+        }
+    }
+
+    size_t
+    size() const {
+        return this->num_values;
+    }
+
+    size_t
+    get_memory_bytes() const {
+        return this->v_words.capacity() * sizeof(uint64_t);
+    }
+
+    void
+    save(
+            std::ostream &output
+    ) const {
+        succinct_io::write_value<uint64_t>(output, this->num_values);
+        succinct_io::write_value<uint32_t>(output, this->width);
+        succinct_io::write_vector(output, this->v_words);
+    }
+
+    void
+    load(
+            std::istream &input
+    ) {
+        this->num_values = (size_t) succinct_io::read_value<uint64_t>(input);
+        this->width = succinct_io::read_value<uint32_t>(input);
+        if (this->width == 0 || this->width > 64) {
+            throw std::runtime_error("Invalid width of a packed array");
+        }
+        this->mask = (this->width == 64) ? (uint64_t) -1 : ((uint64_t) 1 << this->width) - 1;
+        succinct_io::read_vector(input, this->v_words);
+        if (this->v_words.size() != (this->num_values * this->width + 63) / 64 + 1) {
+            throw std::runtime_error("Invalid size of a packed array");
+        }
+    }
+};
+
+
+/**
+ * Append-only bit vector with rank of the ones and select of the zeros. The rank uses the cumulative counts of the
+ * blocks of 512 bits, the select samples the block of every 512th zero (about 14% of space overhead in total).
+ */
+class SuccinctBitVector {
+private:
+    const size_t WORDS_PER_BLOCK = 8;
+    const size_t BITS_PER_BLOCK = 512;
+    const size_t ZEROS_PER_SAMPLE = 512;
+
+    std::vector<uint64_t> v_words;
+    std::vector<uint64_t> v_block_ranks;
+    std::vector<uint32_t> v_zero_samples;
+    size_t num_bits;
+
+public:
+    SuccinctBitVector() :
+            num_bits(0) {}
+
+    void
+    push_back(
+            bool bit
+    ) {
+        if (this->num_bits % 64 == 0) {
+            this->v_words.push_back(0);
+        }
+        if (bit) {
+            this->v_words.back() |= (uint64_t) 1 << (this->num_bits % 64);
+        }
+        ++this->num_bits;
+    }
+
+    /**
+     * Build the rank and select indexes; it must be called after the last push_back.
+     */
+    void
+    build_index() {
+        // pad with a whole block, so that the scans never read outside the words
+        this->v_words.resize((this->v_words.size() / this->WORDS_PER_BLOCK + 1) * this->WORDS_PER_BLOCK, 0);
+        this->v_words.shrink_to_fit();
+        const size_t num_blocks = this->v_words.size() / this->WORDS_PER_BLOCK;
+        this->v_block_ranks.assign(num_blocks + 1, 0);
+        this->v_zero_samples.clear();
+
+        size_t num_zeros = 0;
+        for (size_t block = 0; block < num_blocks; ++block) {
+            size_t block_ones = 0;
+            for (size_t i = 0; i < this->WORDS_PER_BLOCK; ++i) {
+                block_ones += (size_t) __builtin_popcountll(this->v_words[block * this->WORDS_PER_BLOCK + i]);
+            }
+            const size_t block_begin = std::min(this->num_bits, block * this->BITS_PER_BLOCK);
+            const size_t block_bits = std::min(this->BITS_PER_BLOCK, this->num_bits - block_begin);
+            const size_t block_zeros = block_bits - block_ones;
+            // the block of the zeros 1, 513, 1025, ...
+            while (this->v_zero_samples.size() * this->ZEROS_PER_SAMPLE < num_zeros + block_zeros) {
+                this->v_zero_samples.push_back((uint32_t) block);
+            }
+            num_zeros += block_zeros;
+            this->v_block_ranks[block + 1] = this->v_block_ranks[block] + block_ones;
+        }
+        this->v_zero_samples.shrink_to_fit();
+    }
+
+    bool
+    get(
+            size_t pos
+    ) const {
+        return (this->v_words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    /**
+     * @return The number of ones in [0, pos)
+     */
+    size_t
+    rank1(
+            size_t pos
+    ) const {
+        const size_t word_pos = pos / 64;
+        size_t rank = this->v_block_ranks[pos / this->BITS_PER_BLOCK];
+        for (size_t i = (pos / this->BITS_PER_BLOCK) * this->WORDS_PER_BLOCK; i < word_pos; ++i) {
+            rank += (size_t) __builtin_popcountll(this->v_words[i]);
+        }
+        if (pos % 64 != 0) {
+            rank += (size_t) __builtin_popcountll(this->v_words[word_pos] << (64 - pos % 64));
+        }
+        return rank;
+    }
+
+    /**
+     * @param k The rank of the zero, starting from 1
+     * @return The position of the k-th zero
+     */
+    size_t
+    select0(
+            size_t k
+    ) const {
+        // find the block with the sample and then scan the following ones
+        size_t block = this->v_zero_samples[(k - 1) / this->ZEROS_PER_SAMPLE];
+        while ((block + 1) * this->BITS_PER_BLOCK - this->v_block_ranks[block + 1] < k) {
+            ++block;
+        }
+        size_t remaining = k - (block * this->BITS_PER_BLOCK - this->v_block_ranks[block]);
+        size_t word_pos = block * this->WORDS_PER_BLOCK;
+        while (true) {
+            const uint64_t zeros = ~this->v_words[word_pos];
+            const size_t word_zeros = (size_t) __builtin_popcountll(zeros);
+            if (remaining <= word_zeros) {
+                return word_pos * 64 + _select_in_word(zeros, remaining);
+            }
+            remaining -= word_zeros;
+            ++word_pos;
+        }
+    }
+
+    /**
+     * @return The position of the first zero at or after pos
+     */
+    size_t
+    next0(
+            size_t pos
+    ) const {
+        size_t word_pos = pos / 64;
+        uint64_t zeros = ~this->v_words[word_pos] & ((uint64_t) -1 << (pos % 64));
+        while (zeros == 0) {
+            zeros = ~this->v_words[++word_pos];
+        }
+        return word_pos * 64 + (size_t) __builtin_ctzll(zeros);
+    }
+
+    size_t
+    size() const {
+        return this->num_bits;
+    }
+
+    size_t
+    get_memory_bytes() const {
+        return this->v_words.capacity() * sizeof(uint64_t) + this->v_block_ranks.capacity() * sizeof(uint64_t) +
+               this->v_zero_samples.capacity() * sizeof(uint32_t);
+    }
+
+    /**
+     * Write the bits with their indexes, which are not rebuilt by load.
+     */
+    void
+    save(
+            std::ostream &output
+    ) const {
+        succinct_io::write_value<uint64_t>(output, this->num_bits);
+        succinct_io::write_vector(output, this->v_words);
+        succinct_io::write_vector(output, this->v_block_ranks);
+        succinct_io::write_vector(output, this->v_zero_samples);
+    }
+
+    void
+    load(
+            std::istream &input
+    ) {
+        this->num_bits = (size_t) succinct_io::read_value<uint64_t>(input);
+        succinct_io::read_vector(input, this->v_words);
+        succinct_io::read_vector(input, this->v_block_ranks);
+        succinct_io::read_vector(input, this->v_zero_samples);
+        if (this->v_words.size() * 64 < this->num_bits) {
+            throw std::runtime_error("Invalid size of a bit vector");
+        }
+    }
+
+private:
+    static size_t
+    _select_in_word(
+            uint64_t word,
+            size_t k
+    ) {
+        for (size_t i = 1; i < k; ++i) {
+            word &= word - 1;
+        }
+        return (size_t) __builtin_ctzll(word);
+    }
+};
+
+
+/**
+ * Read-only word pattern matcher with a succinct automaton, for the deployments where the memory matters more than
+ * the scan speed. It finds the same matches of PatternMatcher, in the same order.
+ *
+ * After the compilation:
+ *  - the states are numbered in BFS order and the trie is encoded with LOUDS (the degree of each state in unary), so
+ *    that the children of a state are the contiguous range returned by a select on the zeros;
+ *  - the labels of the edges (word identifiers) and the failure links are bit-packed arrays, with the labels of the
+ *    siblings sorted to be binary searched;
+ *  - the states with an output are marked in a bit vector, whose rank gives the position in the bit-packed array of
+ *    their longest pattern; the patterns are linked to their longest suffix pattern, like in AhoCorasickAutomaton;
+ *  - the vocabulary is a single buffer of words with an open-addressing table of word identifiers.
+ * The transitions follow the failure links instead of a precomputed goto table, hence the scan is slower than
+ * PatternMatcher. The compiled matcher can be saved to a file and loaded back, and the dictionaries that do not fit in
+ * memory can be compiled into such a file by ExternalMatcherBuilder.
+ * @tparam KeyType
+ */
+template<typename KeyType>
+class ExternalMatcherBuilder;
+
+
+template<typename KeyType>
+class SuccinctPatternMatcher {
+    template<typename> friend class ExternalMatcherBuilder;
+
+private:
+    const uint64_t FILE_MAGIC = 0x3154434e43435553;  // "SUCCNCT1"
+
+    static const size_t MAX_PATTERN_WORDS = 32;
+
+    bool b_is_compiled;
+    TextNormalizer normalizer;
+    std::string scratch_word;
+
+    // patterns, only until the compilation
+    std::unordered_map<std::string, uint32_t> h_word_to_word_id;
+    std::vector<uint32_t> v_pattern_words;
+    std::vector<size_t> v_pattern_begins;
+    std::vector<KeyType> v_pattern_keys;
+
+    // vocabulary
+    std::string words;
+    PackedIntArray word_begins;
+    std::vector<uint32_t> v_word_slots;
+    size_t word_slots_mask;
+
+    // automaton
+    size_t num_states;
+    size_t num_first_words;
+    SuccinctBitVector louds;
+    PackedIntArray labels;
+    PackedIntArray failure_links;
+    SuccinctBitVector has_output;
+    PackedIntArray output_patterns;
+    PackedIntArray suffix_patterns;
+    PackedIntArray pattern_lengths;
+    std::vector<KeyType> v_pattern_id_to_key;
+    pattern_length_t max_pattern_length;
+
+public:
+    SuccinctPatternMatcher() :
+            b_is_compiled(false),
+            word_slots_mask(0),
+            num_states(0),
+            num_first_words(0),
+            max_pattern_length(0) {
+        this->v_pattern_begins.push_back(0);
+    }
+
+    /**
+     * Set the normalization applied to both the patterns and the texts. It must be set before adding the patterns.
+     */
+    void
+    set_normalizer(
+            const TextNormalizer &normalizer
+    ) {
+        if (!this->v_pattern_keys.empty()) {
+            throw std::runtime_error("The normalizer cannot be changed after adding the patterns");
+        }
+        this->normalizer = normalizer;
+    }
+
+    void
+    add_pattern(
+            KeyType pattern_id,
+            const std::string &pattern
+    ) {
+        if (this->b_is_compiled) {
+            throw std::runtime_error("This method cannot be called after the compilation");
+        }
+        const size_t begin = this->v_pattern_words.size();
+        try {
+            this->normalizer.for_each_word(
+                    pattern.data(), pattern.size(), this->scratch_word,
+                    [this, begin](const MyString &word, size_t, size_t) {
+                        if (this->v_pattern_words.size() - begin == SuccinctPatternMatcher::MAX_PATTERN_WORDS) {
+                            throw std::invalid_argument("The given pattern has too many words");
+                        }
+                        const std::string word_string(word.data(), word.size());
+                        auto find_word_it = this->h_word_to_word_id.find(word_string);
+                        if (find_word_it == this->h_word_to_word_id.end()) {
+                            const uint32_t word_id = (uint32_t) this->h_word_to_word_id.size() + 1;
+                            this->h_word_to_word_id[word_string] = word_id;
+                            this->v_pattern_words.push_back(word_id);
+                        } else {
+                            this->v_pattern_words.push_back(find_word_it->second);
+                        }
+                    });
+        } catch (...) {
+            this->v_pattern_words.resize(begin);
+            throw;
+        }
+        this->v_pattern_begins.push_back(this->v_pattern_words.size());
+        this->v_pattern_keys.push_back(pattern_id);
+    }
+
+    /**
+     * Build the succinct automaton and release the patterns.
+     */
+    void
+    compile() {
+        if (this->b_is_compiled) {
+            return;
+        }
+        this->_renumber_words();
+        this->_compile_vocabulary();
+        this->_compile_automaton();
+        this->b_is_compiled = true;
+    }
+
+    void
+    find_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        if (!this->b_is_compiled) {
+            throw std::runtime_error("The matcher has not been compiled");
+        }
+        if (matches.get_semantics() == MATCH_LEFTMOST_FIRST) {
+            // the patterns are renumbered at compile time, hence their insertion order is not available
+            throw std::invalid_argument("The succinct matcher does not support MATCH_LEFTMOST_FIRST");
+        }
+        if (matches.get_semantics() == MATCH_LEFTMOST_LONGEST) {
+            this->_find_leftmost_longest_patterns(text, matches);
+            return;
+        }
+        size_t state = 0;
+        size_t pos = 0;
+        std::string scratch_word;
+
+        // ring with the begin offsets of the last words, large enough to contain the longest pattern
+        const bool include_spans = matches.include_spans();
+        size_t ring_mask = 0;
+        std::vector<size_t> ring_word_begin;
+        if (include_spans) {
+            size_t ring_size = 1;
+            while (ring_size < this->max_pattern_length) {
+                ring_size <<= 1;
+            }
+            ring_word_begin.resize(ring_size);
+            ring_mask = ring_size - 1;
+        }
+
+        this->normalizer.for_each_word(
+                text.data(), text.size(), scratch_word,
+                [&](const MyString &word, size_t begin_offset, size_t end_offset) {
+                    state = this->_get_next_state(state, this->_find_word_id(word));
+                    if (include_spans) {
+                        ring_word_begin[pos & ring_mask] = begin_offset;
+                    }
+
+                    if (this->has_output.get(state)) {
+                        uint64_t pattern_id = this->output_patterns.get(this->has_output.rank1(state));
+                        do {
+                            matches.push_back(PatternMatch<KeyType>(this->v_pattern_id_to_key[pattern_id], pos));
+                            if (include_spans) {
+                                const size_t length = (size_t) this->pattern_lengths.get(pattern_id);
+                                const size_t begin_match_offset = (length == 0) ? end_offset
+                                        : ring_word_begin[(pos + 1 - length) & ring_mask];
+                                matches.push_span(PatternSpan(begin_match_offset, end_offset));
+                            }
+                            // the suffix links are shifted by one, 0 means no suffix
+                            pattern_id = this->suffix_patterns.get(pattern_id);
+                        } while (matches.include_suffixes() && pattern_id-- != 0);
+                    }
+                    ++pos;
+                });
+    }
+
+    size_t
+    get_num_states() const {
+        return this->num_states;
+    }
+
+    size_t
+    get_num_patterns() const {
+        return this->v_pattern_id_to_key.size();
+    }
+
+    /**
+     * @return The bytes used by the compiled vocabulary and automaton
+     */
+    size_t
+    get_memory_bytes() const {
+        return this->words.capacity() + this->word_begins.get_memory_bytes() +
+               this->v_word_slots.capacity() * sizeof(uint32_t) + this->louds.get_memory_bytes() +
+               this->labels.get_memory_bytes() + this->failure_links.get_memory_bytes() +
+               this->has_output.get_memory_bytes() + this->output_patterns.get_memory_bytes() +
+               this->suffix_patterns.get_memory_bytes() + this->pattern_lengths.get_memory_bytes() +
+               this->v_pattern_id_to_key.capacity() * sizeof(KeyType);
+    }
+
+    /**
+     * Write the compiled matcher (including its normalizer) to a file, in the byte order of this machine.
+     */
+    void
+    save(
+            const std::string &path
+    ) const {
+        static_assert(std::is_trivially_copyable<KeyType>::value, "The keys must be trivially copyable to be saved");
+        if (!this->b_is_compiled) {
+            throw std::runtime_error("The matcher has not been compiled");
+        }
+        std::ofstream output(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!output) {
+            throw std::runtime_error("Unable to create " + path);
+        }
+        succinct_io::write_value<uint64_t>(output, this->FILE_MAGIC);
+        succinct_io::write_value<uint32_t>(output, sizeof(KeyType));
+        this->normalizer.save(output);
+        succinct_io::write_value<uint64_t>(output, this->words.size());
+        output.write(this->words.data(), this->words.size());
+        this->word_begins.save(output);
+        succinct_io::write_vector(output, this->v_word_slots);
+        succinct_io::write_value<uint64_t>(output, this->num_states);
+        succinct_io::write_value<uint64_t>(output, this->num_first_words);
+        this->louds.save(output);
+        this->labels.save(output);
+        this->failure_links.save(output);
+        this->has_output.save(output);
+        this->output_patterns.save(output);
+        this->suffix_patterns.save(output);
+        this->pattern_lengths.save(output);
+        succinct_io::write_vector(output, this->v_pattern_id_to_key);
+        succinct_io::write_value<pattern_length_t>(output, this->max_pattern_length);
+        if (!output.flush()) {
+            throw std::runtime_error("Unable to write " + path);
+        }
+    }
+
+    /**
+     * Replace this matcher with a compiled one written by save.
+     */
+    void
+    load(
+            const std::string &path
+    ) {
+        static_assert(std::is_trivially_copyable<KeyType>::value, "The keys must be trivially copyable to be loaded");
+        std::ifstream input(path.c_str(), std::ios::binary);
+        if (!input) {
+            throw std::runtime_error("Unable to open " + path);
+        }
+        if (succinct_io::read_value<uint64_t>(input) != this->FILE_MAGIC ||
+            succinct_io::read_value<uint32_t>(input) != sizeof(KeyType)) {
+            throw std::runtime_error(path + " does not contain a compiled matcher with these keys");
+        }
+        this->normalizer.load(input);
+        this->words.resize((size_t) succinct_io::read_value<uint64_t>(input));
+        if (!this->words.empty() && !input.read(&this->words[0], this->words.size())) {
+            throw std::runtime_error("Unexpected end of the compiled matcher");
+        }
+        this->word_begins.load(input);
+        succinct_io::read_vector(input, this->v_word_slots);
+        this->word_slots_mask = this->v_word_slots.size() - 1;
+        this->num_states = (size_t) succinct_io::read_value<uint64_t>(input);
+        this->num_first_words = (size_t) succinct_io::read_value<uint64_t>(input);
+        this->louds.load(input);
+        this->labels.load(input);
+        this->failure_links.load(input);
+        this->has_output.load(input);
+        this->output_patterns.load(input);
+        this->suffix_patterns.load(input);
+        this->pattern_lengths.load(input);
+        succinct_io::read_vector(input, this->v_pattern_id_to_key);
+        this->max_pattern_length = succinct_io::read_value<pattern_length_t>(input);
+
+        std::unordered_map<std::string, uint32_t>().swap(this->h_word_to_word_id);
+        std::vector<uint32_t>().swap(this->v_pattern_words);
+        this->v_pattern_begins.assign(1, 0);
+        std::vector<KeyType>().swap(this->v_pattern_keys);
+        this->b_is_compiled = true;
+    }
+
+private:
+    /**
+     * Scan for MATCH_LEFTMOST_LONGEST: the output patterns of each state are passed to the selector (see
+     * LeftmostMatchSelector), which emits them once they cannot be overlapped by a longer one.
+     */
+    void
+    _find_leftmost_longest_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        LeftmostMatchSelector<KeyType> selector(MATCH_LEFTMOST_LONGEST,
+                                                std::max<size_t>(this->max_pattern_length, 1));
+        size_t state = 0;
+        size_t pos = 0;
+        std::string scratch_word;
+
+        size_t ring_size = 1;
+        while (ring_size < this->max_pattern_length) {
+            ring_size <<= 1;
+        }
+        std::vector<size_t> ring_word_begin(ring_size);
+        const size_t ring_mask = ring_size - 1;
+
+        this->normalizer.for_each_word(
+                text.data(), text.size(), scratch_word,
+                [&](const MyString &word, size_t begin_offset, size_t end_offset) {
+                    state = this->_get_next_state(state, this->_find_word_id(word));
+                    ring_word_begin[pos & ring_mask] = begin_offset;
+
+                    if (this->has_output.get(state)) {
+                        uint64_t pattern_id = this->output_patterns.get(this->has_output.rank1(state));
+                        do {
+                            const size_t length = (size_t) this->pattern_lengths.get(pattern_id);
+                            if (length > 0) {
+                                selector.add_candidate(this->v_pattern_id_to_key[pattern_id], pos + 1 - length, pos,
+                                                       0, ring_word_begin[(pos + 1 - length) & ring_mask],
+                                                       end_offset);
+                            }
+                            pattern_id = this->suffix_patterns.get(pattern_id);
+                        } while (pattern_id-- != 0);
+                    }
+                    selector.flush(pos, matches);
+                    ++pos;
+                });
+        selector.finish(matches);
+    }
+
+    /**
+     * Give the identifiers 1..R to the R words that start a pattern: they are the labels of the children of the
+     * initial state, hence the child of the initial state for the word w <= R is the state w.
+     */
+    void
+    _renumber_words() {
+        const size_t num_words = this->h_word_to_word_id.size();
+        std::vector<uint32_t> v_old_to_new(num_words + 1, 0);
+        uint32_t next_word_id = 1;
+        for (size_t i = 0, i_max = this->v_pattern_keys.size(); i < i_max; ++i) {
+            if (this->_get_pattern_size((uint32_t) i) > 0) {
+                uint32_t &new_word_id = v_old_to_new[this->_get_pattern_word((uint32_t) i, 0)];
+                if (new_word_id == 0) {
+                    new_word_id = next_word_id++;
+                }
+            }
+        }
+        this->num_first_words = next_word_id - 1;
+        for (size_t word_id = 1; word_id <= num_words; ++word_id) {
+            if (v_old_to_new[word_id] == 0) {
+                v_old_to_new[word_id] = next_word_id++;
+            }
+        }
+
+        for (size_t i = 0, i_max = this->v_pattern_words.size(); i < i_max; ++i) {
+            this->v_pattern_words[i] = v_old_to_new[this->v_pattern_words[i]];
+        }
+        for (auto it = this->h_word_to_word_id.begin(), it_end = this->h_word_to_word_id.end(); it != it_end; ++it) {
+            it->second = v_old_to_new[it->second];
+        }
+    }
+
+    void
+    _compile_vocabulary() {
+        const size_t num_words = this->h_word_to_word_id.size();
+        std::vector<const std::string *> v_word_id_to_word(num_words + 1, nullptr);
+        size_t total_size = 0;
+        for (auto it = this->h_word_to_word_id.cbegin(), it_end = this->h_word_to_word_id.cend(); it != it_end; ++it) {
+            v_word_id_to_word[it->second] = &it->first;
+            total_size += it->first.size();
+        }
+
+        // the words are concatenated by identifier, the word i is [word_begins[i - 1], word_begins[i])
+        this->words.reserve(total_size);
+        this->word_begins = PackedIntArray(num_words + 1, total_size);
+        for (size_t word_id = 1; word_id <= num_words; ++word_id) {
+            this->words.append(*v_word_id_to_word[word_id]);
+            this->word_begins.set(word_id, this->words.size());
+        }
+
+        // open addressing with linear probing and a load factor below 0.75
+        size_t num_slots = 1;
+        while (num_slots * 3 < (num_words + 1) * 4) {
+            num_slots <<= 1;
+        }
+        this->v_word_slots.assign(num_slots, 0);
+        this->word_slots_mask = num_slots - 1;
+        for (size_t word_id = 1; word_id <= num_words; ++word_id) {
+            const std::string &word = *v_word_id_to_word[word_id];
+            size_t slot = std::hash<MyString>()(MyString(word.data(), word.size())) & this->word_slots_mask;
+            while (this->v_word_slots[slot] != 0) {
+                slot = (slot + 1) & this->word_slots_mask;
+            }
+            this->v_word_slots[slot] = (uint32_t) word_id;
+        }
+
+        std::unordered_map<std::string, uint32_t>().swap(this->h_word_to_word_id);
+    }
+
+    uint32_t
+    _find_word_id(
+            const MyString &word
+    ) const {
+        size_t slot = std::hash<MyString>()(word) & this->word_slots_mask;
+        while (true) {
+            const uint32_t word_id = this->v_word_slots[slot];
+            if (word_id == 0) {
+                return 0;
+            }
+            const size_t begin = (size_t) this->word_begins.get(word_id - 1);
+            const size_t end = (size_t) this->word_begins.get(word_id);
+            if (end - begin == word.size() && memcmp(this->words.data() + begin, word.data(), word.size()) == 0) {
+                return word_id;
+            }
+            slot = (slot + 1) & this->word_slots_mask;
+        }
+    }
+
+    /**
+     * Range of a node of the trie during the construction: the sorted patterns in [begin, end) share the first depth
+     * words.
+     */
+    class BuildNode {
+    public:
+        size_t begin;
+        size_t end;
+        size_t depth;
+
+    public:
+        BuildNode(size_t begin, size_t end, size_t depth) :
+                begin(begin),
+                end(end),
+                depth(depth) {}
+    };
+
+    void
+    _compile_automaton() {
+        const size_t num_patterns = this->v_pattern_keys.size();
+        const size_t num_words = this->word_begins.size() - 1;
+
+        // 1) sort the patterns, so that the children of each node are contiguous ranges ordered by label
+        std::vector<uint32_t> v_order(num_patterns);
+        for (size_t i = 0; i < num_patterns; ++i) {
+            v_order[i] = (uint32_t) i;
+        }
+        const std::vector<uint32_t> &pattern_words = this->v_pattern_words;
+        const std::vector<size_t> &pattern_begins = this->v_pattern_begins;
+        std::sort(v_order.begin(), v_order.end(), [&pattern_words, &pattern_begins](uint32_t a, uint32_t b) {
+            return std::lexicographical_compare(
+                    pattern_words.begin() + pattern_begins[a], pattern_words.begin() + pattern_begins[a + 1],
+                    pattern_words.begin() + pattern_begins[b], pattern_words.begin() + pattern_begins[b + 1]);
+        });
+
+        // 2) visit the trie in BFS order, writing the LOUDS bits and the labels, and numbering the patterns by state
+        std::vector<uint32_t> v_labels;
+        std::vector<uint32_t> v_terminal_patterns;
+        std::vector<size_t> v_terminal_states;
+        std::queue<BuildNode> bfs_queue;
+        bfs_queue.push(BuildNode(0, num_patterns, 0));
+        size_t state = 0;
+        while (!bfs_queue.empty()) {
+            const BuildNode node = bfs_queue.front();
+            bfs_queue.pop();
+
+            size_t child_begin = node.begin;
+            // the pattern that ends in this node is the first one of the range
+            if (child_begin < node.end && this->_get_pattern_size(v_order[child_begin]) == node.depth) {
+                v_terminal_patterns.push_back(v_order[child_begin]);
+                v_terminal_states.push_back(state);
+                ++child_begin;
+                if (child_begin < node.end && this->_get_pattern_size(v_order[child_begin]) == node.depth) {
+                    throw std::invalid_argument("The given pattern was already inside the automaton");
+                }
+            }
+            while (child_begin < node.end) {
+                const uint32_t label = this->_get_pattern_word(v_order[child_begin], node.depth);
+                size_t child_end = child_begin + 1;
+                while (child_end < node.end && this->_get_pattern_word(v_order[child_end], node.depth) == label) {
+                    ++child_end;
+                }
+                this->louds.push_back(true);
+                v_labels.push_back(label);
+                bfs_queue.push(BuildNode(child_begin, child_end, node.depth + 1));
+                child_begin = child_end;
+            }
+            this->louds.push_back(false);
+            ++state;
+        }
+        this->num_states = state;
+        this->louds.build_index();
+        this->labels = PackedIntArray(v_labels.size(), num_words);
+        for (size_t i = 0, i_max = v_labels.size(); i < i_max; ++i) {
+            this->labels.set(i, v_labels[i]);
+        }
+        std::vector<uint32_t>().swap(v_labels);
+
+        // 3) the patterns are numbered in BFS order of their states
+        const size_t num_terminals = v_terminal_patterns.size();
+        PackedIntArray state_to_output(this->num_states, num_terminals);
+        this->v_pattern_id_to_key.resize(num_terminals);
+        this->pattern_lengths = PackedIntArray(num_terminals, MAX_PATTERN_WORDS);
+        for (size_t i = 0; i < num_terminals; ++i) {
+            const size_t pattern_size = this->_get_pattern_size(v_terminal_patterns[i]);
+            this->v_pattern_id_to_key[i] = this->v_pattern_keys[v_terminal_patterns[i]];
+            this->pattern_lengths.set(i, pattern_size);
+            if (pattern_size > this->max_pattern_length) {
+                this->max_pattern_length = (pattern_length_t) pattern_size;
+            }
+            // the outputs are shifted by one, 0 means no output
+            state_to_output.set(v_terminal_states[i], i + 1);
+        }
+
+        // 4) compute the failure links and the outputs in BFS order
+        this->_compile_links(state_to_output, num_terminals);
+
+        // 5) release the patterns
+        std::vector<uint32_t>().swap(this->v_pattern_words);
+        std::vector<size_t>().swap(this->v_pattern_begins);
+        std::vector<KeyType>().swap(this->v_pattern_keys);
+    }
+
+    size_t
+    _get_pattern_size(
+            uint32_t pattern
+    ) const {
+        return this->v_pattern_begins[pattern + 1] - this->v_pattern_begins[pattern];
+    }
+
+    uint32_t
+    _get_pattern_word(
+            uint32_t pattern,
+            size_t pos
+    ) const {
+        return this->v_pattern_words[this->v_pattern_begins[pattern] + pos];
+    }
+
+    /**
+     * Get the children of a state: in LOUDS the state s is described by the bits after its s-th zero, and the child
+     * written in the position p is the state p - s + 1.
+     */
+    void
+    _get_children(
+            size_t state,
+            size_t &first_child,
+            size_t &num_children
+    ) const {
+        const size_t begin = (state == 0) ? 0 : this->louds.select0(state) + 1;
+        num_children = this->louds.next0(begin) - begin;
+        first_child = begin - state + 1;
+    }
+
+    /**
+     * @return The child of the state with the given label, or 0
+     */
+    size_t
+    _find_child(
+            size_t state,
+            uint32_t label
+    ) const {
+        if (state == 0) {
+            return (label <= this->num_first_words) ? label : 0;
+        }
+        size_t first_child, num_children;
+        this->_get_children(state, first_child, num_children);
+        // the labels of the siblings are sorted
+        size_t low = first_child, high = first_child + num_children;
+        while (low < high) {
+            const size_t middle = (low + high) / 2;
+            const uint32_t middle_label = (uint32_t) this->labels.get(middle - 1);
+            if (middle_label == label) {
+                return middle;
+            }
+            if (middle_label < label) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return 0;
+    }
+
+    size_t
+    _get_next_state(
+            size_t state,
+            uint32_t word_id
+    ) const {
+        // the unknown words bring back to the initial state
+        if (word_id == 0) {
+            return 0;
+        }
+        while (true) {
+            const size_t child = this->_find_child(state, word_id);
+            if (child != 0 || state == 0) {
+                return child;
+            }
+            state = (size_t) this->failure_links.get(state);
+        }
+    }
+
+    /**
+     * Compute the failure links, the suffix links of the patterns and the outputs of the states, given the trie and
+     * the output of the states where a pattern ends (shifted by one, 0 means no output). The states are visited in
+     * BFS order, hence the failure links followed by _get_next_state are already computed.
+     */
+    void
+    _compile_links(
+            PackedIntArray &state_to_output,
+            size_t num_terminals
+    ) {
+        this->failure_links = PackedIntArray(this->num_states, this->num_states);
+        this->suffix_patterns = PackedIntArray(num_terminals, num_terminals);
+        for (size_t parent = 0; parent < this->num_states; ++parent) {
+            size_t first_child, num_children;
+            this->_get_children(parent, first_child, num_children);
+            for (size_t child = first_child; child < first_child + num_children; ++child) {
+                size_t failure_link = 0;
+                if (parent != 0) {
+                    failure_link = this->_get_next_state((size_t) this->failure_links.get(parent),
+                                                         (uint32_t) this->labels.get(child - 1));
+                }
+                this->failure_links.set(child, failure_link);
+                if (state_to_output.get(child) != 0) {
+                    this->suffix_patterns.set(state_to_output.get(child) - 1, state_to_output.get(failure_link));
+                } else {
+                    state_to_output.set(child, state_to_output.get(failure_link));
+                }
+            }
+        }
+
+        size_t num_outputs = 0;
+        for (size_t i = 0; i < this->num_states; ++i) {
+            this->has_output.push_back(state_to_output.get(i) != 0);
+            num_outputs += (state_to_output.get(i) != 0) ? 1 : 0;
+        }
+        this->has_output.build_index();
+        this->output_patterns = PackedIntArray(num_outputs, num_terminals);
+        for (size_t i = 0, j = 0; i < this->num_states; ++i) {
+            if (state_to_output.get(i) != 0) {
+                this->output_patterns.set(j++, state_to_output.get(i) - 1);
+            }
+        }
+    }
+};
+
+#endif //SUCCINCTPATTERNMATCHER_HPP
@@ -0,0 +1,396 @@
+#ifndef TEXTNORMALIZER_HPP
+#define TEXTNORMALIZER_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "BufferManager.hpp"
+
+
+/**
+ * Tokenizer that splits a text into words and normalizes them in a single pass over the bytes.
+ * It supports a configurable table of ASCII delimiters, the Unicode whitespaces and punctuation as delimiters, the
+ * ASCII and UTF-8 case folding (Latin-1, Latin Extended-A, Greek and Cyrillic) and the stripping of the accents from
+ * the Latin letters. A normalized word is written into the scratch buffer only when it differs from the input,
+ * otherwise the word points directly into the text.
+ * The default configuration splits on ' ' only and does not change the words.
+ */
+class TextNormalizer {
+private:
+    bool delimiter_table[128];
+    bool b_unicode_whitespace_delimiters;
+    bool b_unicode_punctuation_delimiters;
+    bool b_ascii_case_folding;
+    bool b_utf8_case_folding;
+    bool b_accent_stripping;
+
+public:
+    TextNormalizer() :
+            b_unicode_whitespace_delimiters(false),
+            b_unicode_punctuation_delimiters(false),
+            b_ascii_case_folding(false),
+            b_utf8_case_folding(false),
+            b_accent_stripping(false) {
+        memset(this->delimiter_table, 0, sizeof(this->delimiter_table));
+        this->delimiter_table[(uint8_t) ' '] = true;
+    }
+
+    /**
+     * Set whether an ASCII character is a delimiter.
+     */
+    TextNormalizer &
+    set_delimiter(
+            char delimiter,
+            bool is_delimiter = true
+    ) {
+        if ((uint8_t) delimiter >= 128) {
+            throw std::invalid_argument("Only the ASCII characters can be used as delimiters");
+        }
+        this->delimiter_table[(uint8_t) delimiter] = is_delimiter;
+        return *this;
+    }
+
+    /**
+     * Use all the ASCII whitespaces (' ', '\t', '\n', '\v', '\f', '\r') as delimiters.
+     */
+    TextNormalizer &
+    set_ascii_whitespace_delimiters() {
+        for (const char *c = " \t\n\v\f\r"; *c; ++c) {
+            this->set_delimiter(*c);
+        }
+        return *this;
+    }
+
+    /**
+     * Use all the ASCII punctuation characters as delimiters.
+     */
+    TextNormalizer &
+    set_ascii_punctuation_delimiters() {
+        for (const char *c = "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"; *c; ++c) {
+            this->set_delimiter(*c);
+        }
+        return *this;
+    }
+
+    TextNormalizer &
+    set_unicode_whitespace_delimiters(
+            bool enabled = true
+    ) {
+        this->b_unicode_whitespace_delimiters = enabled;
+        return *this;
+    }
+
+    TextNormalizer &
+    set_unicode_punctuation_delimiters(
+            bool enabled = true
+    ) {
+        this->b_unicode_punctuation_delimiters = enabled;
+        return *this;
+    }
+
+    TextNormalizer &
+    set_ascii_case_folding(
+            bool enabled = true
+    ) {
+        this->b_ascii_case_folding = enabled;
+        return *this;
+    }
+
+    TextNormalizer &
+    set_utf8_case_folding(
+            bool enabled = true
+    ) {
+        this->b_utf8_case_folding = enabled;
+        return *this;
+    }
+
+    TextNormalizer &
+    set_accent_stripping(
+            bool enabled = true
+    ) {
+        this->b_accent_stripping = enabled;
+        return *this;
+    }
+
+    /**
+     * Write the configuration in binary form, see load.
+     */
+    void
+    save(
+            std::ostream &output
+    ) const {
+        const bool flags[5] = {this->b_unicode_whitespace_delimiters, this->b_unicode_punctuation_delimiters,
+                               this->b_ascii_case_folding, this->b_utf8_case_folding, this->b_accent_stripping};
+        char bytes[128 + 5];
+        for (size_t i = 0; i < 128; ++i) {
+            bytes[i] = this->delimiter_table[i] ? 1 : 0;
+        }
+        for (size_t i = 0; i < 5; ++i) {
+            bytes[128 + i] = flags[i] ? 1 : 0;
+        }
+        output.write(bytes, sizeof(bytes));
+    }
+
+    void
+    load(
+            std::istream &input
+    ) {
+        char bytes[128 + 5];
+        if (!input.read(bytes, sizeof(bytes))) {
+            throw std::runtime_error("Unable to read the normalizer configuration");
+        }
+        for (size_t i = 0; i < 128; ++i) {
+            this->delimiter_table[i] = bytes[i] != 0;
+        }
+        this->b_unicode_whitespace_delimiters = bytes[128] != 0;
+        this->b_unicode_punctuation_delimiters = bytes[129] != 0;
+        this->b_ascii_case_folding = bytes[130] != 0;
+        this->b_utf8_case_folding = bytes[131] != 0;
+        this->b_accent_stripping = bytes[132] != 0;
+    }
+
+    /**
+     * Split the text into normalized words, calling callback(word, begin_offset, end_offset) for each of them, where
+     * the offsets refer to the original text. The word is valid only during the call.
+     * @param data The text
+     * @param size The size of the text in bytes
+     * @param scratch The buffer used to store the words changed by the normalization
+     * @param callback The function to call for each word
+     */
+    template<typename Callback>
+    void
+    for_each_word(
+            const char *data,
+            size_t size,
+            std::string &scratch,
+            Callback callback
+    ) const {
+        const uint8_t *bytes = (const uint8_t *) data;
+        const bool check_unicode_delimiters =
+                this->b_unicode_whitespace_delimiters || this->b_unicode_punctuation_delimiters;
+        const bool normalize_utf8 = this->b_utf8_case_folding || this->b_accent_stripping;
+
+        // fast path: the words are never changed, only the ASCII delimiters have to be found
+        if (!check_unicode_delimiters && !normalize_utf8 && !this->b_ascii_case_folding) {
+            for (size_t begin = 0, end = 0; begin < size; begin = end + 1) {
+                end = begin;
+                while (end < size && (bytes[end] >= 128 || !this->delimiter_table[bytes[end]])) {
+                    ++end;
+                }
+                if (begin < end) {
+                    callback(MyString(data + begin, end - begin), begin, end);
+                }
+            }
+            return;
+        }
+
+        bool in_word = false;
+        bool differs = false;
+        size_t word_begin = 0;
+        size_t pos = 0;
+        while (pos < size) {
+            const uint8_t byte = bytes[pos];
+
+            // 1) decode the current character
+            uint32_t code_point = byte;
+            size_t in_length = 1;
+            if (byte >= 0x80 && (check_unicode_delimiters || normalize_utf8)) {
+                in_length = _decode_utf8(bytes, pos, size, code_point);
+            }
+
+            // 2) the delimiters end the current word
+            if ((code_point < 128 && this->delimiter_table[code_point]) ||
+                (in_length > 1 && check_unicode_delimiters && this->_is_unicode_delimiter(code_point))) {
+                if (in_word) {
+                    callback(differs ? MyString(scratch.data(), scratch.size())
+                                     : MyString(data + word_begin, pos - word_begin), word_begin, pos);
+                    in_word = false;
+                }
+                pos += in_length;
+                continue;
+            }
+            if (!in_word) {
+                in_word = true;
+                differs = false;
+                word_begin = pos;
+            }
+
+            // 3) normalize the character
+            uint32_t normalized_code_point = code_point;
+            if (in_length == 2 && normalize_utf8) {
+                normalized_code_point = this->_normalize_code_point(code_point);
+            }
+            if (normalized_code_point < 128 && this->b_ascii_case_folding &&
+                normalized_code_point >= 'A' && normalized_code_point <= 'Z') {
+                normalized_code_point += 'a' - 'A';
+            }
+
+            // 4) copy it into the scratch buffer only if the word differs from the input
+            if (normalized_code_point != code_point) {
+                if (!differs) {
+                    differs = true;
+                    scratch.assign(data + word_begin, pos - word_begin);
+                }
+                _append_utf8(scratch, normalized_code_point);
+            } else if (differs) {
+                scratch.append(data + pos, in_length);
+            }
+            pos += in_length;
+        }
+
+        if (in_word) {
+            callback(differs ? MyString(scratch.data(), scratch.size())
+                             : MyString(data + word_begin, pos - word_begin), word_begin, pos);
+        }
+    }
+
+private:
+    /**
+     * Decode a 2 or 3 bytes UTF-8 sequence; the invalid and longer sequences are consumed one byte at a time.
+     * @return The length of the sequence
+     */
+    static size_t
+    _decode_utf8(
+            const uint8_t *bytes,
+            size_t pos,
+            size_t size,
+            uint32_t &code_point
+    ) {
+        const uint8_t byte = bytes[pos];
+        if ((byte & 0xE0) == 0xC0 && pos + 1 < size && (bytes[pos + 1] & 0xC0) == 0x80) {
+            code_point = ((uint32_t) (byte & 0x1F) << 6) | (bytes[pos + 1] & 0x3F);
+            if (code_point >= 0x80) {
+                return 2;
+            }
+        } else if ((byte & 0xF0) == 0xE0 && pos + 2 < size &&
+                   (bytes[pos + 1] & 0xC0) == 0x80 && (bytes[pos + 2] & 0xC0) == 0x80) {
+            code_point = ((uint32_t) (byte & 0x0F) << 12) | ((uint32_t) (bytes[pos + 1] & 0x3F) << 6) |
+                         (bytes[pos + 2] & 0x3F);
+            if (code_point >= 0x800) {
+                return 3;
+            }
+        }
+        code_point = byte;
+        return 1;
+    }
+
+    static void
+    _append_utf8(
+            std::string &buffer,
+            uint32_t code_point
+    ) {
+        if (code_point < 0x80) {
+            buffer.push_back((char) code_point);
+        } else {
+            buffer.push_back((char) (0xC0 | (code_point >> 6)));
+            buffer.push_back((char) (0x80 | (code_point & 0x3F)));
+        }
+    }
+
+    bool
+    _is_unicode_delimiter(
+            uint32_t code_point
+    ) const {
+        if (this->b_unicode_whitespace_delimiters) {
+            if (code_point == 0x85 || code_point == 0xA0 || code_point == 0x1680 ||
+                (code_point >= 0x2000 && code_point <= 0x200A) || code_point == 0x2028 || code_point == 0x2029 ||
+                code_point == 0x202F || code_point == 0x205F || code_point == 0x3000) {
+                return true;
+            }
+        }
+        if (this->b_unicode_punctuation_delimiters) {
+            if (code_point == 0xA1 || code_point == 0xAB || code_point == 0xB7 || code_point == 0xBB ||
+                code_point == 0xBF || (code_point >= 0x2010 && code_point <= 0x2027) ||
+                (code_point >= 0x2030 && code_point <= 0x205E) || code_point == 0x3001 || code_point == 0x3002) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Case folding and accent stripping of a code point of 2 bytes (U+0080 - U+07FF).
+     */
+    uint32_t
+    _normalize_code_point(
+            uint32_t code_point
+    ) const {
+        if (this->b_utf8_case_folding) {
+            code_point = _fold_case(code_point);
+        }
+        if (this->b_accent_stripping) {
+            // base letters of U+00C0 - U+00FF and U+0100 - U+017F ('.' means no base letter)
+            static const char *latin1_base_letters =
+                    "AAAAAA.CEEEEIIIIDNOOOOO.OUUUUY..aaaaaa.ceeeeiiiidnooooo.ouuuuy.y";
+            static const char *latin_extended_a_base_letters =
+                    "AaAaAaCcCcCcCcDdDdEeEeEeEeEeGgGgGgGgHhHhIiIiIiIiIi..JjKk.LlLlLlLlLlNnNnNn...OoOoOo..RrRrRrSsSsSsSs"
+                    "TtTtTtUuUuUuUuUuUuWwYyYZzZzZzs";
+            char base_letter = '.';
+            if (code_point >= 0xC0 && code_point < 0x100) {
+                base_letter = latin1_base_letters[code_point - 0xC0];
+            } else if (code_point >= 0x100 && code_point < 0x180) {
+                base_letter = latin_extended_a_base_letters[code_point - 0x100];
+            }
+            if (base_letter != '.') {
+                code_point = (uint32_t) base_letter;
+            }
+        }
+        return code_point;
+    }
+
+    static uint32_t
+    _fold_case(
+            uint32_t code_point
+    ) {
+        // Latin-1 Supplement
+        if (code_point >= 0xC0 && code_point <= 0xDE && code_point != 0xD7) {
+            return code_point + 0x20;
+        }
+        // Latin Extended-A
+        if (code_point >= 0x100 && code_point <= 0x17F) {
+            if (code_point == 0x130) {
+                return 'i';
+            }
+            if (code_point == 0x178) {
+                return 0xFF;
+            }
+            if ((code_point <= 0x137 && code_point != 0x131) || (code_point >= 0x14A && code_point <= 0x177)) {
+                return code_point | 1;
+            }
+            if ((code_point >= 0x139 && code_point <= 0x148) || (code_point >= 0x179 && code_point <= 0x17E)) {
+                return (code_point & 1) ? code_point + 1 : code_point;
+            }
+            return code_point;
+        }
+        // Greek
+        if (code_point >= 0x391 && code_point <= 0x3A9 && code_point != 0x3A2) {
+            return code_point + 0x20;
+        }
+        if (code_point == 0x386) {
+            return 0x3AC;
+        }
+        if (code_point >= 0x388 && code_point <= 0x38A) {
+            return code_point + 0x25;
+        }
+        if (code_point == 0x38C) {
+            return 0x3CC;
+        }
+        if (code_point == 0x38E || code_point == 0x38F) {
+            return code_point + 0x3F;
+        }
+        // Cyrillic
+        if (code_point >= 0x400 && code_point <= 0x40F) {
+            return code_point + 0x50;
+        }
+        if (code_point >= 0x410 && code_point <= 0x42F) {
+            return code_point + 0x20;
+        }
+        return code_point;
+    }
+};
+
+#endif //TEXTNORMALIZER_HPP
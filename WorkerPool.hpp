@@ -0,0 +1,139 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Fixed pool of threads used to process the batches of requests in parallel. Every worker belongs to a node (e.g. a
+ * NUMA node) and can run an initialization hook with the index of its node when it starts, e.g. to pin itself.
+ */
+class WorkerPool {
+private:
+    std::vector<std::thread> v_threads;
+    std::queue<std::function<void(size_t)>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool b_is_stopped;
+
+public:
+    /**
+     * @param num_workers Number of workers, all of them on the node 0
+     */
+    WorkerPool(size_t num_workers) :
+            b_is_stopped(false) {
+        this->_start_workers(std::vector<size_t>(std::max<size_t>(num_workers, 1), 0), nullptr);
+    }
+
+    /**
+     * @param worker_node_indexes The node index of each worker
+     * @param worker_init Function called by each worker with its node index before running any task (it can be empty)
+     */
+    WorkerPool(const std::vector<size_t> &worker_node_indexes, const std::function<void(size_t)> &worker_init) :
+            b_is_stopped(false) {
+        this->_start_workers(worker_node_indexes.empty() ? std::vector<size_t>(1, 0) : worker_node_indexes,
+                             worker_init);
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->b_is_stopped = true;
+        }
+        this->condition.notify_all();
+        for (size_t i = 0, i_max = this->v_threads.size(); i < i_max; ++i) {
+            this->v_threads[i].join();
+        }
+    }
+
+    size_t
+    size() const {
+        return this->v_threads.size();
+    }
+
+    /**
+     * Call function(i, node_index) for each i in [0, n) using the workers, and wait for the completion. The indexes
+     * are taken dynamically by the workers, so that the slower ones get less work.
+     */
+    void
+    parallel_for(
+            size_t n,
+            const std::function<void(size_t, size_t)> &function
+    ) {
+        if (n == 0) {
+            return;
+        }
+        const size_t num_tasks = std::min(n, this->v_threads.size());
+        std::atomic<size_t> next_index(0);
+        std::mutex done_mutex;
+        std::condition_variable done_condition;
+        size_t num_done = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            for (size_t task = 0; task < num_tasks; ++task) {
+                this->tasks.push([n, &function, &next_index, &done_mutex, &done_condition, &num_done](size_t node_index) {
+                    for (size_t i = next_index++; i < n; i = next_index++) {
+                        function(i, node_index);
+                    }
+                    std::lock_guard<std::mutex> done_lock(done_mutex);
+                    ++num_done;
+                    done_condition.notify_one();
+                });
+            }
+        }
+        this->condition.notify_all();
+
+        std::unique_lock<std::mutex> done_lock(done_mutex);
+        done_condition.wait(done_lock, [&num_done, num_tasks]() { return num_done == num_tasks; });
+    }
+
+private:
+    void
+    _start_workers(
+            const std::vector<size_t> &worker_node_indexes,
+            const std::function<void(size_t)> &worker_init
+    ) {
+        for (size_t i = 0, i_max = worker_node_indexes.size(); i < i_max; ++i) {
+            const size_t node_index = worker_node_indexes[i];
+            // the hook is copied because the workers can start after the end of the constructor
+            this->v_threads.push_back(std::thread([this, worker_init, node_index]() {
+                if (worker_init) {
+                    worker_init(node_index);
+                }
+                this->_worker_loop(node_index);
+            }));
+        }
+    }
+
+    void
+    _worker_loop(
+            size_t node_index
+    ) {
+        while (true) {
+            std::function<void(size_t)> task;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->condition.wait(lock, [this]() { return this->b_is_stopped || !this->tasks.empty(); });
+                if (this->tasks.empty()) {
+                    return;
+                }
+                task = std::move(this->tasks.front());
+                this->tasks.pop();
+            }
+            task(node_index);
+        }
+    }
+};
+
+#endif //WORKERPOOL_HPP
@@ -0,0 +1,171 @@
+"""
+Python client of the matcher server (matcher_server.cpp), it does not need the compiled extensions.
+
+The protocol is described in MatcherServer.hpp: the single requests travel on the Unix domain socket, while the batches
+are written into two shared-memory rings (mapped from /dev/shm) and the socket only carries the notifications.
+"""
+import mmap
+import os
+import socket
+import struct
+
+OP_FIND_PATTERNS = 1
+OP_FIND_PATTERNS_WITH_SUFFIXES = 2
+OP_SEGMENT = 3
+OP_ATTACH_SHM = 4
+OP_SHM_BATCH = 5
+
+STATUS_OK = 0
+
+_SHM_MAGIC = 0x4d48535245484354
+_SHM_CAPACITY_OFFSET = 8
+_SHM_REQUEST_HEAD_OFFSET = 64
+_SHM_REQUEST_TAIL_OFFSET = 72
+_SHM_RESPONSE_HEAD_OFFSET = 128
+_SHM_RESPONSE_TAIL_OFFSET = 136
+_SHM_HEADER_SIZE = 256
+_RING_WRAP_MARKER = 0xFFFFFFFF
+_RING_ALIGNMENT = 8
+
+
+def _record_size(payload_size):
+    size = 4 + payload_size
+    return (size + _RING_ALIGNMENT - 1) // _RING_ALIGNMENT * _RING_ALIGNMENT
+
+
+def _to_pairs(payload):
+    values = struct.unpack("<%dI" % (len(payload) // 4), payload)
+    return list(zip(values[0::2], values[1::2]))
+
+
+class MatcherClient(object):
+
+    def __init__(self, socket_path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(socket_path)
+        self.shm = None
+        self.shm_path = None
+        self.ring_capacity = 0
+
+    def close(self):
+        if self.shm is not None:
+            self.shm.close()
+            os.unlink(self.shm_path)
+            self.shm = None
+        self.sock.close()
+
+    def find_patterns(self, text, include_suffixes=False):
+        """
+        :return: the list of (pattern, end_pos) pairs
+        """
+        operation = OP_FIND_PATTERNS_WITH_SUFFIXES if include_suffixes else OP_FIND_PATTERNS
+        return _to_pairs(self._call(operation, text))
+
+    def segment(self, text):
+        """
+        :return: the list of (start, end) word positions of the selected segments
+        """
+        return _to_pairs(self._call(OP_SEGMENT, text))
+
+    def attach_shared_memory(self, name, ring_capacity=1 << 24):
+        """
+        Create a shared-memory region (e.g. "/matcher-1234") with two rings of the given size and attach it to the
+        server, so that process_batch can be used.
+        """
+        ring_capacity = (ring_capacity + _RING_ALIGNMENT - 1) // _RING_ALIGNMENT * _RING_ALIGNMENT
+        path = "/dev/shm/" + name.lstrip("/")
+        fd = os.open(path, os.O_CREAT | os.O_EXCL | os.O_RDWR, 0o600)
+        try:
+            os.ftruncate(fd, _SHM_HEADER_SIZE + 2 * ring_capacity)
+            self.shm = mmap.mmap(fd, _SHM_HEADER_SIZE + 2 * ring_capacity)
+        finally:
+            os.close(fd)
+        self.shm_path = path
+        self.ring_capacity = ring_capacity
+        struct.pack_into("<QQ", self.shm, 0, _SHM_MAGIC, ring_capacity)
+
+        self._write_frame(OP_ATTACH_SHM, name.encode("utf-8"))
+        status, _ = self._read_frame()
+        if status != STATUS_OK:
+            raise RuntimeError("The server is unable to attach the shared memory " + name)
+
+    def process_batch(self, operation, texts):
+        """
+        Process a batch of texts through the shared memory (it must fit in the rings).
+        :return: the list of results (lists of pairs), None for the texts that the server was unable to process
+        """
+        if self.shm is None:
+            raise RuntimeError("The shared memory has not been attached")
+        # the client is the only producer of the requests and the only consumer of the responses
+        tail, = struct.unpack_from("<Q", self.shm, _SHM_REQUEST_TAIL_OFFSET)
+        head, = struct.unpack_from("<Q", self.shm, _SHM_REQUEST_HEAD_OFFSET)
+        for text in texts:
+            if not isinstance(text, bytes):
+                text = text.encode("utf-8")
+            size = _record_size(4 + len(text))
+            offset = tail % self.ring_capacity
+            skip = self.ring_capacity - offset if offset + size > self.ring_capacity else 0
+            if size > self.ring_capacity or tail + skip + size - head > self.ring_capacity:
+                raise RuntimeError("The batch does not fit in the shared memory")
+            if skip > 0:
+                struct.pack_into("<I", self.shm, _SHM_HEADER_SIZE + offset, _RING_WRAP_MARKER)
+                tail += skip
+                offset = 0
+            start = _SHM_HEADER_SIZE + offset
+            struct.pack_into("<II", self.shm, start, 4 + len(text), operation)
+            self.shm[start + 8:start + 8 + len(text)] = text
+            tail += size
+        struct.pack_into("<Q", self.shm, _SHM_REQUEST_TAIL_OFFSET, tail)
+
+        self._write_frame(OP_SHM_BATCH, struct.pack("<I", len(texts)))
+        status, payload = self._read_frame()
+        if len(payload) != 4:
+            raise RuntimeError("Invalid response of the server")
+        num_responses, = struct.unpack("<I", payload)
+
+        # the responses written are consumed even on errors, so that the ring stays aligned with the next batches
+        results = []
+        position, = struct.unpack_from("<Q", self.shm, _SHM_RESPONSE_HEAD_OFFSET)
+        data_offset = _SHM_HEADER_SIZE + self.ring_capacity
+        for _ in range(min(num_responses, len(texts))):
+            offset = position % self.ring_capacity
+            size, = struct.unpack_from("<I", self.shm, data_offset + offset)
+            if size == _RING_WRAP_MARKER:
+                position += self.ring_capacity - offset
+                offset = 0
+                size, = struct.unpack_from("<I", self.shm, data_offset)
+            start = data_offset + offset
+            result_status, = struct.unpack_from("<I", self.shm, start + 4)
+            payload = self.shm[start + 8:start + 4 + size]
+            results.append(_to_pairs(payload) if result_status == STATUS_OK else None)
+            position += _record_size(size)
+        struct.pack_into("<Q", self.shm, _SHM_RESPONSE_HEAD_OFFSET, position)
+        if status != STATUS_OK or num_responses != len(texts):
+            raise RuntimeError("The server is unable to process the batch")
+        return results
+
+    def _call(self, operation, text):
+        if not isinstance(text, bytes):
+            text = text.encode("utf-8")
+        self._write_frame(operation, text)
+        status, payload = self._read_frame()
+        if status != STATUS_OK:
+            raise RuntimeError("The server is unable to process the request")
+        return payload
+
+    def _write_frame(self, code, payload):
+        self.sock.sendall(struct.pack("<II", code, len(payload)) + payload)
+
+    def _read_exactly(self, size):
+        chunks = []
+        while size > 0:
+            chunk = self.sock.recv(size)
+            if not chunk:
+                raise RuntimeError("The connection has been closed by the server")
+            chunks.append(chunk)
+            size -= len(chunk)
+        return b"".join(chunks)
+
+    def _read_frame(self):
+        code, size = struct.unpack("<II", self._read_exactly(8))
+        return code, self._read_exactly(size) if size > 0 else b""
@@ -0,0 +1,591 @@
+/**
+ * Generator of specialized matchers for small fixed pattern sets (stop-phrases, keywords, up to a few thousands of
+ * patterns): it compiles the word automaton of the patterns into a C++ header with a class that has the same
+ * find_patterns of PatternMatcher and finds the same matches, but without any hash table or goto table:
+ *  - the words are recognized by nested switches on their length and bytes, with a memcmp of the unique suffixes;
+ *  - each state of the automaton is a switch on the word identifier, whose default jumps to its failure state;
+ *  - the matches of each state (the pattern and its suffixes) are precomputed in constant arrays.
+ * The key of a pattern is its position in the patterns file (the empty lines are skipped).
+ *
+ * Build:    g++ -std=c++11 -O3 matcher_codegen.cpp -o matcher_codegen
+ * Generate: matcher_codegen --patterns FILE --class NAME [--output PATH] [--key-type TYPE] [--delimiters CHARS]
+ *                           [--ascii-whitespace] [--ascii-punctuation] [--unicode-whitespace] [--unicode-punctuation]
+ *                           [--ascii-case-folding] [--utf8-case-folding] [--accent-stripping]
+ *
+ * The generated header includes AhoCorasickAutomaton.hpp and TextNormalizer.hpp, hence it is compiled with this
+ * directory in the include path. A build that owns a static dictionary regenerates the header when the patterns change,
+ * e.g. with a make rule:
+ *     StopPhrasesMatcher.hpp: stop_phrases.txt matcher_codegen
+ *             ./matcher_codegen --patterns $< --class StopPhrasesMatcher --output $@
+ */
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TextNormalizer.hpp"
+
+
+// the generated switches grow with the patterns, beyond this size PatternMatcher is the better choice
+static const size_t MAX_STATES = 1 << 16;
+
+
+struct Options {
+    std::string patterns_path;
+    std::string class_name;
+    std::string output_path;
+    std::string key_type;
+    std::string delimiters;
+    bool b_ascii_whitespace;
+    bool b_ascii_punctuation;
+    bool b_unicode_whitespace;
+    bool b_unicode_punctuation;
+    bool b_ascii_case_folding;
+    bool b_utf8_case_folding;
+    bool b_accent_stripping;
+
+    Options() :
+            key_type("uint32_t"),
+            delimiters(" "),
+            b_ascii_whitespace(false),
+            b_ascii_punctuation(false),
+            b_unicode_whitespace(false),
+            b_unicode_punctuation(false),
+            b_ascii_case_folding(false),
+            b_utf8_case_folding(false),
+            b_accent_stripping(false) {}
+};
+
+
+/**
+ * Word automaton of the patterns: the trie, the failure links and the matches of each state.
+ */
+struct Automaton {
+    std::vector<std::string> v_word_id_to_word;
+    std::vector<std::map<uint32_t, uint32_t>> v_state_to_children;
+    std::vector<uint32_t> v_state_to_fail;
+    // the pattern of each state (-1 if none) and its longest suffix pattern
+    std::vector<int64_t> v_state_to_pattern;
+    std::vector<int64_t> v_pattern_to_suffix;
+    std::vector<size_t> v_pattern_to_length;
+    size_t max_pattern_length;
+
+    Automaton() :
+            v_word_id_to_word(1),
+            v_state_to_children(1),
+            v_state_to_fail(1, 0),
+            v_state_to_pattern(1, -1),
+            max_pattern_length(0) {}
+};
+
+
+static void
+usage() {
+    std::cerr << "Usage: matcher_codegen --patterns FILE --class NAME [--output PATH] [--key-type TYPE]" << std::endl
+              << "                       [--delimiters CHARS] [--ascii-whitespace] [--ascii-punctuation]" << std::endl
+              << "                       [--unicode-whitespace] [--unicode-punctuation] [--ascii-case-folding]"
+              << std::endl
+              << "                       [--utf8-case-folding] [--accent-stripping]" << std::endl;
+    exit(2);
+}
+
+static Options
+parse_options(
+        int argc,
+        char **argv
+) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (argument == "--patterns" && has_value) {
+            options.patterns_path = argv[++i];
+        } else if (argument == "--class" && has_value) {
+            options.class_name = argv[++i];
+        } else if (argument == "--output" && has_value) {
+            options.output_path = argv[++i];
+        } else if (argument == "--key-type" && has_value) {
+            options.key_type = argv[++i];
+        } else if (argument == "--delimiters" && has_value) {
+            options.delimiters = argv[++i];
+        } else if (argument == "--ascii-whitespace") {
+            options.b_ascii_whitespace = true;
+        } else if (argument == "--ascii-punctuation") {
+            options.b_ascii_punctuation = true;
+        } else if (argument == "--unicode-whitespace") {
+            options.b_unicode_whitespace = true;
+        } else if (argument == "--unicode-punctuation") {
+            options.b_unicode_punctuation = true;
+        } else if (argument == "--ascii-case-folding") {
+            options.b_ascii_case_folding = true;
+        } else if (argument == "--utf8-case-folding") {
+            options.b_utf8_case_folding = true;
+        } else if (argument == "--accent-stripping") {
+            options.b_accent_stripping = true;
+        } else {
+            usage();
+        }
+    }
+    if (options.patterns_path.empty() || options.class_name.empty()) {
+        usage();
+    }
+    return options;
+}
+
+static TextNormalizer
+make_normalizer(
+        const Options &options
+) {
+    TextNormalizer normalizer;
+    normalizer.set_delimiter(' ', false);
+    for (size_t i = 0, i_max = options.delimiters.size(); i < i_max; ++i) {
+        normalizer.set_delimiter(options.delimiters[i]);
+    }
+    if (options.b_ascii_whitespace) {
+        normalizer.set_ascii_whitespace_delimiters();
+    }
+    if (options.b_ascii_punctuation) {
+        normalizer.set_ascii_punctuation_delimiters();
+    }
+    normalizer.set_unicode_whitespace_delimiters(options.b_unicode_whitespace);
+    normalizer.set_unicode_punctuation_delimiters(options.b_unicode_punctuation);
+    normalizer.set_ascii_case_folding(options.b_ascii_case_folding);
+    normalizer.set_utf8_case_folding(options.b_utf8_case_folding);
+    normalizer.set_accent_stripping(options.b_accent_stripping);
+    return normalizer;
+}
+
+/**
+ * Insert the patterns into the trie, then compute the failure links and the suffix patterns in BFS order, like
+ * AhoCorasickAutomaton::compile.
+ */
+static void
+build_automaton(
+        const std::string &patterns_path,
+        const TextNormalizer &normalizer,
+        Automaton &automaton
+) {
+    std::ifstream input(patterns_path.c_str());
+    if (!input) {
+        throw std::runtime_error("Unable to open " + patterns_path);
+    }
+    std::unordered_map<std::string, uint32_t> h_word_to_word_id;
+    std::string line, scratch_word;
+    while (std::getline(input, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        uint32_t state = 0;
+        size_t length = 0;
+        normalizer.for_each_word(
+                line.data(), line.size(), scratch_word,
+                [&](const MyString &word, size_t, size_t) {
+                    const std::string word_string(word.data(), word.size());
+                    auto find_word_it = h_word_to_word_id.find(word_string);
+                    uint32_t word_id;
+                    if (find_word_it == h_word_to_word_id.end()) {
+                        word_id = (uint32_t) automaton.v_word_id_to_word.size();
+                        h_word_to_word_id[word_string] = word_id;
+                        automaton.v_word_id_to_word.push_back(word_string);
+                    } else {
+                        word_id = find_word_it->second;
+                    }
+                    auto find_child_it = automaton.v_state_to_children[state].find(word_id);
+                    if (find_child_it == automaton.v_state_to_children[state].end()) {
+                        const uint32_t child = (uint32_t) automaton.v_state_to_children.size();
+                        if (child == MAX_STATES) {
+                            throw std::invalid_argument("Too many patterns for a generated matcher");
+                        }
+                        automaton.v_state_to_children[state][word_id] = child;
+                        automaton.v_state_to_children.push_back(std::map<uint32_t, uint32_t>());
+                        automaton.v_state_to_fail.push_back(0);
+                        automaton.v_state_to_pattern.push_back(-1);
+                        state = child;
+                    } else {
+                        state = find_child_it->second;
+                    }
+                    ++length;
+                });
+        if (length == 0) {
+            throw std::invalid_argument("The pattern has no words: " + line);
+        }
+        if (automaton.v_state_to_pattern[state] != -1) {
+            throw std::invalid_argument("The given pattern was already inside the automaton: " + line);
+        }
+        automaton.v_state_to_pattern[state] = (int64_t) automaton.v_pattern_to_length.size();
+        automaton.v_pattern_to_length.push_back(length);
+        automaton.v_pattern_to_suffix.push_back(-1);
+        automaton.max_pattern_length = std::max(automaton.max_pattern_length, length);
+    }
+
+    std::queue<uint32_t> bfs_queue;
+    bfs_queue.push(0);
+    while (!bfs_queue.empty()) {
+        const uint32_t state = bfs_queue.front();
+        bfs_queue.pop();
+        const std::map<uint32_t, uint32_t> &children = automaton.v_state_to_children[state];
+        for (auto it = children.cbegin(), it_end = children.cend(); it != it_end; ++it) {
+            const uint32_t child = it->second;
+            uint32_t fail = 0;
+            if (state != 0) {
+                for (uint32_t fail_state = automaton.v_state_to_fail[state];; fail_state = automaton.v_state_to_fail[fail_state]) {
+                    auto find_it = automaton.v_state_to_children[fail_state].find(it->first);
+                    if (find_it != automaton.v_state_to_children[fail_state].end()) {
+                        fail = find_it->second;
+                        break;
+                    }
+                    if (fail_state == 0) {
+                        break;
+                    }
+                }
+            }
+            automaton.v_state_to_fail[child] = fail;
+            // a state without its own pattern outputs the longest suffix pattern
+            const int64_t fail_pattern = automaton.v_state_to_pattern[fail];
+            if (automaton.v_state_to_pattern[child] != -1) {
+                automaton.v_pattern_to_suffix[automaton.v_state_to_pattern[child]] = fail_pattern;
+            } else {
+                automaton.v_state_to_pattern[child] = fail_pattern;
+            }
+            bfs_queue.push(child);
+        }
+    }
+}
+
+/**
+ * @return The bytes as a C string literal, with octal escapes for the non printable characters
+ */
+static std::string
+to_literal(
+        const std::string &bytes
+) {
+    std::string literal = "\"";
+    for (size_t i = 0, i_max = bytes.size(); i < i_max; ++i) {
+        const unsigned char c = (unsigned char) bytes[i];
+        if (c == '"' || c == '\\' || c == '?') {
+            literal += '\\';
+            literal += (char) c;
+        } else if (c >= 32 && c < 127) {
+            literal += (char) c;
+        } else {
+            char escape[5];
+            snprintf(escape, sizeof(escape), "\\%03o", c);
+            literal += escape;
+        }
+    }
+    return literal + "\"";
+}
+
+/**
+ * Write the switches that recognize a group of words of the same length, from the byte in position depth.
+ */
+static void
+generate_word_switch(
+        std::ostream &output,
+        const Automaton &automaton,
+        const std::vector<uint32_t> &word_ids,
+        size_t depth,
+        const std::string &indent
+) {
+    if (word_ids.size() == 1) {
+        const std::string &word = automaton.v_word_id_to_word[word_ids[0]];
+        if (depth == word.size()) {
+            output << indent << "return " << word_ids[0] << ";\n";
+        } else {
+            output << indent << "return memcmp(data + " << depth << ", " << to_literal(word.substr(depth)) << ", "
+                   << word.size() - depth << ") == 0 ? " << word_ids[0] << " : 0;\n";
+        }
+        return;
+    }
+    std::map<unsigned char, std::vector<uint32_t>> groups;
+    for (size_t i = 0, i_max = word_ids.size(); i < i_max; ++i) {
+        groups[(unsigned char) automaton.v_word_id_to_word[word_ids[i]][depth]].push_back(word_ids[i]);
+    }
+    output << indent << "switch ((uint8_t) data[" << depth << "]) {\n";
+    for (auto it = groups.cbegin(), it_end = groups.cend(); it != it_end; ++it) {
+        output << indent << "    case " << (unsigned) it->first << ": {\n";
+        generate_word_switch(output, automaton, it->second, depth + 1, indent + "        ");
+        output << indent << "    }\n";
+    }
+    output << indent << "    default:\n"
+           << indent << "        return 0;\n"
+           << indent << "}\n";
+}
+
+static void
+generate_header(
+        std::ostream &output,
+        const Options &options,
+        const Automaton &automaton
+) {
+    const std::string &name = options.class_name;
+    std::string guard = name + "_HPP";
+    std::transform(guard.begin(), guard.end(), guard.begin(), ::toupper);
+    const size_t num_states = automaton.v_state_to_children.size();
+    const size_t num_patterns = automaton.v_pattern_to_length.size();
+    size_t ring_size = 1;
+    while (ring_size < automaton.max_pattern_length) {
+        ring_size <<= 1;
+    }
+
+    output << std::boolalpha
+           << "// Generated by matcher_codegen from " << options.patterns_path << ", do not edit.\n"
+           << "#ifndef " << guard << "\n"
+           << "#define " << guard << "\n\n"
+           << "#include <stdint.h>\n"
+           << "#include <string.h>\n"
+           << "#include <string>\n\n"
+           << "#include \"AhoCorasickAutomaton.hpp\"\n"
+           << "#include \"TextNormalizer.hpp\"\n\n\n"
+           << "/**\n"
+           << " * Matcher of the " << num_patterns << " fixed patterns of " << options.patterns_path
+           << ", with the same matches of\n"
+           << " * PatternMatcher; the key of a pattern is its position in the file.\n"
+           << " */\n"
+           << "class " << name << " {\n"
+           << "public:\n"
+           << "    typedef " << options.key_type << " KeyType;\n\n"
+           << "private:\n"
+           << "    TextNormalizer normalizer;\n\n"
+           << "public:\n"
+           << "    " << name << "() {\n"
+           << "        this->normalizer.set_delimiter(' ', false);\n";
+    for (size_t i = 0, i_max = options.delimiters.size(); i < i_max; ++i) {
+        output << "        this->normalizer.set_delimiter((char) " << (int) options.delimiters[i] << ");\n";
+    }
+    if (options.b_ascii_whitespace) {
+        output << "        this->normalizer.set_ascii_whitespace_delimiters();\n";
+    }
+    if (options.b_ascii_punctuation) {
+        output << "        this->normalizer.set_ascii_punctuation_delimiters();\n";
+    }
+    output << "        this->normalizer.set_unicode_whitespace_delimiters(" << options.b_unicode_whitespace << ");\n"
+           << "        this->normalizer.set_unicode_punctuation_delimiters(" << options.b_unicode_punctuation << ");\n"
+           << "        this->normalizer.set_ascii_case_folding(" << options.b_ascii_case_folding << ");\n"
+           << "        this->normalizer.set_utf8_case_folding(" << options.b_utf8_case_folding << ");\n"
+           << "        this->normalizer.set_accent_stripping(" << options.b_accent_stripping << ");\n"
+           << "    }\n\n";
+
+    // find_patterns, with the same semantics of PatternMatcher
+    output << "    void\n"
+           << "    find_patterns(\n"
+           << "            const std::string &text,\n"
+           << "            PatternMatches<KeyType> &matches\n"
+           << "    ) const {\n"
+           << "        const bool include_spans = matches.include_spans();\n"
+           << "        const bool include_suffixes = matches.include_suffixes();\n"
+           << "        size_t ring_word_begin[" << ring_size << "];\n"
+           << "        uint32_t state = 0;\n"
+           << "        size_t pos = 0;\n"
+           << "        std::string scratch_word;\n\n"
+           << "        if (matches.get_semantics() != MATCH_ALL) {\n"
+           << "            LeftmostMatchSelector<KeyType> selector(matches.get_semantics(), "
+           << std::max((size_t) 1, automaton.max_pattern_length) << ");\n"
+           << "            this->normalizer.for_each_word(\n"
+           << "                    text.data(), text.size(), scratch_word,\n"
+           << "                    [&](const MyString &word, size_t begin_offset, size_t end_offset) {\n"
+           << "                        state = _get_next_state(state, _find_word_id(word.data(), word.size()));\n"
+           << "                        ring_word_begin[pos & " << ring_size - 1 << "] = begin_offset;\n"
+           << "                        const uint32_t *output, *output_end;\n"
+           << "                        _get_outputs(state, output, output_end);\n"
+           << "                        for (; output != output_end; ++output) {\n"
+           << "                            const size_t length = _get_length(*output);\n"
+           << "                            selector.add_candidate((KeyType) *output, pos + 1 - length, pos, *output,\n"
+           << "                                                   ring_word_begin[(pos + 1 - length) & "
+           << ring_size - 1 << "], end_offset);\n"
+           << "                        }\n"
+           << "                        selector.flush(pos, matches);\n"
+           << "                        ++pos;\n"
+           << "                    });\n"
+           << "            selector.finish(matches);\n"
+           << "            return;\n"
+           << "        }\n\n"
+           << "        this->normalizer.for_each_word(\n"
+           << "                text.data(), text.size(), scratch_word,\n"
+           << "                [&](const MyString &word, size_t begin_offset, size_t end_offset) {\n"
+           << "                    state = _get_next_state(state, _find_word_id(word.data(), word.size()));\n"
+           << "                    ring_word_begin[pos & " << ring_size - 1 << "] = begin_offset;\n"
+           << "                    const uint32_t *output, *output_end;\n"
+           << "                    _get_outputs(state, output, output_end);\n"
+           << "                    if (output != output_end) {\n"
+           << "                        do {\n"
+           << "                            matches.push_back(PatternMatch<KeyType>((KeyType) *output, pos));\n"
+           << "                            if (include_spans) {\n"
+           << "                                const size_t length = _get_length(*output);\n"
+           << "                                matches.push_span(PatternSpan(\n"
+           << "                                        ring_word_begin[(pos + 1 - length) & " << ring_size - 1
+           << "], end_offset));\n"
+           << "                            }\n"
+           << "                        } while (include_suffixes && ++output != output_end);\n"
+           << "                    }\n"
+           << "                    ++pos;\n"
+           << "                });\n"
+           << "    }\n\n"
+           << "    size_t\n"
+           << "    get_num_patterns() const {\n"
+           << "        return " << num_patterns << ";\n"
+           << "    }\n\n"
+           << "    size_t\n"
+           << "    get_num_states() const {\n"
+           << "        return " << num_states << ";\n"
+           << "    }\n\n"
+           << "    pattern_length_t\n"
+           << "    get_pattern_length(\n"
+           << "            KeyType pattern_id\n"
+           << "    ) const {\n"
+           << "        if ((size_t) pattern_id >= " << num_patterns << ") {\n"
+           << "            throw std::runtime_error(\"The given pattern has not been found\");\n"
+           << "        }\n"
+           << "        return (pattern_length_t) _get_length((uint32_t) pattern_id);\n"
+           << "    }\n\n"
+           << "private:\n";
+
+    // word recognizer
+    std::map<size_t, std::vector<uint32_t>> words_by_size;
+    for (size_t word_id = 1, i_max = automaton.v_word_id_to_word.size(); word_id < i_max; ++word_id) {
+        words_by_size[automaton.v_word_id_to_word[word_id].size()].push_back((uint32_t) word_id);
+    }
+    output << "    /**\n"
+           << "     * @return The identifier of the word, 0 if it is not in the patterns\n"
+           << "     */\n"
+           << "    static uint32_t\n"
+           << "    _find_word_id(\n"
+           << "            const char *data,\n"
+           << "            size_t size\n"
+           << "    ) {\n"
+           << "        switch (size) {\n";
+    for (auto it = words_by_size.cbegin(), it_end = words_by_size.cend(); it != it_end; ++it) {
+        output << "            case " << it->first << ": {\n";
+        generate_word_switch(output, automaton, it->second, 0, "                ");
+        output << "            }\n";
+    }
+    output << "            default:\n"
+           << "                return 0;\n"
+           << "        }\n"
+           << "    }\n\n";
+
+    // transitions: the default of a state jumps to its failure state
+    output << "    /**\n"
+           << "     * @return The next state, following the failure links until the word is found\n"
+           << "     */\n"
+           << "    static uint32_t\n"
+           << "    _get_next_state(\n"
+           << "            uint32_t state,\n"
+           << "            uint32_t word_id\n"
+           << "    ) {\n"
+           << "        if (word_id == 0) {\n"
+           << "            return 0;\n"
+           << "        }\n"
+           << "        switch (state) {\n";
+    for (size_t state = 0; state < num_states; ++state) {
+        output << "            case " << state << ": goto state_" << state << ";\n";
+    }
+    output << "            default: return 0;\n"
+           << "        }\n";
+    for (size_t state = 0; state < num_states; ++state) {
+        const std::map<uint32_t, uint32_t> &children = automaton.v_state_to_children[state];
+        const std::string fallback = (state == 0) ? "return 0;"
+                                                  : "goto state_" + std::to_string(automaton.v_state_to_fail[state]) + ";";
+        output << "        state_" << state << ":\n";
+        if (children.empty()) {
+            output << "        " << fallback << "\n";
+            continue;
+        }
+        output << "        switch (word_id) {\n";
+        for (auto it = children.cbegin(), it_end = children.cend(); it != it_end; ++it) {
+            output << "            case " << it->first << ": return " << it->second << ";\n";
+        }
+        output << "            default: " << fallback << "\n"
+               << "        }\n";
+    }
+    output << "    }\n\n";
+
+    // matches of each state: its pattern followed by the suffixes
+    std::vector<size_t> v_output_begins(1, 0);
+    std::vector<int64_t> v_outputs;
+    for (size_t state = 0; state < num_states; ++state) {
+        for (int64_t pattern = automaton.v_state_to_pattern[state]; pattern != -1;
+             pattern = automaton.v_pattern_to_suffix[pattern]) {
+            v_outputs.push_back(pattern);
+        }
+        v_output_begins.push_back(v_outputs.size());
+    }
+    output << "    static void\n"
+           << "    _get_outputs(\n"
+           << "            uint32_t state,\n"
+           << "            const uint32_t *&output,\n"
+           << "            const uint32_t *&output_end\n"
+           << "    ) {\n"
+           << "        static const uint32_t output_begins[" << num_states + 1 << "] = {";
+    for (size_t i = 0; i <= num_states; ++i) {
+        output << (i % 16 == 0 ? "\n                " : " ") << v_output_begins[i] << (i < num_states ? "," : "");
+    }
+    output << "\n        };\n"
+           << "        static const uint32_t outputs[" << std::max((size_t) 1, v_outputs.size()) << "] = {";
+    for (size_t i = 0, i_max = v_outputs.size(); i < i_max; ++i) {
+        output << (i % 16 == 0 ? "\n                " : " ") << v_outputs[i] << (i + 1 < i_max ? "," : "");
+    }
+    output << "\n        };\n"
+           << "        output = outputs + output_begins[state];\n"
+           << "        output_end = outputs + output_begins[state + 1];\n"
+           << "    }\n\n"
+           << "    static size_t\n"
+           << "    _get_length(\n"
+           << "            uint32_t pattern\n"
+           << "    ) {\n"
+           << "        static const uint8_t lengths[" << std::max((size_t) 1, num_patterns) << "] = {";
+    for (size_t i = 0; i < num_patterns; ++i) {
+        output << (i % 16 == 0 ? "\n                " : " ") << automaton.v_pattern_to_length[i]
+               << (i + 1 < num_patterns ? "," : "");
+    }
+    output << "\n        };\n"
+           << "        return lengths[pattern];\n"
+           << "    }\n"
+           << "};\n\n"
+           << "#endif //" << guard << "\n";
+}
+
+static int
+run(
+        const Options &options
+) {
+    Automaton automaton;
+    build_automaton(options.patterns_path, make_normalizer(options), automaton);
+    if (automaton.max_pattern_length > 255) {
+        throw std::invalid_argument("The patterns of a generated matcher cannot have more than 255 words");
+    }
+
+    if (options.output_path.empty()) {
+        generate_header(std::cout, options, automaton);
+        return 0;
+    }
+    std::ofstream output(options.output_path.c_str());
+    if (!output) {
+        throw std::runtime_error("Unable to create " + options.output_path);
+    }
+    generate_header(output, options, automaton);
+    output.close();
+    if (!output) {
+        throw std::runtime_error("Unable to write " + options.output_path);
+    }
+    std::cerr << "Generated " << options.class_name << " with " << automaton.v_pattern_to_length.size()
+              << " patterns and " << automaton.v_state_to_children.size() << " states" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const Options options = parse_options(argc, argv);
+    try {
+        return run(options);
+    } catch (std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
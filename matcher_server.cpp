@@ -0,0 +1,270 @@
+/**
+ * Standalone server of a compiled Segmenter (see MatcherServer.hpp), and load generator to measure it locally.
+ *
+ * Build: g++ -std=c++11 -O3 -pthread matcher_server.cpp -o matcher_server -lrt
+ *
+ * Serve:     matcher_server --patterns FILE --socket PATH [--workers N] [--cache-bytes N]
+ * Load test: matcher_server --patterns FILE --load-test --texts FILE [--clients N] [--requests N] [--batch N]
+ *                           [--shm] [--segment] [--workers N]
+ *
+ * The patterns file contains one segment per line, optionally followed by a tab and its gain (default 1).
+ */
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MatcherClient.hpp"
+#include "MatcherServer.hpp"
+#include "Segmenter.hpp"
+
+
+struct Options {
+    std::string patterns_path;
+    std::string socket_path;
+    std::string texts_path;
+    size_t num_workers;
+    size_t cache_bytes;
+    bool b_load_test;
+    size_t num_clients;
+    size_t num_requests;
+    size_t batch_size;
+    bool b_shared_memory;
+    bool b_segment;
+
+    Options() :
+            socket_path("/tmp/matcher_server.sock"),
+            num_workers(std::max(1u, std::thread::hardware_concurrency())),
+            cache_bytes(0),
+            b_load_test(false),
+            num_clients(4),
+            num_requests(100000),
+            batch_size(64),
+            b_shared_memory(false),
+            b_segment(false) {}
+};
+
+
+static void
+usage() {
+    std::cerr << "Usage: matcher_server --patterns FILE [--socket PATH] [--workers N] [--cache-bytes N]" << std::endl
+              << "                      [--load-test --texts FILE [--clients N] [--requests N] [--batch N] [--shm]"
+              << " [--segment]]" << std::endl;
+    exit(2);
+}
+
+static Options
+parse_options(
+        int argc,
+        char **argv
+) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (argument == "--patterns" && has_value) {
+            options.patterns_path = argv[++i];
+        } else if (argument == "--socket" && has_value) {
+            options.socket_path = argv[++i];
+        } else if (argument == "--texts" && has_value) {
+            options.texts_path = argv[++i];
+        } else if (argument == "--workers" && has_value) {
+            options.num_workers = strtoul(argv[++i], nullptr, 10);
+        } else if (argument == "--cache-bytes" && has_value) {
+            options.cache_bytes = strtoul(argv[++i], nullptr, 10);
+        } else if (argument == "--clients" && has_value) {
+            options.num_clients = strtoul(argv[++i], nullptr, 10);
+        } else if (argument == "--requests" && has_value) {
+            options.num_requests = strtoul(argv[++i], nullptr, 10);
+        } else if (argument == "--batch" && has_value) {
+            options.batch_size = strtoul(argv[++i], nullptr, 10);
+        } else if (argument == "--load-test") {
+            options.b_load_test = true;
+        } else if (argument == "--shm") {
+            options.b_shared_memory = true;
+        } else if (argument == "--segment") {
+            options.b_segment = true;
+        } else {
+            usage();
+        }
+    }
+    if (options.patterns_path.empty() || (options.b_load_test && options.texts_path.empty()) ||
+        options.num_clients == 0 || options.batch_size == 0) {
+        usage();
+    }
+    return options;
+}
+
+static void
+load_segmenter(
+        const std::string &patterns_path,
+        Segmenter &segmenter
+) {
+    std::ifstream input(patterns_path.c_str());
+    if (!input) {
+        throw std::runtime_error("Unable to open " + patterns_path);
+    }
+    std::string line;
+    while (std::getline(input, line)) {
+        const size_t tab_pos = line.find('\t');
+        const std::string segment = line.substr(0, tab_pos);
+        const uint64_t gain = (tab_pos == std::string::npos) ? 1 : strtoull(line.c_str() + tab_pos + 1, nullptr, 10);
+        if (!segment.empty()) {
+            segmenter.add_segment(segment, gain);
+        }
+    }
+    segmenter.compile();
+}
+
+static void
+load_texts(
+        const std::string &texts_path,
+        std::vector<std::string> &texts
+) {
+    std::ifstream input(texts_path.c_str());
+    if (!input) {
+        throw std::runtime_error("Unable to open " + texts_path);
+    }
+    std::string line;
+    while (std::getline(input, line)) {
+        texts.push_back(line);
+    }
+    if (texts.empty()) {
+        throw std::runtime_error("No texts in " + texts_path);
+    }
+}
+
+/**
+ * Run the clients against the server and report the throughput and the latency percentiles of the calls (a call is a
+ * single request or a whole batch).
+ */
+static void
+run_load_test(
+        const Options &options,
+        const std::vector<std::string> &texts
+) {
+    const size_t requests_per_client = options.num_requests / options.num_clients;
+    std::vector<std::vector<double>> v_client_latencies(options.num_clients);
+    std::vector<std::thread> threads;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    for (size_t client_id = 0; client_id < options.num_clients; ++client_id) {
+        threads.push_back(std::thread([&options, &texts, &v_client_latencies, requests_per_client, client_id]() {
+            MatcherClient client;
+            client.connect(options.socket_path);
+            const uint32_t operation = options.b_segment ? matcher_protocol::OP_SEGMENT
+                                                         : matcher_protocol::OP_FIND_PATTERNS;
+            std::vector<double> &latencies = v_client_latencies[client_id];
+            std::vector<uint32_t> result;
+            std::vector<std::string> batch;
+            std::vector<std::vector<uint32_t>> results;
+            std::vector<uint32_t> statuses;
+            if (options.b_shared_memory) {
+                size_t max_text_size = 0;
+                for (size_t i = 0, i_max = texts.size(); i < i_max; ++i) {
+                    max_text_size = std::max(max_text_size, texts[i].size());
+                }
+                client.attach_shared_memory("/matcher_server_load_test_" + std::to_string(getpid()) + "_" +
+                                            std::to_string(client_id),
+                                            std::max((size_t) 1 << 20, 4 * options.batch_size * (max_text_size + 16)));
+            }
+
+            size_t text_id = client_id;
+            for (size_t done = 0; done < requests_per_client;) {
+                const auto call_start_time = std::chrono::steady_clock::now();
+                if (options.b_shared_memory) {
+                    batch.clear();
+                    for (; batch.size() < options.batch_size && done < requests_per_client; ++done) {
+                        batch.push_back(texts[text_id++ % texts.size()]);
+                    }
+                    client.process_batch(operation, batch, results, statuses);
+                } else {
+                    const std::string &text = texts[text_id++ % texts.size()];
+                    if (options.b_segment) {
+                        client.segment(text, result);
+                    } else {
+                        client.find_patterns(text, false, result);
+                    }
+                    ++done;
+                }
+                latencies.push_back(std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - call_start_time).count());
+            }
+        }));
+    }
+    for (size_t i = 0, i_max = threads.size(); i < i_max; ++i) {
+        threads[i].join();
+    }
+    const double elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    std::vector<double> latencies;
+    for (size_t i = 0, i_max = v_client_latencies.size(); i < i_max; ++i) {
+        latencies.insert(latencies.end(), v_client_latencies[i].begin(), v_client_latencies[i].end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const size_t num_requests = requests_per_client * options.num_clients;
+    std::cout << "requests: " << num_requests << ", calls: " << latencies.size()
+              << ", seconds: " << elapsed_seconds << std::endl
+              << "throughput: " << num_requests / elapsed_seconds << " requests/s" << std::endl;
+    if (!latencies.empty()) {
+        const double percentiles[3] = {0.5, 0.99, 0.999};
+        const char *names[3] = {"p50", "p99", "p999"};
+        std::cout << "call latency (us):";
+        for (size_t i = 0; i < 3; ++i) {
+            std::cout << " " << names[i] << "=" << latencies[(size_t) (percentiles[i] * (latencies.size() - 1))];
+        }
+        std::cout << std::endl;
+    }
+}
+
+static int
+run(
+        const Options &options
+) {
+    Segmenter segmenter;
+    load_segmenter(options.patterns_path, segmenter);
+    if (options.cache_bytes > 0) {
+        segmenter.get_matcher().enable_result_cache(options.cache_bytes);
+    }
+    std::cerr << "Loaded " << segmenter.size() << " segments" << std::endl;
+
+    // the signals are blocked before starting the threads, so that only sigwait receives them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    MatcherServer server(segmenter, options.num_workers);
+    server.start(options.socket_path);
+
+    if (options.b_load_test) {
+        std::vector<std::string> texts;
+        load_texts(options.texts_path, texts);
+        run_load_test(options, texts);
+        server.stop();
+        return 0;
+    }
+
+    // serve until SIGINT or SIGTERM
+    std::cerr << "Listening on " << options.socket_path << std::endl;
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    server.stop();
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const Options options = parse_options(argc, argv);
+    try {
+        return run(options);
+    } catch (std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
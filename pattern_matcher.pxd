@@ -1,22 +1,45 @@
-from libc.stdint cimport uint32_t
+from libc.stdint cimport uint32_t, uint64_t
 from libcpp cimport bool
 from libcpp.string cimport string
-from libcpp.unordered_map cimport unordered_map
 from libcpp.unordered_set cimport unordered_set
+from libcpp.utility cimport pair
+from libcpp.vector cimport vector
 
 ctypedef unsigned short ushort
 
 
 cdef extern from "AhoCorasickAutomaton.hpp":
+    cdef cppclass SparseKeys:
+        pass
+
+    cdef cppclass DenseKeys:
+        pass
+
     cdef cppclass PatternMatch[T]:
         const T     pattern
         size_t      end_pos
         PatternMatch(const T &, size_t)
 
+    cdef cppclass PatternSpan:
+        size_t      begin_offset
+        size_t      end_offset
+        PatternSpan(size_t, size_t)
+
+    cdef enum MatchSemantics:
+        MATCH_ALL
+        MATCH_LEFTMOST_FIRST
+        MATCH_LEFTMOST_LONGEST
+
     cdef cppclass PatternMatches[T]:
         PatternMatches()
         PatternMatches(bool)
+        PatternMatches(bool, bool)
+        PatternMatches(bool, bool, MatchSemantics)
         bool                        include_suffixes() const
+        MatchSemantics              get_semantics() const
+        bool                        include_spans() const
+        const vector[PatternSpan]&  spans() const
+        void                        push_span(const PatternSpan &)
         void                        clear()
         void                        reserve(size_t)
         size_t                      size()
@@ -25,22 +48,120 @@ cdef extern from "AhoCorasickAutomaton.hpp":
         PatternMatch[T]&            at(size_t)
 
 
+cdef extern from "ResultCache.hpp":
+    cdef cppclass ShardedResultCache[V]:
+        ShardedResultCache(size_t)
+        ShardedResultCache(size_t, size_t)
+        bool                                    find(const string &, V &)
+        void                                    insert(const string &, const V &)
+        void                                    clear()
+        uint64_t                                get_num_hits() const
+        uint64_t                                get_num_misses() const
+        size_t                                  size() const
+        size_t                                  get_used_bytes() const
+
+
+cdef extern from "TextNormalizer.hpp":
+    cdef cppclass TextNormalizer:
+        TextNormalizer()
+        TextNormalizer &                        set_delimiter(char, bool) except +
+        TextNormalizer &                        set_ascii_whitespace_delimiters()
+        TextNormalizer &                        set_ascii_punctuation_delimiters()
+        TextNormalizer &                        set_unicode_whitespace_delimiters(bool)
+        TextNormalizer &                        set_unicode_punctuation_delimiters(bool)
+        TextNormalizer &                        set_ascii_case_folding(bool)
+        TextNormalizer &                        set_utf8_case_folding(bool)
+        TextNormalizer &                        set_accent_stripping(bool)
+
+
 cdef extern from "PatternMatcher.hpp":
-    cdef cppclass PatternMatcher[T]:
+    cdef cppclass PatternMatcher[T, P=*]:
         PatternMatcher()
         void                                    add_pattern(T, const string &) except +
+        void                                    set_normalizer(const TextNormalizer &) except +
         void                                    compile() except +
         void                                    complete_with_suffix_matches(PatternMatches[T] &, PatternMatches[T] &) except +
         void                                    find_patterns(const string &, PatternMatches[T] &) except +
+        void                                    enable_result_cache(size_t, size_t)
+        void                                    disable_result_cache()
+        const ShardedResultCache[vector[pair[T, uint32_t]]] * get_result_cache() const
         ushort                                  get_pattern_length(T) except +
-        const unordered_map[T, ushort] &        get_pattern_length_map()
         const unordered_set[ushort] &           get_pattern_set()
         void                                    reserve(size_t)
 
 
+cdef extern from "BytePatternMatcher.hpp":
+    cdef cppclass BytePatternMatcher[T]:
+        BytePatternMatcher()
+        BytePatternMatcher(size_t)
+        void                                    add_pattern(T, const string &) except +
+        void                                    compile() except +
+        void                                    find_patterns(const string &, PatternMatches[T] &) except +
+        void                                    reserve(size_t)
+
+
+cdef extern from "SuccinctPatternMatcher.hpp":
+    cdef cppclass SuccinctPatternMatcher[T]:
+        SuccinctPatternMatcher()
+        void                                    set_normalizer(const TextNormalizer &) except +
+        void                                    add_pattern(T, const string &) except +
+        void                                    compile() except +
+        void                                    find_patterns(const string &, PatternMatches[T] &) except +
+        size_t                                  get_num_states()
+        size_t                                  get_num_patterns()
+        size_t                                  get_memory_bytes()
+        void                                    save(const string &) except +
+        void                                    load(const string &) except +
+
+
+cdef extern from "ExternalMatcherBuilder.hpp":
+    cdef cppclass ExternalMatcherBuilder[T]:
+        ExternalMatcherBuilder(const string &, size_t) except +
+        void                                    set_normalizer(const TextNormalizer &) except +
+        void                                    add_pattern(T, const string &) except +
+        void                                    build(const string &) except +
+        size_t                                  get_num_patterns()
+        size_t                                  get_num_runs()
+
+
+cdef extern from "IdSequenceMatcher.hpp":
+    cdef cppclass IdSequenceMatchesBatch[T]:
+        vector[uint64_t]                        v_offsets
+        vector[T]                               v_keys
+        vector[uint64_t]                        v_begins
+        vector[uint64_t]                        v_ends
+        size_t                                  get_num_matches()
+
+    cdef cppclass IdSequenceMatcher[T, S=*]:
+        IdSequenceMatcher()
+        void                                    add_pattern(T, const S *, size_t) except + nogil
+        void                                    compile() except +
+        void                                    find_patterns(const S *, size_t, PatternMatches[T] &) except +
+        void                                    find_patterns_batch(const S *, size_t, const uint64_t *, size_t, bool,
+                                                                    MatchSemantics, IdSequenceMatchesBatch[T] &) except + nogil
+        ushort                                  get_pattern_length(T) except +
+        void                                    reserve(size_t)
+
+
 cdef class PyPatternMatches:
     cdef PatternMatches[uint32_t] * c_matches
 
 
 cdef class PyPatternMatcher:
     cdef PatternMatcher[uint32_t] * c_matcher
+
+
+cdef class PyBytePatternMatcher:
+    cdef BytePatternMatcher[uint32_t] * c_matcher
+
+
+cdef class PySuccinctPatternMatcher:
+    cdef SuccinctPatternMatcher[uint32_t] * c_matcher
+
+
+cdef class PyExternalMatcherBuilder:
+    cdef ExternalMatcherBuilder[uint32_t] * c_builder
+
+
+cdef class PyIdSequenceMatcher:
+    cdef IdSequenceMatcher[uint32_t, uint32_t] * c_matcher
@@ -2,11 +2,27 @@
 
 import struct
 from cython.operator cimport dereference
+from libc.string cimport memcpy
+
+import numpy
+
+
+_SEMANTICS = {
+    "all": MATCH_ALL,
+    "leftmost-first": MATCH_LEFTMOST_FIRST,
+    "leftmost-longest": MATCH_LEFTMOST_LONGEST,
+}
 
 
 cdef class PyPatternMatches:
-    def __cinit__(self, bool include_suffixes):
-        self.c_matches = new PatternMatches[uint32_t](include_suffixes)
+    def __cinit__(self, bool include_suffixes, bool include_spans=False, semantics="all"):
+        """
+        :param semantics: "all", "leftmost-first" (non-overlapping, the pattern inserted first wins) or
+        "leftmost-longest" (non-overlapping, the longest pattern wins)
+        """
+        if semantics not in _SEMANTICS:
+            raise ValueError("Unknown match semantics: %s" % semantics)
+        self.c_matches = new PatternMatches[uint32_t](include_suffixes, include_spans, _SEMANTICS[semantics])
 
     def __dealloc__(self):
         del self.c_matches
@@ -31,15 +47,39 @@ cdef class PyPatternMatches:
     def get_end_pos(self, size_t pos):
         return self.c_matches.at(pos).end_pos
 
+    def get_span(self, size_t pos):
+        if not self.c_matches.include_spans():
+            raise ValueError("The spans have not been included in these matches")
+        cdef const PatternSpan * span = &self.c_matches.spans().at(pos)
+        return (span.begin_offset, span.end_offset)
+
     def dumps(self):
-        return "".join(struct.pack("<2I", pattern, end_pos) for (pattern, end_pos) in self)
+        """
+        Serialize the matches, together with their spans if they are included: the result must be loaded into matches
+        that include the spans in the same way.
+        """
+        if not self.c_matches.include_spans():
+            return "".join(struct.pack("<2I", pattern, end_pos) for (pattern, end_pos) in self)
+        return "".join(
+            struct.pack("<2I2Q", pattern, end_pos, *self.get_span(i)) for i, (pattern, end_pos) in enumerate(self)
+        )
 
     def loads(self, binary_data):
         cdef uint32_t pattern
-        cdef size_t end_pos
-        for i in range(0, len(binary_data), 8):
-            pattern, end_pos = struct.unpack('<2I', binary_data[i:i+8])
+        cdef size_t end_pos, begin_offset, end_offset
+        if not self.c_matches.include_spans():
+            for i in range(0, len(binary_data), 8):
+                pattern, end_pos = struct.unpack('<2I', binary_data[i:i+8])
+                self.c_matches.push_back(PatternMatch[uint32_t](pattern, end_pos))
+            return
+        # each match is followed by its span, so that spans()[j] still belongs to the match j
+        record_size = struct.calcsize("<2I2Q")
+        if len(binary_data) % record_size != 0:
+            raise ValueError("The binary data does not contain matches with spans")
+        for i in range(0, len(binary_data), record_size):
+            pattern, end_pos, begin_offset, end_offset = struct.unpack("<2I2Q", binary_data[i:i+record_size])
             self.c_matches.push_back(PatternMatch[uint32_t](pattern, end_pos))
+            self.c_matches.push_span(PatternSpan(begin_offset, end_offset))
 
 
 cdef class PyPatternMatcher:
@@ -52,6 +92,22 @@ cdef class PyPatternMatcher:
     def add_pattern(self, uint32_t pattern_id, string pattern):
         self.c_matcher.add_pattern(pattern_id, pattern)
 
+    def set_normalization(
+            self,
+            bytes delimiters=b" ",
+            bool ascii_whitespace_delimiters=False,
+            bool ascii_punctuation_delimiters=False,
+            bool unicode_whitespace_delimiters=False,
+            bool unicode_punctuation_delimiters=False,
+            bool ascii_case_folding=False,
+            bool utf8_case_folding=False,
+            bool accent_stripping=False
+    ):
+        self.c_matcher.set_normalizer(make_normalizer(
+            delimiters, ascii_whitespace_delimiters, ascii_punctuation_delimiters, unicode_whitespace_delimiters,
+            unicode_punctuation_delimiters, ascii_case_folding, utf8_case_folding, accent_stripping
+        ))
+
     def compile(self):
         self.c_matcher.compile()
 
@@ -61,8 +117,252 @@ cdef class PyPatternMatcher:
     def find_patterns(self, str text, PyPatternMatches matches):
         self.c_matcher.find_patterns(text, dereference(matches.c_matches))
 
+    def enable_result_cache(self, size_t max_bytes, size_t num_shards=16):
+        self.c_matcher.enable_result_cache(max_bytes, num_shards)
+
+    def disable_result_cache(self):
+        self.c_matcher.disable_result_cache()
+
+    def get_result_cache_stats(self):
+        cdef const ShardedResultCache[vector[pair[uint32_t, uint32_t]]] * cache = self.c_matcher.get_result_cache()
+        if cache == NULL:
+            return None
+        return {
+            "hits": cache.get_num_hits(),
+            "misses": cache.get_num_misses(),
+            "entries": cache.size(),
+            "bytes": cache.get_used_bytes(),
+        }
+
+    def get_pattern_length(self, uint32_t pattern_id):
+        return self.c_matcher.get_pattern_length(pattern_id)
+
+    def reserve(self, size_t num_patterns):
+        self.c_matcher.reserve(num_patterns)
+
+
+cdef class PyBytePatternMatcher:
+    def __cinit__(self, size_t max_dense_table_bytes=16 * 1024 * 1024):
+        self.c_matcher = new BytePatternMatcher[uint32_t](max_dense_table_bytes)
+
+    def __dealloc__(self):
+        del self.c_matcher
+
+    def add_pattern(self, uint32_t pattern_id, string pattern):
+        self.c_matcher.add_pattern(pattern_id, pattern)
+
+    def compile(self):
+        self.c_matcher.compile()
+
+    def find_patterns(self, str text, PyPatternMatches matches):
+        self.c_matcher.find_patterns(text, dereference(matches.c_matches))
+
+    def reserve(self, size_t num_patterns):
+        self.c_matcher.reserve(num_patterns)
+
+
+cdef class PySuccinctPatternMatcher:
+    def __cinit__(self):
+        self.c_matcher = new SuccinctPatternMatcher[uint32_t]()
+
+    def __dealloc__(self):
+        del self.c_matcher
+
+    def add_pattern(self, uint32_t pattern_id, string pattern):
+        self.c_matcher.add_pattern(pattern_id, pattern)
+
+    def set_normalization(
+            self,
+            bytes delimiters=b" ",
+            bool ascii_whitespace_delimiters=False,
+            bool ascii_punctuation_delimiters=False,
+            bool unicode_whitespace_delimiters=False,
+            bool unicode_punctuation_delimiters=False,
+            bool ascii_case_folding=False,
+            bool utf8_case_folding=False,
+            bool accent_stripping=False
+    ):
+        self.c_matcher.set_normalizer(make_normalizer(
+            delimiters, ascii_whitespace_delimiters, ascii_punctuation_delimiters, unicode_whitespace_delimiters,
+            unicode_punctuation_delimiters, ascii_case_folding, utf8_case_folding, accent_stripping
+        ))
+
+    def compile(self):
+        self.c_matcher.compile()
+
+    def find_patterns(self, str text, PyPatternMatches matches):
+        self.c_matcher.find_patterns(text, dereference(matches.c_matches))
+
+    def get_num_states(self):
+        return self.c_matcher.get_num_states()
+
+    def get_num_patterns(self):
+        return self.c_matcher.get_num_patterns()
+
+    def get_memory_bytes(self):
+        return self.c_matcher.get_memory_bytes()
+
+    def save(self, string path):
+        self.c_matcher.save(path)
+
+    def load(self, string path):
+        self.c_matcher.load(path)
+
+
+cdef class PyExternalMatcherBuilder:
+    """
+    Compile the patterns into a file that PySuccinctPatternMatcher.load reads, keeping the memory within the given budget
+    (besides the vocabulary and the compiled automaton) by sorting the patterns on disk.
+    """
+    def __cinit__(self, string work_directory, size_t ram_budget_bytes=256 * 1024 * 1024):
+        self.c_builder = new ExternalMatcherBuilder[uint32_t](work_directory, ram_budget_bytes)
+
+    def __dealloc__(self):
+        del self.c_builder
+
+    def add_pattern(self, uint32_t pattern_id, string pattern):
+        self.c_builder.add_pattern(pattern_id, pattern)
+
+    def set_normalization(
+            self,
+            bytes delimiters=b" ",
+            bool ascii_whitespace_delimiters=False,
+            bool ascii_punctuation_delimiters=False,
+            bool unicode_whitespace_delimiters=False,
+            bool unicode_punctuation_delimiters=False,
+            bool ascii_case_folding=False,
+            bool utf8_case_folding=False,
+            bool accent_stripping=False
+    ):
+        self.c_builder.set_normalizer(make_normalizer(
+            delimiters, ascii_whitespace_delimiters, ascii_punctuation_delimiters, unicode_whitespace_delimiters,
+            unicode_punctuation_delimiters, ascii_case_folding, utf8_case_folding, accent_stripping
+        ))
+
+    def build(self, string output_path):
+        self.c_builder.build(output_path)
+
+    def get_num_patterns(self):
+        return self.c_builder.get_num_patterns()
+
+    def get_num_runs(self):
+        return self.c_builder.get_num_runs()
+
+
+cdef class PyIdSequenceMatcher:
+    """
+    Matcher of patterns given as sequences of integer ids (e.g. the token ids of an external tokenizer), which scans
+    id sequences without any string handling. The batches are given in CSR layout: a flat uint32 array with the ids of
+    all the sequences and the uint64 offsets of the sequences, the sequence i being ids[offsets[i]:offsets[i + 1]].
+    """
+    def __cinit__(self):
+        self.c_matcher = new IdSequenceMatcher[uint32_t, uint32_t]()
+
+    def __dealloc__(self):
+        del self.c_matcher
+
+    def add_pattern(self, uint32_t pattern_id, pattern):
+        cdef const uint32_t[::1] c_pattern = numpy.ascontiguousarray(pattern, dtype=numpy.uint32)
+        self.c_matcher.add_pattern(pattern_id, &c_pattern[0] if c_pattern.shape[0] else NULL, c_pattern.shape[0])
+
+    def add_patterns(self, pattern_ids, ids, offsets):
+        """
+        Add the patterns of a CSR batch, the pattern i having the key pattern_ids[i].
+        """
+        cdef const uint32_t[::1] c_pattern_ids = numpy.ascontiguousarray(pattern_ids, dtype=numpy.uint32)
+        cdef const uint32_t[::1] c_ids = numpy.ascontiguousarray(ids, dtype=numpy.uint32)
+        cdef const uint64_t[::1] c_offsets = numpy.ascontiguousarray(offsets, dtype=numpy.uint64)
+        cdef const uint32_t * c_ids_data = &c_ids[0] if c_ids.shape[0] else NULL
+        cdef size_t i, num_patterns = c_pattern_ids.shape[0]
+        check_offsets(c_offsets, num_patterns, c_ids.shape[0])
+        self.c_matcher.reserve(num_patterns)
+        with nogil:
+            for i in range(num_patterns):
+                self.c_matcher.add_pattern(c_pattern_ids[i], c_ids_data + c_offsets[i], c_offsets[i + 1] - c_offsets[i])
+
+    def compile(self):
+        self.c_matcher.compile()
+
+    def find_patterns(self, sequence, PyPatternMatches matches):
+        """
+        The end positions and the spans of the matches are indexes of the sequence.
+        """
+        cdef const uint32_t[::1] c_sequence = numpy.ascontiguousarray(sequence, dtype=numpy.uint32)
+        self.c_matcher.find_patterns(&c_sequence[0] if c_sequence.shape[0] else NULL, c_sequence.shape[0],
+                                     dereference(matches.c_matches))
+
+    def find_patterns_batch(self, ids, offsets, bool include_suffixes=True, semantics="all"):
+        """
+        Scan a CSR batch of sequences with the GIL released.
+        :return: the uint64 match offsets, and the uint32 keys and the uint64 begin and end positions of the matches: the
+        matches of the sequence i are in [match_offsets[i], match_offsets[i + 1]) and each one spans
+        ids[offsets[i] + begins[j]:offsets[i] + ends[j]]
+        """
+        if semantics not in _SEMANTICS:
+            raise ValueError("Unknown match semantics: %s" % semantics)
+        cdef MatchSemantics c_semantics = _SEMANTICS[semantics]
+        cdef const uint32_t[::1] c_ids = numpy.ascontiguousarray(ids, dtype=numpy.uint32)
+        cdef const uint64_t[::1] c_offsets = numpy.ascontiguousarray(offsets, dtype=numpy.uint64)
+        cdef const uint32_t * c_ids_data = &c_ids[0] if c_ids.shape[0] else NULL
+        if c_offsets.shape[0] == 0:
+            raise ValueError("There must be one offset more than the sequences")
+        cdef IdSequenceMatchesBatch[uint32_t] batch
+        with nogil:
+            self.c_matcher.find_patterns_batch(c_ids_data, c_ids.shape[0], &c_offsets[0],
+                                               c_offsets.shape[0] - 1, include_suffixes, c_semantics, batch)
+        return (
+            to_numpy(batch.v_offsets.data(), batch.v_offsets.size(), sizeof(uint64_t), numpy.uint64),
+            to_numpy(batch.v_keys.data(), batch.v_keys.size(), sizeof(uint32_t), numpy.uint32),
+            to_numpy(batch.v_begins.data(), batch.v_begins.size(), sizeof(uint64_t), numpy.uint64),
+            to_numpy(batch.v_ends.data(), batch.v_ends.size(), sizeof(uint64_t), numpy.uint64),
+        )
+
     def get_pattern_length(self, uint32_t pattern_id):
         return self.c_matcher.get_pattern_length(pattern_id)
 
     def reserve(self, size_t num_patterns):
         self.c_matcher.reserve(num_patterns)
+
+
+cdef check_offsets(const uint64_t[::1] offsets, size_t num_sequences, size_t num_ids):
+    cdef size_t i
+    if <size_t> offsets.shape[0] != num_sequences + 1:
+        raise ValueError("There must be one offset more than the sequences")
+    for i in range(num_sequences):
+        if offsets[i] > offsets[i + 1] or offsets[i + 1] > num_ids:
+            raise ValueError("The offsets of the sequences are not valid")
+
+
+cdef to_numpy(const void * data, size_t size, size_t item_size, dtype):
+    array = numpy.empty(size, dtype=dtype)
+    cdef unsigned char[::1] c_array = array.view(numpy.uint8)
+    if size:
+        memcpy(&c_array[0], data, size * item_size)
+    return array
+
+
+cdef TextNormalizer make_normalizer(
+        bytes delimiters,
+        bool ascii_whitespace_delimiters,
+        bool ascii_punctuation_delimiters,
+        bool unicode_whitespace_delimiters,
+        bool unicode_punctuation_delimiters,
+        bool ascii_case_folding,
+        bool utf8_case_folding,
+        bool accent_stripping
+) except *:
+    cdef TextNormalizer normalizer = TextNormalizer()
+    cdef char delimiter
+    normalizer.set_delimiter(b" "[0], False)
+    for delimiter in delimiters:
+        normalizer.set_delimiter(delimiter, True)
+    if ascii_whitespace_delimiters:
+        normalizer.set_ascii_whitespace_delimiters()
+    if ascii_punctuation_delimiters:
+        normalizer.set_ascii_punctuation_delimiters()
+    normalizer.set_unicode_whitespace_delimiters(unicode_whitespace_delimiters)
+    normalizer.set_unicode_punctuation_delimiters(unicode_punctuation_delimiters)
+    normalizer.set_ascii_case_folding(ascii_case_folding)
+    normalizer.set_utf8_case_folding(utf8_case_folding)
+    normalizer.set_accent_stripping(accent_stripping)
+    return normalizer
@@ -1,90 +1,117 @@
 # distutils: language=c++
 
 from libc.stdint cimport uint16_t, uint32_t, int32_t, uint64_t
+from libcpp cimport bool
+from libcpp.string cimport string
 from libcpp.vector cimport vector
 
 cimport cython
+import numpy
 
 cimport pattern_matcher
-from pattern_matcher cimport PatternMatcher, PatternMatches
+from pattern_matcher cimport DenseKeys, PatternMatcher, PatternMatches, ShardedResultCache
+
+
+cdef extern from "SegmenterBuilder.hpp":
+    cdef cppclass FrequencyTable:
+        FrequencyTable(const char *, size_t, const uint64_t *, size_t, bool, size_t) except + nogil
+        FrequencyTable(const string &, bool, size_t) except + nogil
+
+    cdef cppclass MappedFile:
+        MappedFile(const string &) except + nogil
+        const char *    data()
+        size_t          size()
+
+    cdef cppclass SegmenterBuilder:
+        SegmenterBuilder(double, uint64_t, size_t) except +
+        void            build(const char *, size_t, const FrequencyTable &, const FrequencyTable &,
+                              PatternMatcher[uint32_t, DenseKeys] &, vector[uint64_t] &, vector[uint16_t] &) except + nogil
 
 
 cdef class PySegmenter(object):
-    cdef PatternMatcher[uint32_t] * c_matcher
+    # the segments are identified by their position, hence the keys are dense
+    cdef PatternMatcher[uint32_t, DenseKeys] * c_matcher
     cdef vector[uint16_t] c_segments_lengths
     cdef vector[uint64_t] c_segments_gains
     cdef uint64_t c_num_segments
+    # cache of the selected segments (pairs of start and end positions) of the most frequent texts
+    cdef ShardedResultCache[vector[uint32_t]] * c_cache
 
     def __cinit__(
             self,
-            set segments_set,
-            dict segment_to_phrase_freq,
-            dict segment_to_and_freq,
-            double min_segmentation_probability,
-            long min_segmentation_freq,
-            debug=False
+            set segments_set=None,
+            dict segment_to_phrase_freq=None,
+            dict segment_to_and_freq=None,
+            double min_segmentation_probability=0,
+            long min_segmentation_freq=0,
+            debug=False,
+            size_t cache_max_bytes=0,
+            size_t cache_num_shards=16,
+            segments_path=None,
+            phrase_freqs_path=None,
+            and_freqs_path=None,
+            size_t num_threads=0
     ):
-        # create a filtered list of segments which will be used for the segmentation
-        if debug:
-            print "Fetching segments to use for the segmentation"
+        """
+        The segments and their frequencies are given either as a set and two dictionaries, or as three files: the
+        segments one per line, and the phrase and AND frequencies as lines with a segment, a tab and its frequency.
+        The filters and the gains are computed natively (see SegmenterBuilder.hpp) by num_threads threads (0 means one
+        per core).
+        """
+        self.c_cache = NULL
+        self.c_matcher = new PatternMatcher[uint32_t, DenseKeys]()
         assert min_segmentation_probability >= 0 or min_segmentation_probability == -1
         assert min_segmentation_freq >= 0
-        segment_to_and_freq = dict(
-            (" ".join(sorted(segment.split())) if " " in segment else segment, freq)
-            for segment, freq in segment_to_and_freq.iteritems()
-        )
-
-        if min_segmentation_probability == -1:
-            segments_freqs = tuple(
-                (segment, phrase_freq)
-                for segment, segment_length, (phrase_freq, and_freq) in (
-                    (segment, len(segment.split()) if "  " in segment else (segment.count(" ")+1), get_segment_details(segment, segment_to_phrase_freq, segment_to_and_freq))
-                    for segment in segments_set
-                    if " " in segment  # are we sure we want only multi-terms segments here?
-                )
-                if phrase_freq >= min_segmentation_freq
-                and (segment_length ** segment_length) * phrase_freq >= and_freq
-            )
-        else:
-            segments_freqs = tuple(
-                (segment, phrase_freq)
-                for segment, (phrase_freq, and_freq) in (
-                    (segment, get_segment_details(segment, segment_to_phrase_freq, segment_to_and_freq))
-                    for segment in segments_set
-                    if " " in segment  # are we sure we want only multi-terms segments here?
-                )
-                if phrase_freq >= min_segmentation_freq
-                and phrase_freq >= (min_segmentation_probability * (and_freq if and_freq > 0 else 1))
-            )
-
-        self.c_num_segments = len(segments_freqs)
-        self.c_segments_gains = vector[uint64_t](self.c_num_segments)
-        self.c_segments_lengths = vector[uint16_t](self.c_num_segments)
+        cdef SegmenterBuilder * builder = new SegmenterBuilder(min_segmentation_probability, min_segmentation_freq,
+                                                               num_threads)
+        cdef FrequencyTable * phrase_table = NULL
+        cdef FrequencyTable * and_table = NULL
+        cdef MappedFile * segments_file = NULL
+        cdef const char * segments_data
+        cdef size_t segments_size
+        cdef bytes segments_buffer
+        cdef string path
+        try:
+            if debug:
+                print "Loading the segments and their frequencies"
+            if segments_set is not None:
+                segments_buffer = join_keys(segments_set)
+                segments_data = segments_buffer
+                segments_size = len(segments_buffer)
+                phrase_table = make_frequency_table(segment_to_phrase_freq, False, num_threads)
+                and_table = make_frequency_table(segment_to_and_freq, True, num_threads)
+            else:
+                if segments_path is None or phrase_freqs_path is None or and_freqs_path is None:
+                    raise ValueError("Either the segments set and the frequency dictionaries or their files are needed")
+                path = segments_path
+                with nogil:
+                    segments_file = new MappedFile(path)
+                segments_data = segments_file.data()
+                segments_size = segments_file.size()
+                path = phrase_freqs_path
+                with nogil:
+                    phrase_table = new FrequencyTable(path, False, num_threads)
+                path = and_freqs_path
+                with nogil:
+                    and_table = new FrequencyTable(path, True, num_threads)
+
+            # filter the segments, compute their gains and build the matcher in a single native call
+            if debug:
+                print "Building the PatternMatcher"
+            with nogil:
+                builder.build(segments_data, segments_size, phrase_table[0], and_table[0], self.c_matcher[0],
+                              self.c_segments_gains, self.c_segments_lengths)
+        finally:
+            del builder
+            del phrase_table
+            del and_table
+            del segments_file
+        self.c_num_segments = self.c_segments_gains.size()
         if debug:
             print "Fetched {} segments".format(self.c_num_segments)
 
-        # create the matcher
-        self.c_matcher = new PatternMatcher[uint32_t]()
-
-        # add the patterns
-        if debug:
-            print "Adding patterns into PatternMatcher"
-
-        cdef uint32_t segment_pos
-        cdef str segment
-        cdef uint64_t phrase_freq
-        cdef uint64_t segment_len
-        for segment_pos in range(self.c_num_segments):
-            segment, phrase_freq = segments_freqs[segment_pos]
-            segment_len = len(segment.split())
-            self.c_segments_lengths[segment_pos] = segment_len
-            self.c_segments_gains[segment_pos] = (segment_len ** segment_len) * phrase_freq
-            self.c_matcher.add_pattern(segment_pos, segment)
-
-        # compile the matcher
-        if debug:
-            print "Compiling the PatternMatcher"
-        self.c_matcher.compile()
+        if cache_max_bytes > 0:
+            self.c_cache = new ShardedResultCache[vector[uint32_t]](cache_max_bytes, cache_num_shards)
 
         if debug:
             print "End PySegmenter.__init__"
@@ -92,6 +119,17 @@ cdef class PySegmenter(object):
 
     def __dealloc__(self):
         del self.c_matcher
+        del self.c_cache
+
+    def get_cache_stats(self):
+        if self.c_cache == NULL:
+            return None
+        return {
+            "hits": self.c_cache.get_num_hits(),
+            "misses": self.c_cache.get_num_misses(),
+            "entries": self.c_cache.size(),
+            "bytes": self.c_cache.get_used_bytes(),
+        }
 
 
     @cython.boundscheck(False)
@@ -105,30 +143,39 @@ cdef class PySegmenter(object):
         if len(terms) == 0:
             return []
 
+        # look for the selected segments in the cache
+        cdef vector[uint32_t] segments_bounds
+        if self.c_cache != NULL and self.c_cache.find(text, segments_bounds):
+            return build_segmentation(terms, segments_bounds)
+
         # find the segments inside the text
         cdef PatternMatches[uint32_t] c_matches = PatternMatches[uint32_t](True)
         self.c_matcher.find_patterns(text, c_matches)
         cdef int32_t num_matches = c_matches.size()
         # early exit
         if num_matches == 0:
+            if self.c_cache != NULL:
+                self.c_cache.insert(text, segments_bounds)
             return terms
 
 
         # buffer vector will be deallocated at the end of the function
-        cdef vector[uint32_t] buffer_vector = vector[uint32_t](num_matches * 6)
+        cdef vector[uint32_t] buffer_vector = vector[uint32_t](num_matches * 4)
+        # the gains are 64 bits wide like the ones of Segmenter, hence they have their own buffer
+        cdef vector[uint64_t] gain_buffer_vector = vector[uint64_t](num_matches * 2)
 
         # vector with the start position of each segment
         cdef uint32_t * start_vec = &buffer_vector[num_matches * 0]
         # vector with the end position of each segment
         cdef uint32_t * end_vec = &buffer_vector[num_matches * 1]
         # vector with the (precomputed) gain of each segment
-        cdef uint32_t * gain_vec = &buffer_vector[num_matches * 2]
+        cdef uint64_t * gain_vec = &gain_buffer_vector[num_matches * 0]
         # vector with the segmentation back references
-        cdef int32_t * best_back_pos = <int32_t*>&buffer_vector[num_matches * 3]
+        cdef int32_t * best_back_pos = <int32_t*>&buffer_vector[num_matches * 2]
         # vector with the best segmentation gains
-        cdef uint32_t * best_gain = &buffer_vector[num_matches * 4]
+        cdef uint64_t * best_gain = &gain_buffer_vector[num_matches * 1]
         # vecotor with the positions of the best segments for each position of the vector matches
-        cdef int32_t * best_pos = <int32_t*>&buffer_vector[num_matches * 5]
+        cdef int32_t * best_pos = <int32_t*>&buffer_vector[num_matches * 3]
 
         cdef int32_t pos,
         cdef uint32_t start_pos, end_pos, freq, length
@@ -168,8 +215,11 @@ cdef class PySegmenter(object):
                     gain = best_gain[prev_pos]
                     best_back_pos[pos] = best_pos[prev_pos]
 
-            # add the gain due to this segment
-            gain += gain_vec[pos]
+            # add the gain due to this segment (the sum saturates like in Segmenter)
+            if gain > <uint64_t> -1 - gain_vec[pos]:
+                gain = <uint64_t> -1
+            else:
+                gain += gain_vec[pos]
 
             # store the best value and position encountered until now in this position
             if pos > 0 and gain <= best_gain[pos-1]:
@@ -187,20 +237,16 @@ cdef class PySegmenter(object):
             pos = best_back_pos[pos]
         best_pos_list.reverse()  # transform the list with the position from left to right
 
-        # build the optimal solution
-        segmentation = []
-        cdef uint32_t prev_end_pos = 0
+        # store the bounds of the selected segments
+        segments_bounds.reserve(2 * len(best_pos_list))
         for pos in best_pos_list:
-            start_pos = start_vec[pos]
-            end_pos = end_vec[pos]
+            segments_bounds.push_back(start_vec[pos])
+            segments_bounds.push_back(end_vec[pos])
+        if self.c_cache != NULL:
+            self.c_cache.insert(text, segments_bounds)
 
-            segmentation.extend(terms[prev_end_pos:start_pos])
-            segmentation.append(" ".join(terms[start_pos:end_pos]))
-            prev_end_pos = end_pos
-        segmentation.extend(terms[prev_end_pos:])
-
-        # return the result
-        return segmentation
+        # build the optimal solution
+        return build_segmentation(terms, segments_bounds)
 
     cdef c_segment_text(self, str text):
         assert("_" not in text)
@@ -228,9 +274,44 @@ cdef class PySegmenter(object):
             raise ValueError("text must be a string or a list of strings (related to different rows of the same document)")
 
 
-cdef get_segment_details(str segment, dict segment_to_phrase_freq, dict segment_to_and_freq):
-    if " " in segment:
-        return (segment_to_phrase_freq[segment], segment_to_and_freq[" ".join(sorted(segment.split()))])
-    else:
-        freq = segment_to_phrase_freq[segment]
-        return (freq, freq)
+cdef build_segmentation(list terms, vector[uint32_t] & segments_bounds):
+    segmentation = []
+    cdef uint32_t prev_end_pos = 0
+    cdef uint32_t start_pos, end_pos
+    cdef size_t i
+    for i in range(0, segments_bounds.size(), 2):
+        start_pos = segments_bounds[i]
+        end_pos = segments_bounds[i + 1]
+
+        segmentation.extend(terms[prev_end_pos:start_pos])
+        segmentation.append(" ".join(terms[start_pos:end_pos]))
+        prev_end_pos = end_pos
+    segmentation.extend(terms[prev_end_pos:])
+
+    # return the result
+    return segmentation
+
+
+cdef bytes join_keys(keys):
+    """
+    Join the keys (in their iteration order) by newlines, which they cannot contain.
+    """
+    cdef bytes joined = b"\n".join(keys)
+    if joined.count(b"\n") != max(len(keys) - 1, 0):
+        raise ValueError("The segments cannot contain newlines")
+    return joined
+
+
+cdef FrequencyTable * make_frequency_table(dict segment_to_freq, bool sort_words, size_t num_threads) except NULL:
+    cdef bytes keys = join_keys(segment_to_freq)
+    # the values of a dictionary follow the order of its keys
+    cdef uint64_t[::1] freqs = numpy.fromiter(segment_to_freq.itervalues(), dtype=numpy.uint64,
+                                              count=len(segment_to_freq))
+    cdef const char * keys_data = keys
+    cdef size_t keys_size = len(keys)
+    cdef const uint64_t * freqs_data = &freqs[0] if freqs.shape[0] > 0 else NULL
+    cdef size_t num_freqs = freqs.shape[0]
+    cdef FrequencyTable * table
+    with nogil:
+        table = new FrequencyTable(keys_data, keys_size, freqs_data, num_freqs, sort_words, num_threads)
+    return table
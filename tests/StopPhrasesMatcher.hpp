@@ -0,0 +1,324 @@
+// Generated by matcher_codegen from tests/stop_phrases.txt, do not edit.
+#ifndef STOPPHRASESMATCHER_HPP
+#define STOPPHRASESMATCHER_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "AhoCorasickAutomaton.hpp"
+#include "TextNormalizer.hpp"
+
+
+/**
+ * Matcher of the 12 fixed patterns of tests/stop_phrases.txt, with the same matches of
+ * PatternMatcher; the key of a pattern is its position in the file.
+ */
+class StopPhrasesMatcher {
+public:
+    typedef uint32_t KeyType;
+
+private:
+    TextNormalizer normalizer;
+
+public:
+    StopPhrasesMatcher() {
+        this->normalizer.set_delimiter(' ', false);
+        this->normalizer.set_delimiter((char) 32);
+        this->normalizer.set_ascii_whitespace_delimiters();
+        this->normalizer.set_ascii_punctuation_delimiters();
+        this->normalizer.set_unicode_whitespace_delimiters(false);
+        this->normalizer.set_unicode_punctuation_delimiters(false);
+        this->normalizer.set_ascii_case_folding(true);
+        this->normalizer.set_utf8_case_folding(false);
+        this->normalizer.set_accent_stripping(false);
+    }
+
+    void
+    find_patterns(
+            const std::string &text,
+            PatternMatches<KeyType> &matches
+    ) const {
+        const bool include_spans = matches.include_spans();
+        const bool include_suffixes = matches.include_suffixes();
+        size_t ring_word_begin[4];
+        uint32_t state = 0;
+        size_t pos = 0;
+        std::string scratch_word;
+
+        if (matches.get_semantics() != MATCH_ALL) {
+            LeftmostMatchSelector<KeyType> selector(matches.get_semantics(), 4);
+            this->normalizer.for_each_word(
+                    text.data(), text.size(), scratch_word,
+                    [&](const MyString &word, size_t begin_offset, size_t end_offset) {
+                        state = _get_next_state(state, _find_word_id(word.data(), word.size()));
+                        ring_word_begin[pos & 3] = begin_offset;
+                        const uint32_t *output, *output_end;
+                        _get_outputs(state, output, output_end);
+                        for (; output != output_end; ++output) {
+                            const size_t length = _get_length(*output);
+                            selector.add_candidate((KeyType) *output, pos + 1 - length, pos, *output,
+                                                   ring_word_begin[(pos + 1 - length) & 3], end_offset);
+                        }
+                        selector.flush(pos, matches);
+                        ++pos;
+                    });
+            selector.finish(matches);
+            return;
+        }
+
+        this->normalizer.for_each_word(
+                text.data(), text.size(), scratch_word,
+                [&](const MyString &word, size_t begin_offset, size_t end_offset) {
+                    state = _get_next_state(state, _find_word_id(word.data(), word.size()));
+                    ring_word_begin[pos & 3] = begin_offset;
+                    const uint32_t *output, *output_end;
+                    _get_outputs(state, output, output_end);
+                    if (output != output_end) {
+                        do {
+                            matches.push_back(PatternMatch<KeyType>((KeyType) *output, pos));
+                            if (include_spans) {
+                                const size_t length = _get_length(*output);
+                                matches.push_span(PatternSpan(
+                                        ring_word_begin[(pos + 1 - length) & 3], end_offset));
+                            }
+                        } while (include_suffixes && ++output != output_end);
+                    }
+                    ++pos;
+                });
+    }
+
+    size_t
+    get_num_patterns() const {
+        return 12;
+    }
+
+    size_t
+    get_num_states() const {
+        return 21;
+    }
+
+    pattern_length_t
+    get_pattern_length(
+            KeyType pattern_id
+    ) const {
+        if ((size_t) pattern_id >= 12) {
+            throw std::runtime_error("The given pattern has not been found");
+        }
+        return (pattern_length_t) _get_length((uint32_t) pattern_id);
+    }
+
+private:
+    /**
+     * @return The identifier of the word, 0 if it is not in the patterns
+     */
+    static uint32_t
+    _find_word_id(
+            const char *data,
+            size_t size
+    ) {
+        switch (size) {
+            case 1: {
+                switch ((uint8_t) data[0]) {
+                    case 97: {
+                        return 1;
+                    }
+                    case 98: {
+                        return 2;
+                    }
+                    case 99: {
+                        return 3;
+                    }
+                    case 100: {
+                        return 4;
+                    }
+                    case 101: {
+                        return 5;
+                    }
+                    case 102: {
+                        return 6;
+                    }
+                    default:
+                        return 0;
+                }
+            }
+            case 2: {
+                return memcmp(data + 0, "au", 2) == 0 ? 11 : 0;
+            }
+            case 3: {
+                return memcmp(data + 0, "new", 3) == 0 ? 7 : 0;
+            }
+            case 4: {
+                switch ((uint8_t) data[0]) {
+                    case 99: {
+                        return memcmp(data + 1, "ity", 3) == 0 ? 9 : 0;
+                    }
+                    case 108: {
+                        return memcmp(data + 1, "ait", 3) == 0 ? 12 : 0;
+                    }
+                    case 121: {
+                        return memcmp(data + 1, "ork", 3) == 0 ? 8 : 0;
+                    }
+                    default:
+                        return 0;
+                }
+            }
+            case 5: {
+                return memcmp(data + 0, "caf\303\251", 5) == 0 ? 10 : 0;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    /**
+     * @return The next state, following the failure links until the word is found
+     */
+    static uint32_t
+    _get_next_state(
+            uint32_t state,
+            uint32_t word_id
+    ) {
+        if (word_id == 0) {
+            return 0;
+        }
+        switch (state) {
+            case 0: goto state_0;
+            case 1: goto state_1;
+            case 2: goto state_2;
+            case 3: goto state_3;
+            case 4: goto state_4;
+            case 5: goto state_5;
+            case 6: goto state_6;
+            case 7: goto state_7;
+            case 8: goto state_8;
+            case 9: goto state_9;
+            case 10: goto state_10;
+            case 11: goto state_11;
+            case 12: goto state_12;
+            case 13: goto state_13;
+            case 14: goto state_14;
+            case 15: goto state_15;
+            case 16: goto state_16;
+            case 17: goto state_17;
+            case 18: goto state_18;
+            case 19: goto state_19;
+            case 20: goto state_20;
+            default: return 0;
+        }
+        state_0:
+        switch (word_id) {
+            case 1: return 1;
+            case 2: return 4;
+            case 3: return 6;
+            case 4: return 8;
+            case 6: return 11;
+            case 7: return 12;
+            case 8: return 14;
+            case 9: return 16;
+            case 10: return 17;
+            case 11: return 20;
+            default: return 0;
+        }
+        state_1:
+        switch (word_id) {
+            case 2: return 2;
+            default: goto state_0;
+        }
+        state_2:
+        switch (word_id) {
+            case 3: return 3;
+            default: goto state_4;
+        }
+        state_3:
+        switch (word_id) {
+            case 4: return 5;
+            default: goto state_6;
+        }
+        state_4:
+        goto state_0;
+        state_5:
+        goto state_7;
+        state_6:
+        switch (word_id) {
+            case 4: return 7;
+            default: goto state_0;
+        }
+        state_7:
+        goto state_8;
+        state_8:
+        switch (word_id) {
+            case 5: return 9;
+            default: goto state_0;
+        }
+        state_9:
+        switch (word_id) {
+            case 6: return 10;
+            default: goto state_0;
+        }
+        state_10:
+        goto state_11;
+        state_11:
+        goto state_0;
+        state_12:
+        switch (word_id) {
+            case 8: return 13;
+            default: goto state_0;
+        }
+        state_13:
+        switch (word_id) {
+            case 9: return 15;
+            default: goto state_14;
+        }
+        state_14:
+        goto state_0;
+        state_15:
+        goto state_16;
+        state_16:
+        goto state_0;
+        state_17:
+        switch (word_id) {
+            case 11: return 18;
+            default: goto state_0;
+        }
+        state_18:
+        switch (word_id) {
+            case 12: return 19;
+            default: goto state_20;
+        }
+        state_19:
+        goto state_0;
+        state_20:
+        goto state_0;
+    }
+
+    static void
+    _get_outputs(
+            uint32_t state,
+            const uint32_t *&output,
+            const uint32_t *&output_end
+    ) {
+        static const uint32_t output_begins[22] = {
+                0, 0, 0, 1, 2, 3, 5, 5, 6, 6, 6, 8, 9, 9, 11, 12,
+                14, 15, 15, 16, 17, 18
+        };
+        static const uint32_t outputs[18] = {
+                1, 0, 1, 2, 3, 3, 4, 5, 5, 6, 7, 7, 8, 9, 9, 11,
+                10, 11
+        };
+        output = outputs + output_begins[state];
+        output_end = outputs + output_begins[state + 1];
+    }
+
+    static size_t
+    _get_length(
+            uint32_t pattern
+    ) {
+        static const uint8_t lengths[12] = {
+                3, 1, 4, 2, 3, 1, 2, 1, 3, 1, 3, 1
+        };
+        return lengths[pattern];
+    }
+};
+
+#endif //STOPPHRASESMATCHER_HPP
@@ -1,5 +1,14 @@
 #include <assert.h>
 #include "PatternMatcher.hpp"
+#include "BytePatternMatcher.hpp"
+#include "PartitionedPatternMatcher.hpp"
+#include "MatcherClient.hpp"
+#include "NumaReplicatedMatcher.hpp"
+#include "SuccinctPatternMatcher.hpp"
+#include "ExternalMatcherBuilder.hpp"
+#include "SegmenterBuilder.hpp"
+#include "IdSequenceMatcher.hpp"
+#include "StopPhrasesMatcher.hpp"
 
 
 void
@@ -134,9 +143,921 @@ test2() {
 }
 
 
+void
+test3() {
+    // test the byte-level matcher against a naive search, with the rare-byte and the first-byte prefilters and with
+    // both dense and sparse states
+    const char *text = "see http://example.org/#tag and ##tags, hers: she said he is his; ushers xhttp";
+    const char *patterns_sets[2][8] = {
+            {"http", "#tag", "tag", "ag", "he", "she", "hers", "his"},
+            {"he", "she", "his", "hers", "s", "x", "e", "#"},
+    };
+
+    for (size_t set = 0; set < 2; ++set) {
+        for (size_t dense_bytes = 0; dense_bytes <= 1024 * 1024; dense_bytes += 1024 * 1024) {
+            BytePatternMatcher<uint8_t> matcher(dense_bytes);
+            for (uint8_t i = 0; i < 8; ++i) {
+                matcher.add_pattern(i, patterns_sets[set][i]);
+            }
+            matcher.compile();
+
+            PatternMatches<uint8_t> matches(true);
+            matcher.find_patterns(text, matches);
+
+            // naive search: for each end position the patterns ordered by decreasing length
+            PatternMatches<uint8_t> expected(true);
+            const std::string text_string(text);
+            for (size_t end_pos = 0; end_pos < text_string.size(); ++end_pos) {
+                for (size_t length = end_pos + 1; length > 0; --length) {
+                    for (uint8_t i = 0; i < 8; ++i) {
+                        const std::string pattern(patterns_sets[set][i]);
+                        if (pattern.size() == length &&
+                            text_string.compare(end_pos + 1 - length, length, pattern) == 0) {
+                            expected.push_back(PatternMatch<uint8_t>(i, end_pos));
+                        }
+                    }
+                }
+            }
+
+            assert(matches.size() == expected.size());
+            for (size_t i = 0; i < matches.size(); ++i) {
+                assert(matches[i] == expected[i]);
+            }
+        }
+    }
+}
+
+
+void
+test4() {
+    // test that the DenseKeys policy behaves like the default one
+    const char *testString = "a b c d a b c d e f a b";
+    const char *patterns[6] = {
+            "a b",
+            "b",
+            "a b c d",
+            "c d",
+            "d e f",
+            "f",
+    };
+
+    PatternMatcher<uint32_t> sparse_matcher;
+    PatternMatcher<uint32_t, DenseKeys> dense_matcher;
+    for (uint32_t i = 0; i < 6; ++i) {
+        sparse_matcher.add_pattern(i, patterns[i]);
+        dense_matcher.add_pattern(i, patterns[i]);
+    }
+    sparse_matcher.compile();
+    dense_matcher.compile();
+
+    for (int include_suffixes = 0; include_suffixes < 2; ++include_suffixes) {
+        PatternMatches<uint32_t> sparse_matches(include_suffixes);
+        PatternMatches<uint32_t> dense_matches(include_suffixes);
+        sparse_matcher.find_patterns(testString, sparse_matches);
+        dense_matcher.find_patterns(testString, dense_matches);
+        assert(sparse_matches.size() == dense_matches.size());
+        for (size_t i = 0; i < sparse_matches.size(); ++i) {
+            assert(sparse_matches[i] == dense_matches[i]);
+        }
+
+        if (!include_suffixes) {
+            PatternMatches<uint32_t> sparse_completed(true);
+            PatternMatches<uint32_t> dense_completed(true);
+            sparse_matcher.complete_with_suffix_matches(sparse_matches, sparse_completed);
+            dense_matcher.complete_with_suffix_matches(dense_matches, dense_completed);
+            assert(sparse_completed.size() == dense_completed.size());
+            for (size_t i = 0; i < sparse_completed.size(); ++i) {
+                assert(sparse_completed[i] == dense_completed[i]);
+            }
+
+            // an unknown key must be rejected
+            PatternMatches<uint32_t> unknown_matches(false);
+            unknown_matches.push_back(PatternMatch<uint32_t>(42, 0));
+            try {
+                dense_matcher.complete_with_suffix_matches(unknown_matches, dense_completed);
+                throw std::exception();  // "Exception not thrown"
+            } catch (std::runtime_error &) {}
+        }
+    }
+
+    for (uint32_t i = 0; i < 6; ++i) {
+        assert(sparse_matcher.get_pattern_length(i) == dense_matcher.get_pattern_length(i));
+    }
+    try {
+        dense_matcher.get_pattern_length(6);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::runtime_error &) {}
+}
+
+
+void
+test5() {
+    // test the result cache
+    const char *texts[3] = {
+            "hello world string",
+            "the world says hello world",
+            "nothing to see",
+    };
+    const char *patterns[3] = {
+            "hello",
+            "world",
+            "hello world",
+    };
+
+    PatternMatcher<uint8_t> matcher;
+    PatternMatcher<uint8_t> cached_matcher;
+    for (uint8_t i = 0; i < 3; ++i) {
+        matcher.add_pattern(i, patterns[i]);
+        cached_matcher.add_pattern(i, patterns[i]);
+    }
+    matcher.compile();
+    cached_matcher.enable_result_cache(1024 * 1024, 4);
+    cached_matcher.compile();
+
+    for (size_t repetition = 0; repetition < 3; ++repetition) {
+        for (size_t t = 0; t < 3; ++t) {
+            for (int include_suffixes = 0; include_suffixes < 2; ++include_suffixes) {
+                PatternMatches<uint8_t> matches(include_suffixes);
+                PatternMatches<uint8_t> cached_matches(include_suffixes);
+                matcher.find_patterns(texts[t], matches);
+                cached_matcher.find_patterns(texts[t], cached_matches);
+                assert(matches.size() == cached_matches.size());
+                for (size_t i = 0; i < matches.size(); ++i) {
+                    assert(matches[i] == cached_matches[i]);
+                }
+            }
+        }
+    }
+    assert(cached_matcher.get_result_cache()->get_num_misses() == 3);
+    assert(cached_matcher.get_result_cache()->get_num_hits() == 3 * 3 * 2 - 3);
+    assert(cached_matcher.get_result_cache()->size() == 3);
+
+    // the memory budget must be respected
+    ShardedResultCache<std::vector<uint32_t>> cache(4096, 1);
+    for (uint32_t i = 0; i < 1000; ++i) {
+        cache.insert(std::to_string(i), std::vector<uint32_t>(i % 16, i));
+        assert(cache.get_used_bytes() <= 4096);
+    }
+    std::vector<uint32_t> value;
+    assert(cache.find("999", value) && value.size() == 999 % 16);
+    assert(!cache.find("0", value));
+}
+
+
+void
+test6() {
+    // test the identifier widths and the partitioned matcher against a single matcher
+    const char *testString = "a b c d a b c d e f a b x c d e";
+    const char *patterns[8] = {
+            "a b",
+            "b",
+            "a b c d",
+            "c d",
+            "d e f",
+            "f",
+            "b c d e f",
+            "c d e",
+    };
+
+    PatternMatcher<uint32_t> matcher;
+    PatternMatcher<uint32_t, SparseKeys, uint16_t> narrow_matcher;
+    PatternMatcher<uint32_t, DenseKeys, uint64_t> wide_matcher;
+    PartitionedPatternMatcher<uint32_t> partitioned_matcher(3);
+    PartitionedPatternMatcher<uint32_t> hosting_matcher(3, std::vector<size_t>({0, 2}));
+    for (uint32_t i = 0; i < 8; ++i) {
+        matcher.add_pattern(i, patterns[i]);
+        narrow_matcher.add_pattern(i, patterns[i]);
+        wide_matcher.add_pattern(i, patterns[i]);
+        assert(partitioned_matcher.add_pattern(i, patterns[i]));
+        assert(hosting_matcher.add_pattern(i, patterns[i]) == (hosting_matcher.get_partition_id(patterns[i]) != 1));
+    }
+    matcher.compile();
+    narrow_matcher.compile();
+    wide_matcher.compile();
+    partitioned_matcher.compile();
+    hosting_matcher.compile();
+
+    for (int include_suffixes = 0; include_suffixes < 2; ++include_suffixes) {
+        PatternMatches<uint32_t> matches(include_suffixes);
+        PatternMatches<uint32_t> narrow_matches(include_suffixes);
+        PatternMatches<uint32_t> wide_matches(include_suffixes);
+        PatternMatches<uint32_t> partitioned_matches(include_suffixes);
+        PatternMatches<uint32_t> all_matches(true);
+        PatternMatches<uint32_t> hosted_matches(true);
+        matcher.find_patterns(testString, matches);
+        narrow_matcher.find_patterns(testString, narrow_matches);
+        wide_matcher.find_patterns(testString, wide_matches);
+        partitioned_matcher.find_patterns(testString, partitioned_matches);
+        assert(matches.size() == narrow_matches.size());
+        assert(matches.size() == wide_matches.size());
+        assert(matches.size() == partitioned_matches.size());
+        for (size_t i = 0; i < matches.size(); ++i) {
+            assert(matches[i] == narrow_matches[i]);
+            assert(matches[i] == wide_matches[i]);
+            assert(matches[i] == partitioned_matches[i]);
+        }
+
+        // the partial matcher finds exactly the matches of the hosted partitions
+        matcher.find_patterns(testString, all_matches);
+        hosting_matcher.find_patterns(testString, hosted_matches);
+        size_t j = 0;
+        for (size_t i = 0; i < all_matches.size(); ++i) {
+            if (hosting_matcher.get_partition_id(patterns[all_matches[i].pattern]) != 1) {
+                assert(j < hosted_matches.size() && all_matches[i] == hosted_matches[j]);
+                ++j;
+            }
+        }
+        assert(j == hosted_matches.size());
+    }
+
+    // a narrow identifier overflows
+    PatternMatcher<uint32_t, SparseKeys, uint8_t> tiny_matcher;
+    try {
+        for (uint32_t i = 0; i < 300; ++i) {
+            tiny_matcher.add_pattern(i, "w" + std::to_string(i));
+        }
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::runtime_error &) {}
+}
+
+
+void
+test7() {
+    // test the byte spans of the matches
+    const std::string testString = "  hello   world string  hello world";
+    const char *patterns[4] = {
+            "hello",
+            "world",
+            "hello world",
+            "world string hello world",
+    };
+
+    PatternMatcher<uint8_t> matcher;
+    PartitionedPatternMatcher<uint8_t> partitioned_matcher(2);
+    BytePatternMatcher<uint8_t> byte_matcher;
+    for (uint8_t i = 0; i < 4; ++i) {
+        matcher.add_pattern(i, patterns[i]);
+        partitioned_matcher.add_pattern(i, patterns[i]);
+        byte_matcher.add_pattern(i, patterns[i]);
+    }
+    matcher.compile();
+    partitioned_matcher.compile();
+    byte_matcher.compile();
+
+    PatternMatches<uint8_t> matches(true, true);
+    PatternMatches<uint8_t> partitioned_matches(true, true);
+    matcher.find_patterns(testString, matches);
+    partitioned_matcher.find_patterns(testString, partitioned_matches);
+    assert(matches.size() == 7 && matches.spans().size() == matches.size());
+    assert(partitioned_matches.size() == matches.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+        const PatternSpan &span = matches.spans()[i];
+        assert(partitioned_matches[i] == matches[i]);
+        assert(partitioned_matches.spans()[i].begin_offset == span.begin_offset);
+        assert(partitioned_matches.spans()[i].end_offset == span.end_offset);
+        // the span starts and ends with the first and last words of the pattern
+        const std::string pattern = patterns[matches[i].pattern];
+        const std::string matched = testString.substr(span.begin_offset, span.end_offset - span.begin_offset);
+        assert(matched.compare(0, matched.find(' '), pattern, 0, pattern.find(' ')) == 0);
+        assert(matched.compare(matched.rfind(' ') + 1, std::string::npos,
+                               pattern, pattern.rfind(' ') + 1, std::string::npos) == 0);
+    }
+    assert(matches.spans()[1].begin_offset == 2 && matches.spans()[1].end_offset == 15);
+
+    PatternMatches<uint8_t> byte_matches(false, true);
+    byte_matcher.find_patterns(testString, byte_matches);
+    for (size_t i = 0; i < byte_matches.size(); ++i) {
+        const PatternSpan &span = byte_matches.spans()[i];
+        assert(testString.substr(span.begin_offset, span.end_offset - span.begin_offset) ==
+               patterns[byte_matches[i].pattern]);
+    }
+
+    // test clear
+    matches.clear();
+    assert(matches.size() == 0 && matches.spans().size() == 0);
+}
+
+
+void
+test8() {
+    // test the normalization inside the tokenizer
+    TextNormalizer normalizer;
+    normalizer.set_ascii_whitespace_delimiters()
+            .set_ascii_punctuation_delimiters()
+            .set_unicode_whitespace_delimiters()
+            .set_unicode_punctuation_delimiters()
+            .set_ascii_case_folding()
+            .set_utf8_case_folding()
+            .set_accent_stripping();
+
+    std::vector<std::string> words;
+    std::vector<size_t> offsets;
+    std::string scratch;
+    const std::string text = "\tCaf\xC3\xA9,  NA\xC3\x8FVE\xC2\xA0\xCE\x91\xCE\xB2\xE2\x80\x94\xD0\x9C\xD0\xB8\xD1\x80 plain";
+    normalizer.for_each_word(text.data(), text.size(), scratch,
+                             [&words, &offsets, &text](const MyString &word, size_t begin, size_t end) {
+                                 words.push_back(std::string(word.data(), word.size()));
+                                 offsets.push_back(begin);
+                                 offsets.push_back(end);
+                                 // the unchanged words point into the text
+                                 assert((word.data() == text.data() + begin) == (word.size() == end - begin &&
+                                         memcmp(word.data(), text.data() + begin, word.size()) == 0));
+                             });
+    assert(words.size() == 5);
+    assert(words[0] == "cafe");
+    assert(words[1] == "naive");
+    assert(words[2] == "\xCE\xB1\xCE\xB2");
+    assert(words[3] == "\xD0\xBC\xD0\xB8\xD1\x80");
+    assert(words[4] == "plain");
+    assert(offsets[0] == 1 && offsets[1] == 6);
+
+    // the same normalization is applied to the patterns and to the texts
+    PatternMatcher<uint8_t> matcher;
+    PartitionedPatternMatcher<uint8_t> partitioned_matcher(3);
+    matcher.set_normalizer(normalizer);
+    partitioned_matcher.set_normalizer(normalizer);
+    const char *patterns[3] = {"Caf\xC3\xA9 na\xC3\xAFve", "PLAIN", "cafe"};
+    for (uint8_t i = 0; i < 3; ++i) {
+        matcher.add_pattern(i, patterns[i]);
+        partitioned_matcher.add_pattern(i, patterns[i]);
+    }
+    matcher.compile();
+    partitioned_matcher.compile();
+    assert(partitioned_matcher.get_partition_id("CAFE plain") == partitioned_matcher.get_partition_id("caf\xC3\xA9"));
+
+    PatternMatches<uint8_t> matches(true, true);
+    PatternMatches<uint8_t> partitioned_matches(true);
+    matcher.find_patterns(text, matches);
+    partitioned_matcher.find_patterns(text, partitioned_matches);
+    assert(matches.size() == 3 && partitioned_matches.size() == 3);
+    assert(matches[0].pattern == 2 && matches[0].end_pos == 0);
+    assert(matches[1].pattern == 0 && matches[1].end_pos == 1);
+    assert(matches[2].pattern == 1 && matches[2].end_pos == 4);
+    assert(matches.spans()[1].begin_offset == 1 && matches.spans()[1].end_offset == 15);
+    for (size_t i = 0; i < matches.size(); ++i) {
+        assert(matches[i] == partitioned_matches[i]);
+    }
+
+    // the normalizer cannot be changed after adding the patterns
+    try {
+        matcher.set_normalizer(TextNormalizer());
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::runtime_error &) {}
+}
+
+
+void
+test9() {
+    Segmenter segmenter;
+    segmenter.add_segment("hello world", Segmenter::default_gain(2, 5));
+    segmenter.add_segment("world string", Segmenter::default_gain(2, 10));
+    segmenter.add_segment("string theory", Segmenter::default_gain(2, 10));
+    segmenter.compile();
+    assert(Segmenter::default_gain(2, 5) == 20 && Segmenter::default_gain(17, 1) == (uint64_t) -1);
+
+    // "world string" overlaps both the other segments, which together have a higher gain
+    std::vector<uint32_t> bounds;
+    segmenter.segment("hello world string", bounds);
+    assert(bounds.size() == 2 && bounds[0] == 1 && bounds[1] == 3);
+    segmenter.segment("hello world string theory", bounds);
+    assert(bounds.size() == 4 && bounds[0] == 0 && bounds[1] == 2 && bounds[2] == 2 && bounds[3] == 4);
+    segmenter.segment("nothing here", bounds);
+    assert(bounds.empty());
+
+    // the same results through the server
+    const std::string socket_path = "/tmp/pattern_matcher_test_" + std::to_string(getpid()) + ".sock";
+    MatcherServer server(segmenter, 2);
+    server.start(socket_path);
+    MatcherClient client;
+    client.connect(socket_path);
+
+    std::vector<uint32_t> result;
+    client.segment("hello world string theory", result);
+    assert(result.size() == 4 && result[0] == 0 && result[1] == 2 && result[2] == 2 && result[3] == 4);
+    client.find_patterns("hello world string", false, result);
+    assert(result.size() == 4 && result[0] == 0 && result[1] == 1 && result[2] == 1 && result[3] == 2);
+
+    // the batches through a small shared memory, so that the rings wrap around
+    client.attach_shared_memory("/pattern_matcher_test_" + std::to_string(getpid()), 96);
+    std::vector<std::string> texts = {"hello world string", "string theory"};
+    std::vector<std::vector<uint32_t>> results;
+    std::vector<uint32_t> statuses;
+    for (int i = 0; i < 5; ++i) {
+        client.process_batch(matcher_protocol::OP_SEGMENT, texts, results, statuses);
+        assert(results.size() == 2 && statuses[0] == matcher_protocol::STATUS_OK);
+        assert(results[0] == std::vector<uint32_t>({1, 3}));
+        assert(results[1] == std::vector<uint32_t>({0, 2}));
+    }
+
+    // a batch that does not fit leaves nothing in the ring, hence the next batch gets its own results
+    std::vector<std::string> large_texts = {"hello world", std::string(200, 'x')};
+    try {
+        client.process_batch(matcher_protocol::OP_SEGMENT, large_texts, results, statuses);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::runtime_error &) {}
+    client.process_batch(matcher_protocol::OP_SEGMENT, texts, results, statuses);
+    assert(results.size() == 2 && results[0] == std::vector<uint32_t>({1, 3}));
+
+    // a batch count larger than the ring and an oversized frame are rejected without allocating them
+    {
+        const std::string raw_shm_name = "/pattern_matcher_test_raw_" + std::to_string(getpid());
+        matcher_protocol::ShmRegion raw_region;
+        raw_region.create(raw_shm_name, 96);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+        const int raw_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        assert(::connect(raw_fd, (struct sockaddr *) &address, sizeof(address)) == 0);
+        uint32_t code;
+        std::string raw_payload;
+        matcher_protocol::write_frame(raw_fd, matcher_protocol::OP_ATTACH_SHM, raw_shm_name.data(),
+                                      raw_shm_name.size());
+        assert(matcher_protocol::read_frame(raw_fd, code, raw_payload) && code == matcher_protocol::STATUS_OK);
+        const uint32_t huge_count = 4000000000U;
+        matcher_protocol::write_frame(raw_fd, matcher_protocol::OP_SHM_BATCH, &huge_count, sizeof(uint32_t));
+        assert(matcher_protocol::read_frame(raw_fd, code, raw_payload) && code == matcher_protocol::STATUS_ERROR);
+        assert(raw_payload == std::string(sizeof(uint32_t), '\0'));
+        const uint32_t oversized_header[2] = {matcher_protocol::OP_SEGMENT,
+                                              matcher_protocol::MAX_REQUEST_FRAME_SIZE + 1};
+        matcher_protocol::write_all(raw_fd, oversized_header, sizeof(oversized_header));
+        assert(!matcher_protocol::read_frame(raw_fd, code, raw_payload));
+        ::close(raw_fd);
+    }
+
+    // the threads of the closed connections are joined when the next connection is accepted
+    for (int i = 0; i < 5; ++i) {
+        MatcherClient short_client;
+        short_client.connect(socket_path);
+        short_client.segment("hello world", result);
+        short_client.close();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    MatcherClient last_client;
+    last_client.connect(socket_path);
+    last_client.segment("hello world", result);
+    assert(server.get_num_connection_threads() == 2);
+    last_client.close();
+
+    client.close();
+    server.stop();
+
+    // the records and the capacity written by a client are validated before being read
+    std::vector<uint64_t> ring_memory(32, 0);
+    char *ring_region = (char *) ring_memory.data();
+    matcher_protocol::ShmRing ring(ring_region, 0, 8, 16, 64);
+    uint32_t code;
+    const char *record_payload;
+    size_t record_payload_size;
+    const uint32_t large_size = 100;
+    memcpy(ring_region + 16, &large_size, sizeof(uint32_t));
+    ring_memory[1] = 16;
+    try {
+        ring.peek(0, code, record_payload, record_payload_size);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::runtime_error &) {}
+    const uint32_t small_size = 8;
+    memcpy(ring_region + 16 + 56, &matcher_protocol::RING_WRAP_MARKER, sizeof(uint32_t));
+    memcpy(ring_region + 16, &small_size, sizeof(uint32_t));
+    ring_memory[1] = 64;
+    try {
+        ring.peek(56, code, record_payload, record_payload_size);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::runtime_error &) {}
+    ring_memory[1] = 80;
+    assert(ring.peek(56, code, record_payload, record_payload_size) == 80 && record_payload_size == 4);
+
+    const std::string shm_name = "/pattern_matcher_test_capacity_" + std::to_string(getpid());
+    const int shm_fd = ::shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    assert(shm_fd >= 0 && ::ftruncate(shm_fd, matcher_protocol::SHM_HEADER_SIZE + 64) == 0);
+    const uint64_t shm_header[2] = {matcher_protocol::SHM_MAGIC, 0};
+    assert(::pwrite(shm_fd, shm_header, sizeof(shm_header), 0) == sizeof(shm_header));
+    ::close(shm_fd);
+    matcher_protocol::ShmRegion shm_region;
+    try {
+        shm_region.open(shm_name);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::runtime_error &) {}
+    ::shm_unlink(shm_name.c_str());
+}
+
+void
+test10() {
+    // fake sysfs with two nodes on the CPU 0: the second one has not enough free memory for a local replica
+    const std::string sysfs_path = "/tmp/pattern_matcher_test_numa_" + std::to_string(getpid());
+    const char *node_lines[2][2] = {{"0", "Node 0 MemFree:        4194304 kB"}, {"0", "Node 1 MemFree:           1024 kB"}};
+    for (int i = 0; i < 2; ++i) {
+        const std::string node_path = sysfs_path + "/node" + std::to_string(i);
+        system(("mkdir -p " + node_path).c_str());
+        std::ofstream((node_path + "/cpulist").c_str()) << node_lines[i][0] << std::endl;
+        std::ofstream((node_path + "/meminfo").c_str()) << node_lines[i][1] << std::endl;
+    }
+    NumaTopology topology(sysfs_path);
+    system(("rm -rf " + sysfs_path).c_str());
+    assert(topology.get_num_nodes() == 2);
+    assert(topology.get_node(0).free_bytes == 4194304ULL * 1024 && topology.get_node(1).free_bytes == 1024 * 1024);
+
+    std::vector<int> cpus;
+    NumaTopology::parse_cpulist("0-2,5,7-8", cpus);
+    assert(cpus == std::vector<int>({0, 1, 2, 5, 7, 8}));
+    assert(NumaTopology("/nonexistent").get_num_nodes() == 1);
+
+    PatternMatcher<uint32_t> matcher;
+    const char *patterns[3] = {"hello", "world", "hello world"};
+    for (uint32_t i = 0; i < 3; ++i) {
+        matcher.add_pattern(i, patterns[i]);
+    }
+    matcher.compile();
+
+    NumaReplicatedMatcher<PatternMatcher<uint32_t>> replicated_matcher(matcher, topology, 16 * 1024 * 1024);
+    assert(replicated_matcher.get_num_replicas() == 2);
+    assert(replicated_matcher.is_local_replica(0) && !replicated_matcher.is_local_replica(1));
+
+    // every worker uses the replica of its node, with the same results of the original matcher
+    const std::vector<std::string> texts = {"hello world", "world hello", "hello hello world", "nothing"};
+    std::vector<PatternMatches<uint32_t>> v_matches(texts.size(), PatternMatches<uint32_t>(true));
+    NumaWorkerPool pool(topology, 2);
+    assert(pool.size() == 4);
+    pool.parallel_for(texts.size(), [&texts, &v_matches, &replicated_matcher](size_t i, size_t node_index) {
+        replicated_matcher.get_replica(node_index).find_patterns(texts[i], v_matches[i]);
+    });
+    for (size_t i = 0; i < texts.size(); ++i) {
+        PatternMatches<uint32_t> matches(true);
+        matcher.find_patterns(texts[i], matches);
+        assert(matches.size() == v_matches[i].size());
+        for (size_t j = 0; j < matches.size(); ++j) {
+            assert(matches[j] == v_matches[i][j]);
+        }
+    }
+}
+
+void
+test11() {
+    // the bit-packed arrays keep the values that cross the 64 bits words
+    PackedIntArray packed(100, 1000);
+    for (size_t i = 0; i < 100; ++i) {
+        packed.set(i, i * 10);
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        assert(packed.get(i) == i * 10);
+    }
+    SuccinctBitVector bits;
+    for (size_t i = 0; i < 3000; ++i) {
+        bits.push_back(i % 3 == 0);
+    }
+    bits.build_index();
+    assert(bits.rank1(0) == 0 && bits.rank1(1) == 1 && bits.rank1(2999) == 1000);
+    assert(bits.select0(1) == 1 && bits.select0(2) == 2 && bits.select0(2000) == 2999);
+    assert(bits.next0(3) == 4);
+
+    // the same matches of PatternMatcher, in the same order
+    const char *patterns[7] = {"hello", "world", "hello world", "world wide web", "wide", "web", "a hello world"};
+    PatternMatcher<uint32_t> matcher;
+    SuccinctPatternMatcher<uint32_t> succinct_matcher;
+    for (uint32_t i = 0; i < 7; ++i) {
+        matcher.add_pattern(i + 100, patterns[i]);
+        succinct_matcher.add_pattern(i + 100, patterns[i]);
+    }
+    matcher.compile();
+    succinct_matcher.compile();
+    assert(succinct_matcher.get_num_patterns() == 7);
+    assert(succinct_matcher.get_num_states() == 11);
+
+    const char *texts[3] = {"a hello world wide web", "hello hello world world", "nothing to see"};
+    for (size_t i = 0; i < 3; ++i) {
+        for (int include_suffixes = 0; include_suffixes < 2; ++include_suffixes) {
+            PatternMatches<uint32_t> matches(include_suffixes, true);
+            PatternMatches<uint32_t> succinct_matches(include_suffixes, true);
+            matcher.find_patterns(texts[i], matches);
+            succinct_matcher.find_patterns(texts[i], succinct_matches);
+            assert(matches.size() == succinct_matches.size());
+            for (size_t j = 0; j < matches.size(); ++j) {
+                assert(matches[j] == succinct_matches[j]);
+                assert(matches.spans()[j].begin_offset == succinct_matches.spans()[j].begin_offset);
+                assert(matches.spans()[j].end_offset == succinct_matches.spans()[j].end_offset);
+            }
+        }
+    }
+
+    // the duplicated patterns are found during the compilation
+    SuccinctPatternMatcher<uint32_t> duplicated_matcher;
+    duplicated_matcher.add_pattern(0, "hello world");
+    duplicated_matcher.add_pattern(1, "hello  world");
+    try {
+        duplicated_matcher.compile();
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::invalid_argument &) {}
+}
+
+void
+test12() {
+    // "a b" is inserted before the longer "a b c", which overlaps "c d"
+    const char *patterns[5] = {"a b c d e f", "a b", "c d", "b c", "a b c"};
+    PatternMatcher<uint32_t> matcher;
+    SuccinctPatternMatcher<uint32_t> succinct_matcher;
+    for (uint32_t i = 0; i < 5; ++i) {
+        matcher.add_pattern(i, patterns[i]);
+        succinct_matcher.add_pattern(i, patterns[i]);
+    }
+    matcher.compile();
+    succinct_matcher.compile();
+
+    // the match of "a b" is deferred until "a b c d e f" cannot match anymore
+    PatternMatches<uint32_t> first_matches(false, true, MATCH_LEFTMOST_FIRST);
+    matcher.find_patterns("a b c d x", first_matches);
+    assert(first_matches.size() == 2);
+    assert(first_matches[0] == PatternMatch<uint32_t>(1, 1) && first_matches[1] == PatternMatch<uint32_t>(2, 3));
+    assert(first_matches.spans()[0].begin_offset == 0 && first_matches.spans()[0].end_offset == 3);
+    assert(first_matches.spans()[1].begin_offset == 4 && first_matches.spans()[1].end_offset == 7);
+
+    PatternMatches<uint32_t> longest_matches(false, true, MATCH_LEFTMOST_LONGEST);
+    PatternMatches<uint32_t> succinct_longest_matches(false, true, MATCH_LEFTMOST_LONGEST);
+    matcher.find_patterns("a b c d x", longest_matches);
+    succinct_matcher.find_patterns("a b c d x", succinct_longest_matches);
+    assert(longest_matches.size() == 1 && longest_matches[0] == PatternMatch<uint32_t>(4, 2));
+    assert(longest_matches.spans()[0].begin_offset == 0 && longest_matches.spans()[0].end_offset == 5);
+    assert(succinct_longest_matches.size() == 1 && succinct_longest_matches[0] == longest_matches[0]);
+
+    // the longest pattern has also the highest priority
+    const char *text = "x a b c d e f a b";
+    for (int semantics = MATCH_LEFTMOST_FIRST; semantics <= MATCH_LEFTMOST_LONGEST; ++semantics) {
+        PatternMatches<uint32_t> matches(true, false, (MatchSemantics) semantics);
+        assert(!matches.include_suffixes());
+        matcher.find_patterns(text, matches);
+        assert(matches.size() == 2);
+        assert(matches[0] == PatternMatch<uint32_t>(0, 6) && matches[1] == PatternMatch<uint32_t>(1, 8));
+    }
+
+    // the succinct matcher does not keep the insertion order
+    try {
+        succinct_matcher.find_patterns(text, first_matches);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::invalid_argument &) {}
+
+    // the byte-level matcher works on the byte positions
+    BytePatternMatcher<uint32_t> byte_matcher;
+    byte_matcher.add_pattern(0, "ab");
+    byte_matcher.add_pattern(1, "abcd");
+    byte_matcher.add_pattern(2, "bc");
+    byte_matcher.add_pattern(3, "cde");
+    byte_matcher.compile();
+    PatternMatches<uint32_t> byte_first_matches(false, true, MATCH_LEFTMOST_FIRST);
+    byte_matcher.find_patterns("xabcdex", byte_first_matches);
+    assert(byte_first_matches.size() == 2);
+    assert(byte_first_matches[0] == PatternMatch<uint32_t>(0, 2));
+    assert(byte_first_matches[1] == PatternMatch<uint32_t>(3, 5));
+    assert(byte_first_matches.spans()[1].begin_offset == 3 && byte_first_matches.spans()[1].end_offset == 6);
+    PatternMatches<uint32_t> byte_longest_matches(false, false, MATCH_LEFTMOST_LONGEST);
+    byte_matcher.find_patterns("xabcdex", byte_longest_matches);
+    assert(byte_longest_matches.size() == 1 && byte_longest_matches[0] == PatternMatch<uint32_t>(1, 4));
+}
+
+void
+test13() {
+    // a budget smaller than the patterns spills several sorted runs
+    TextNormalizer normalizer;
+    normalizer.set_ascii_case_folding();
+    SuccinctPatternMatcher<uint32_t> matcher;
+    matcher.set_normalizer(normalizer);
+    ExternalMatcherBuilder<uint32_t> builder("/tmp", 1);
+    builder.set_normalizer(normalizer);
+    const char *words[6] = {"alpha", "beta", "gamma", "delta", "Alpha", "omega"};
+    for (uint32_t i = 0; i < 20000; ++i) {
+        // the digits of i in base 6, skipping "Alpha" that is equal to "alpha" after the case folding
+        std::string pattern = words[i % 6];
+        bool has_alpha = (i % 6 == 4);
+        for (uint32_t j = i / 6; j > 0; j /= 6) {
+            pattern += std::string(" ") + words[j % 6];
+            has_alpha = has_alpha || (j % 6 == 4);
+        }
+        if (has_alpha) {
+            continue;
+        }
+        matcher.add_pattern(i, pattern);
+        builder.add_pattern(i, pattern);
+    }
+    matcher.compile();
+    builder.build("/tmp/test13_matcher.bin");
+    assert(builder.get_num_runs() > 1);
+
+    // the built matcher is the same of the compiled one, byte for byte
+    matcher.save("/tmp/test13_compiled.bin");
+    auto read_file = [](const char *path) {
+        std::string content;
+        FILE *file = fopen(path, "rb");
+        assert(file != NULL);
+        char buffer[4096];
+        for (size_t size = fread(buffer, 1, sizeof(buffer), file); size > 0;
+             size = fread(buffer, 1, sizeof(buffer), file)) {
+            content.append(buffer, size);
+        }
+        fclose(file);
+        return content;
+    };
+    const std::string built_content = read_file("/tmp/test13_matcher.bin");
+    assert(!built_content.empty() && built_content == read_file("/tmp/test13_compiled.bin"));
+    remove("/tmp/test13_compiled.bin");
+    SuccinctPatternMatcher<uint32_t> loaded_matcher;
+    loaded_matcher.load("/tmp/test13_matcher.bin");
+    remove("/tmp/test13_matcher.bin");
+    assert(loaded_matcher.get_num_states() == matcher.get_num_states());
+    assert(loaded_matcher.get_num_patterns() == matcher.get_num_patterns());
+    const char *text = "ALPHA beta gamma alpha delta omega beta unknown gamma gamma alpha omega";
+    PatternMatches<uint32_t> matches(true, true);
+    PatternMatches<uint32_t> loaded_matches(true, true);
+    matcher.find_patterns(text, matches);
+    loaded_matcher.find_patterns(text, loaded_matches);
+    assert(!matches.empty() && matches.size() == loaded_matches.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+        assert(matches[i] == loaded_matches[i]);
+        assert(matches.spans()[i].begin_offset == loaded_matches.spans()[i].begin_offset);
+    }
+
+    // the duplicates are found by the merge, even in different runs
+    ExternalMatcherBuilder<uint32_t> duplicated_builder("/tmp", 1);
+    duplicated_builder.add_pattern(0, "hello world");
+    for (uint32_t i = 1; i < 10000; ++i) {
+        duplicated_builder.add_pattern(i, "filler " + std::to_string(i));
+    }
+    duplicated_builder.add_pattern(10000, "hello world");
+    try {
+        duplicated_builder.build("/tmp/test13_duplicated.bin");
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::invalid_argument &) {}
+}
+
+void
+test14() {
+    const std::string segments = "new york\nthe new york times\na b\nsingle\nrare pair";
+    const std::string phrase_keys = "new york\nthe new york times\na b\nsingle\nrare pair";
+    const uint64_t phrase_freqs[5] = {100, 10, 1, 5, 2};
+    // the AND keys are looked up with their words sorted
+    const std::string and_keys = "york new\ntimes york the new\nb a\nsingle\npair  rare";
+    const uint64_t and_freqs[5] = {150, 30, 100, 5, 1};
+    FrequencyTable phrase_table(phrase_keys.data(), phrase_keys.size(), phrase_freqs, 5);
+    FrequencyTable and_table(and_keys.data(), and_keys.size(), and_freqs, 5, true, 2);
+    uint64_t freq = 0;
+    assert(and_table.find(MyString("new the times york", 18), freq) && freq == 30);
+    assert(and_table.find(MyString("pair rare", 9), freq) && freq == 1);
+    assert(!and_table.find(MyString("york new", 8), freq));
+
+    // with the probability filter, "the new york times" is too rare compared to its words
+    SegmenterBuilder::MatcherType matcher;
+    std::vector<uint64_t> gains;
+    std::vector<uint16_t> lengths;
+    SegmenterBuilder(0.5, 2, 3).build(segments.data(), segments.size(), phrase_table, and_table, matcher, gains,
+                                      lengths);
+    assert(gains.size() == 2 && gains[0] == 400 && gains[1] == 8);
+    assert(lengths.size() == 2 && lengths[0] == 2 && lengths[1] == 2);
+    assert(matcher.get_pattern_length(1) == 2);
+
+    // with -1 the AND frequency is compared with the gain
+    Segmenter segmenter;
+    SegmenterBuilder(-1, 2).build(segments.data(), segments.size(), phrase_table, and_table, segmenter);
+    assert(segmenter.size() == 3 && segmenter.get_segment_gain(1) == 2560);
+    std::vector<uint32_t> bounds;
+    segmenter.segment("read the new york times", bounds);
+    assert(bounds.size() == 2 && bounds[0] == 1 && bounds[1] == 5);
+
+    // the tables can be loaded from files
+    const char *path = "/tmp/test14_and_freqs.tsv";
+    FILE *file = fopen(path, "w");
+    fputs("york new\t150\ntimes york the new\t30\n", file);
+    fclose(file);
+    FrequencyTable file_table(path, true);
+    remove(path);
+    assert(file_table.size() == 2 && file_table.find(MyString("new york", 8), freq) && freq == 150);
+
+    // the segments without a phrase frequency are an error
+    const std::string unknown_segments = "new york\nunknown segment";
+    Segmenter unknown_segmenter;
+    try {
+        SegmenterBuilder(0.5, 2).build(unknown_segments.data(), unknown_segments.size(), phrase_table, and_table,
+                                       unknown_segmenter);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::invalid_argument &) {}
+}
+
+void
+test15() {
+    // StopPhrasesMatcher.hpp is generated from stop_phrases.txt, which has these lines, with the same normalizer
+    const char *patterns[12] = {
+            "a b c", "b", "a b c d", "c d", "d e f", "f",
+            "new york", "york", "new york city", "city", "café au lait", "au",
+    };
+    const char *text = "New-York city: a b c d e f; CAFÉ au lait, café au lait, unknown york b";
+    StopPhrasesMatcher generated_matcher;
+    PatternMatcher<uint32_t> matcher;
+    TextNormalizer normalizer;
+    normalizer.set_delimiter(' ', false);
+    normalizer.set_delimiter(' ');
+    normalizer.set_ascii_whitespace_delimiters();
+    normalizer.set_ascii_punctuation_delimiters();
+    normalizer.set_ascii_case_folding(true);
+    matcher.set_normalizer(normalizer);
+    for (uint32_t i = 0; i < 12; ++i) {
+        matcher.add_pattern(i, patterns[i]);
+    }
+    matcher.compile();
+    assert(generated_matcher.get_num_patterns() == 12);
+    assert(generated_matcher.get_pattern_length(8) == matcher.get_pattern_length(8));
+
+    for (int semantics = MATCH_ALL; semantics <= MATCH_LEFTMOST_LONGEST; ++semantics) {
+        for (int include_suffixes = 0; include_suffixes < 2; ++include_suffixes) {
+            PatternMatches<uint32_t> matches(include_suffixes, true, (MatchSemantics) semantics);
+            PatternMatches<uint32_t> generated_matches(include_suffixes, true, (MatchSemantics) semantics);
+            matcher.find_patterns(text, matches);
+            generated_matcher.find_patterns(text, generated_matches);
+            assert(!matches.empty() && matches.size() == generated_matches.size());
+            for (size_t i = 0; i < matches.size(); ++i) {
+                assert(matches[i] == generated_matches[i]);
+                assert(matches.spans()[i].begin_offset == generated_matches.spans()[i].begin_offset);
+                assert(matches.spans()[i].end_offset == generated_matches.spans()[i].end_offset);
+            }
+        }
+    }
+}
+
+void
+test16() {
+    // the id sequences are the texts of PatternMatcher with the word i replaced by i
+    const std::vector<std::vector<uint32_t>> patterns = {{1, 2, 3}, {2}, {1, 2, 3, 4}, {3, 4}, {4, 5, 6}, {6}};
+    const char *texts[3] = {"x 1 2 3 4 5 6 2", "", "2 3 4 5 6 1 2 3"};
+    PatternMatcher<uint32_t> matcher;
+    IdSequenceMatcher<uint32_t> id_matcher;
+    for (uint32_t i = 0; i < (uint32_t) patterns.size(); ++i) {
+        std::string pattern;
+        for (size_t j = 0; j < patterns[i].size(); ++j) {
+            pattern += (j ? " " : "") + std::to_string(patterns[i][j]);
+        }
+        matcher.add_pattern(i, pattern);
+        id_matcher.add_pattern(i, patterns[i]);
+    }
+    matcher.compile();
+    id_matcher.compile();
+
+    // the unknown words have an id that is not in the patterns
+    std::vector<uint32_t> ids;
+    std::vector<uint64_t> offsets(1, 0);
+    for (size_t i = 0; i < 3; ++i) {
+        std::istringstream words(texts[i]);
+        std::string word;
+        while (words >> word) {
+            ids.push_back(word == "x" ? 42 : (uint32_t) std::stoul(word));
+        }
+        offsets.push_back(ids.size());
+    }
+
+    for (int semantics = MATCH_ALL; semantics <= MATCH_LEFTMOST_LONGEST; ++semantics) {
+        for (int include_suffixes = 0; include_suffixes < 2; ++include_suffixes) {
+            IdSequenceMatchesBatch<uint32_t> batch;
+            id_matcher.find_patterns_batch(ids.data(), ids.size(), offsets.data(), 3, include_suffixes,
+                                           (MatchSemantics) semantics, batch);
+            assert(batch.v_offsets.size() == 4);
+            for (size_t i = 0; i < 3; ++i) {
+                PatternMatches<uint32_t> matches(include_suffixes, false, (MatchSemantics) semantics);
+                PatternMatches<uint32_t> id_matches(include_suffixes, true, (MatchSemantics) semantics);
+                matcher.find_patterns(texts[i], matches);
+                id_matcher.find_patterns(ids.data() + offsets[i], offsets[i + 1] - offsets[i], id_matches);
+                assert(matches.size() == id_matches.size());
+                assert(batch.v_offsets[i + 1] - batch.v_offsets[i] == matches.size());
+                for (size_t j = 0; j < matches.size(); ++j) {
+                    const size_t k = batch.v_offsets[i] + j;
+                    assert(matches[j] == id_matches[j] && batch.v_keys[k] == matches[j].pattern);
+                    assert(id_matches.spans()[j].end_offset == matches[j].end_pos + 1);
+                    assert(batch.v_ends[k] == matches[j].end_pos + 1);
+                    assert(batch.v_begins[k] + id_matcher.get_pattern_length(matches[j].pattern) == batch.v_ends[k]);
+                }
+            }
+        }
+    }
+
+    // the offsets must be inside the ids
+    std::vector<uint64_t> bad_offsets = {0, ids.size() + 1};
+    IdSequenceMatchesBatch<uint32_t> batch;
+    try {
+        id_matcher.find_patterns_batch(ids.data(), ids.size(), bad_offsets.data(), 1, true, MATCH_ALL, batch);
+        throw std::exception();  // "Exception not thrown"
+    } catch (std::invalid_argument &) {}
+}
+
 int main(int argc, char **argv) {
     test1();
     test2();
+    test3();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
 
     return 0;
 }